@@ -5,6 +5,8 @@
 #include <Pothos/Config.hpp>
 #include <complex>
 #include <cmath>
+#include <algorithm>
+#include "FastSinCos.hpp"
 
 /*!
  * Generate a chirp
@@ -24,24 +26,71 @@ int genChirp(std::complex<Type> *samps, int N, int ovs, int NN, Type f0, bool do
     const Type fMin = -M_PI / ovs;
     const Type fMax = M_PI / ovs;
     const Type fStep = (2 * M_PI) / (N * ovs * ovs);
+    const Type sign = down?-1:1;
     float f = fMin + f0;
     int i;
-    if (down) {
-        for (i = 0; i < NN; i++) {
+    //accumulate a block of phases, then convert them all at once
+    const int blockSize = 256;
+    Type phase[blockSize];
+    for (i = 0; i < NN;) {
+        const int len = std::min(blockSize, NN-i);
+        for (int j = 0; j < len; j++) {
             f += fStep;
             if (f > fMax) f -= (fMax - fMin);
-            phaseAccum -= f;
-            samps[i] = std::polar(ampl, phaseAccum);
+            phaseAccum += sign*f;
+            phase[j] = phaseAccum;
         }
+        fastPolar(phase, samps+i, len, ampl);
+        i += len;
     }
-    else {
-        for (i = 0; i < NN; i++) {
-            f += fStep;
-            if (f > fMax) f -= (fMax - fMin);
-            phaseAccum += f;
-            samps[i] = std::polar(ampl, phaseAccum);
+    phaseAccum -= floor(phaseAccum / (2 * M_PI)) * 2 * M_PI;
+    return i;
+}
+
+/*!
+ * Generate a chirp at a fractional oversampling ratio.
+ * The chirp spans numChips*ovs samples which need not be an integer,
+ * so the sample grid starts timeOffset samples into the chirp and
+ * the chirp frequency is evaluated at each sample's actual time.
+ * This synthesises chirps directly at any output sample rate
+ * without a separate resampling stage.
+ * \param [out] samps pointer to the output samples
+ * \param N samples per chirp sans the oversampling
+ * \param ovs the fractional oversampling ratio (sample rate / bandwidth)
+ * \param numChips the length of the chirp in chips (N for a full chirp)
+ * \param f0 the phase offset/transmit symbol
+ * \param down true for downchirp, false for up
+ * \param ampl the chrip amplitude
+ * \param [inout] phaseAccum running phase accumulator value
+ * \param [inout] timeOffset fractional sample offset in [0, 1) of the next chirp
+ * \return the number of samples generated, at most ceil(numChips*ovs)
+ */
+template <typename Type>
+int genChirpFrac(std::complex<Type> *samps, int N, double ovs, double numChips, Type f0, bool down, const Type ampl, Type &phaseAccum, double &timeOffset)
+{
+    const double fMin = -M_PI / ovs;
+    const double fSpan = (2 * M_PI) / ovs;
+    const double fStep = (2 * M_PI) / (N * ovs * ovs);
+    const double chirpLen = numChips * ovs;
+    const int NN = int(std::ceil(chirpLen - timeOffset));
+    const double sign = down?-1:1;
+    double accum = phaseAccum;
+    int i;
+    //accumulate a block of phases, then convert them all at once
+    const int blockSize = 256;
+    Type phase[blockSize];
+    for (i = 0; i < NN;) {
+        const int len = std::min(blockSize, NN-i);
+        for (int j = 0; j < len; j++) {
+            double f = f0 + fStep * (timeOffset + i + j + 1);
+            f -= std::floor(f / fSpan) * fSpan;
+            accum += sign * (fMin + f);
+            phase[j] = Type(accum);
         }
+        fastPolar(phase, samps+i, len, ampl);
+        i += len;
     }
-    phaseAccum -= floor(phaseAccum / (2 * M_PI)) * 2 * M_PI;
+    timeOffset += NN - chirpLen;
+    phaseAccum = Type(accum - std::floor(accum / (2 * M_PI)) * 2 * M_PI);
     return i;
 }
@@ -0,0 +1,175 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <complex>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FAST_SIN_COS_SSE2
+#endif
+
+/***********************************************************************
+ * Single precision sin/cos kernel
+ *
+ * The argument is reduced to r in [-pi/4, pi/4] with a 3-part Cody-Waite
+ * reduction by multiples of pi/2, then sin(r) and cos(r) are evaluated
+ * with the minimax polynomials from cephes sinf/cosf and swapped/negated
+ * according to the quadrant.
+ *
+ * Max absolute error versus double precision sin/cos:
+ *   |x| <= 2^13 (all LoRa chirp phases up to SF12): 1e-7
+ *   |x| <= 2^16: 1e-6 (reduction error grows with |x|)
+ *
+ * The vector path is selected at compile time: 8 lanes with AVX2,
+ * 4 lanes with SSE2, and the scalar kernel handles the remainder.
+ **********************************************************************/
+#define FAST_SIN_COS_DP1 1.5703125f
+#define FAST_SIN_COS_DP2 4.837512969970703125e-4f
+#define FAST_SIN_COS_DP3 7.54978995489188216e-8f
+#define FAST_SIN_COS_2OPI 0.636619772367581343f
+
+#define FAST_SIN_COS_S1 -1.6666654611e-1f
+#define FAST_SIN_COS_S2 8.3321608736e-3f
+#define FAST_SIN_COS_S3 -1.9515295891e-4f
+#define FAST_SIN_COS_C1 4.166664568298827e-2f
+#define FAST_SIN_COS_C2 -1.388731625493765e-3f
+#define FAST_SIN_COS_C3 2.443315711809948e-5f
+
+/*!
+ * Scalar sin and cos of a single phase value.
+ */
+static inline void fastSinCos(const float x, float &s, float &c)
+{
+    const float kf = std::nearbyint(x*FAST_SIN_COS_2OPI);
+    const int q = int(kf);
+    float r = x - kf*FAST_SIN_COS_DP1;
+    r -= kf*FAST_SIN_COS_DP2;
+    r -= kf*FAST_SIN_COS_DP3;
+    const float z = r*r;
+    const float ps = r + r*z*(FAST_SIN_COS_S1 + z*(FAST_SIN_COS_S2 + z*FAST_SIN_COS_S3));
+    const float pc = 1.0f - 0.5f*z + z*z*(FAST_SIN_COS_C1 + z*(FAST_SIN_COS_C2 + z*FAST_SIN_COS_C3));
+    switch (q & 3)
+    {
+    case 0: s = ps; c = pc; break;
+    case 1: s = pc; c = -ps; break;
+    case 2: s = -ps; c = -pc; break;
+    default: s = -pc; c = ps; break;
+    }
+}
+
+/*!
+ * Vector sin and cos of an array of phase values.
+ * \param phase the input phases in radians
+ * \param [out] s the sine of each phase
+ * \param [out] c the cosine of each phase
+ * \param n the number of elements
+ */
+static inline void fastSinCos(const float *phase, float *s, float *c, const size_t n)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256 dp1 = _mm256_set1_ps(FAST_SIN_COS_DP1);
+    const __m256 dp2 = _mm256_set1_ps(FAST_SIN_COS_DP2);
+    const __m256 dp3 = _mm256_set1_ps(FAST_SIN_COS_DP3);
+    const __m256 twoOverPi = _mm256_set1_ps(FAST_SIN_COS_2OPI);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i two = _mm256_set1_epi32(2);
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(phase + i);
+        const __m256 kf = _mm256_round_ps(_mm256_mul_ps(x, twoOverPi), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        const __m256i q = _mm256_cvtps_epi32(kf);
+        __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(kf, dp1));
+        r = _mm256_sub_ps(r, _mm256_mul_ps(kf, dp2));
+        r = _mm256_sub_ps(r, _mm256_mul_ps(kf, dp3));
+        const __m256 z = _mm256_mul_ps(r, r);
+
+        __m256 ps = _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(FAST_SIN_COS_S3)), _mm256_set1_ps(FAST_SIN_COS_S2));
+        ps = _mm256_add_ps(_mm256_mul_ps(ps, z), _mm256_set1_ps(FAST_SIN_COS_S1));
+        ps = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(ps, z), r), r);
+
+        __m256 pc = _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(FAST_SIN_COS_C3)), _mm256_set1_ps(FAST_SIN_COS_C2));
+        pc = _mm256_add_ps(_mm256_mul_ps(pc, z), _mm256_set1_ps(FAST_SIN_COS_C1));
+        pc = _mm256_mul_ps(_mm256_mul_ps(pc, z), z);
+        pc = _mm256_add_ps(_mm256_sub_ps(pc, _mm256_mul_ps(z, _mm256_set1_ps(0.5f))), _mm256_set1_ps(1.0f));
+
+        //odd quadrants swap sin and cos, then apply the quadrant signs
+        const __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+        const __m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30));
+        const __m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30));
+        _mm256_storeu_ps(s + i, _mm256_xor_ps(_mm256_blendv_ps(ps, pc, swap), sinSign));
+        _mm256_storeu_ps(c + i, _mm256_xor_ps(_mm256_blendv_ps(pc, ps, swap), cosSign));
+    }
+#elif defined(FAST_SIN_COS_SSE2)
+    const __m128 dp1 = _mm_set1_ps(FAST_SIN_COS_DP1);
+    const __m128 dp2 = _mm_set1_ps(FAST_SIN_COS_DP2);
+    const __m128 dp3 = _mm_set1_ps(FAST_SIN_COS_DP3);
+    const __m128 twoOverPi = _mm_set1_ps(FAST_SIN_COS_2OPI);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(phase + i);
+        const __m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, twoOverPi)); //round to nearest
+        const __m128 kf = _mm_cvtepi32_ps(q);
+        __m128 r = _mm_sub_ps(x, _mm_mul_ps(kf, dp1));
+        r = _mm_sub_ps(r, _mm_mul_ps(kf, dp2));
+        r = _mm_sub_ps(r, _mm_mul_ps(kf, dp3));
+        const __m128 z = _mm_mul_ps(r, r);
+
+        __m128 ps = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(FAST_SIN_COS_S3)), _mm_set1_ps(FAST_SIN_COS_S2));
+        ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(FAST_SIN_COS_S1));
+        ps = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ps, z), r), r);
+
+        __m128 pc = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(FAST_SIN_COS_C3)), _mm_set1_ps(FAST_SIN_COS_C2));
+        pc = _mm_add_ps(_mm_mul_ps(pc, z), _mm_set1_ps(FAST_SIN_COS_C1));
+        pc = _mm_mul_ps(_mm_mul_ps(pc, z), z);
+        pc = _mm_add_ps(_mm_sub_ps(pc, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+        //odd quadrants swap sin and cos, then apply the quadrant signs
+        const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+        const __m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two), 30));
+        const __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30));
+        const __m128 sv = _mm_or_ps(_mm_and_ps(swap, pc), _mm_andnot_ps(swap, ps));
+        const __m128 cv = _mm_or_ps(_mm_and_ps(swap, ps), _mm_andnot_ps(swap, pc));
+        _mm_storeu_ps(s + i, _mm_xor_ps(sv, sinSign));
+        _mm_storeu_ps(c + i, _mm_xor_ps(cv, cosSign));
+    }
+#endif
+
+    for (; i < n; i++) fastSinCos(phase[i], s[i], c[i]);
+}
+
+/*!
+ * Vectorised replacement for std::polar over an array of phases.
+ * Computes out[i] = ampl*exp(j*phase[i]), the input and output may not alias.
+ */
+static inline void fastPolar(const float *phase, std::complex<float> *out, const size_t n, const float ampl = 1.0f)
+{
+    const size_t blockSize = 256;
+    float s[blockSize], c[blockSize];
+    for (size_t i = 0; i < n; i += blockSize)
+    {
+        const size_t len = std::min(blockSize, n-i);
+        fastSinCos(phase + i, s, c, len);
+        for (size_t j = 0; j < len; j++) out[i+j] = std::complex<float>(ampl*c[j], ampl*s[j]);
+    }
+}
+
+/*!
+ * Generic fallback for non-float types using std::polar.
+ */
+template <typename Type>
+static inline void fastPolar(const Type *phase, std::complex<Type> *out, const size_t n, const Type ampl = Type(1))
+{
+    for (size_t i = 0; i < n; i++) out[i] = std::polar(ampl, phase[i]);
+}
@@ -0,0 +1,263 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define LORA_AES_NI
+#include <wmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define LORA_AES_NI_TARGET
+#else
+#define LORA_AES_NI_TARGET __attribute__((target("aes,sse2")))
+#endif
+#endif
+
+/*!
+ * AES-128 CMAC (RFC 4493) for the LoRaWAN message integrity code.
+ * The key schedule and subkeys are computed once per session key.
+ * computeBatch() runs the CBC chains of several messages in lockstep,
+ * so that the AES-NI rounds of independent messages overlap in the pipeline.
+ * The portable implementation is used when the CPU lacks AES-NI.
+ */
+class LoRaAesCmac
+{
+public:
+    //! One message to authenticate in a batch
+    struct Job
+    {
+        const LoRaAesCmac *key;
+        const uint8_t *msg;
+        size_t len;
+        uint8_t mac[16]; //!< [out] the full CMAC, LoRaWAN uses the first 4 bytes
+    };
+
+    //! The number of messages in flight through the AES-NI rounds
+    enum {LANES = 4};
+
+    LoRaAesCmac(void)
+    {
+        std::memset(_roundKeys, 0, sizeof(_roundKeys));
+        std::memset(_k1, 0, sizeof(_k1));
+        std::memset(_k2, 0, sizeof(_k2));
+    }
+
+    //! Create the key schedule and the subkeys for a 16 byte key
+    LoRaAesCmac(const uint8_t *key)
+    {
+        expandKey(key, _roundKeys);
+        uint8_t l[16] = {};
+        encryptBlock(_roundKeys, l);
+        shiftSubkey(l, _k1);
+        shiftSubkey(_k1, _k2);
+    }
+
+    //! True when the CPU supports AES-NI
+    static bool hasAesNi(void)
+    {
+        #if defined(LORA_AES_NI) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 25)) != 0;
+        #elif defined(LORA_AES_NI)
+        return __builtin_cpu_supports("aes");
+        #else
+        return false;
+        #endif
+    }
+
+    //! Compute the CMAC of one message
+    void compute(const uint8_t *msg, const size_t len, uint8_t *mac) const
+    {
+        Job job = {this, msg, len, {}};
+        computeBatch(&job, 1);
+        std::memcpy(mac, job.mac, 16);
+    }
+
+    /*!
+     * Compute the CMAC of many messages, with any mix of keys and lengths.
+     * \param jobs the messages, the mac of each is written in place
+     * \param num the number of jobs
+     * \param aesNi use AES-NI, the caller checks hasAesNi()
+     */
+    static void computeBatch(Job *jobs, const size_t num, const bool aesNi = hasAesNi())
+    {
+        for (size_t j = 0; j < num; j += LANES)
+        {
+            const size_t lanes = std::min<size_t>(LANES, num - j);
+            Job *group = jobs + j;
+            const uint8_t *keys[LANES];
+            uint8_t state[LANES][16] = {};
+            size_t numBlocks[LANES], maxBlocks = 0;
+            for (size_t i = 0; i < lanes; i++)
+            {
+                keys[i] = group[i].key->_roundKeys;
+                numBlocks[i] = std::max<size_t>(1, (group[i].len + 15)/16);
+                maxBlocks = std::max(maxBlocks, numBlocks[i]);
+            }
+
+            //xor the next block of each message into its chain, then encrypt the chains together
+            for (size_t b = 0; b < maxBlocks; b++)
+            {
+                const uint8_t *active[LANES];
+                uint8_t *blocks[LANES];
+                size_t n = 0;
+                for (size_t i = 0; i < lanes; i++)
+                {
+                    if (b >= numBlocks[i]) continue;
+                    group[i].key->xorBlock(group[i].msg, group[i].len, b, b + 1 == numBlocks[i], state[i]);
+                    active[n] = keys[i];
+                    blocks[n] = state[i];
+                    n++;
+                }
+                #ifdef LORA_AES_NI
+                if (aesNi)
+                {
+                    encryptBlocksNi(active, blocks, n);
+                    continue;
+                }
+                #endif
+                for (size_t i = 0; i < n; i++) encryptBlock(active[i], blocks[i]);
+            }
+            for (size_t i = 0; i < lanes; i++) std::memcpy(group[i].mac, state[i], 16);
+        }
+    }
+
+private:
+    //! Xor message block b into the chain, with the padding and subkey on the last block
+    void xorBlock(const uint8_t *msg, const size_t len, const size_t b, const bool last, uint8_t *state) const
+    {
+        const size_t offset = b*16;
+        const size_t n = std::min<size_t>(16, len - std::min(len, offset));
+        for (size_t i = 0; i < n; i++) state[i] ^= msg[offset+i];
+        if (not last) return;
+        if (n == 16)
+        {
+            for (size_t i = 0; i < 16; i++) state[i] ^= _k1[i];
+            return;
+        }
+        state[n] ^= 0x80;
+        for (size_t i = 0; i < 16; i++) state[i] ^= _k2[i];
+    }
+
+    static void shiftSubkey(const uint8_t *in, uint8_t *out)
+    {
+        for (size_t i = 0; i < 15; i++) out[i] = uint8_t((in[i] << 1) | (in[i+1] >> 7));
+        out[15] = uint8_t(in[15] << 1);
+        if (in[0] & 0x80) out[15] ^= 0x87;
+    }
+
+    static const uint8_t *sbox(void)
+    {
+        static const uint8_t table[256] = {
+            0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+            0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+            0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+            0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+            0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+            0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+            0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+            0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+            0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+            0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+            0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+            0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+            0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+            0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+            0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+            0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+        };
+        return table;
+    }
+
+    static uint8_t xtime(const uint8_t x)
+    {
+        return uint8_t((x << 1) ^ ((x & 0x80) ? 0x1b : 0x00));
+    }
+
+    //! The 11 round keys of AES-128, in the byte order used by AES-NI
+    static void expandKey(const uint8_t *key, uint8_t *rk)
+    {
+        const uint8_t *s = sbox();
+        std::memcpy(rk, key, 16);
+        uint8_t rcon = 0x01;
+        for (size_t i = 16; i < 176; i += 4)
+        {
+            uint8_t t[4] = {rk[i-4], rk[i-3], rk[i-2], rk[i-1]};
+            if (i % 16 == 0)
+            {
+                const uint8_t t0 = t[0];
+                t[0] = uint8_t(s[t[1]] ^ rcon);
+                t[1] = s[t[2]];
+                t[2] = s[t[3]];
+                t[3] = s[t0];
+                rcon = xtime(rcon);
+            }
+            for (size_t j = 0; j < 4; j++) rk[i+j] = rk[i+j-16] ^ t[j];
+        }
+    }
+
+    static void encryptBlock(const uint8_t *rk, uint8_t *block)
+    {
+        const uint8_t *s = sbox();
+        uint8_t st[16];
+        for (size_t i = 0; i < 16; i++) st[i] = block[i] ^ rk[i];
+        for (size_t round = 1; round <= 10; round++)
+        {
+            //sub bytes and shift rows, the state is column major
+            uint8_t t[16];
+            for (size_t c = 0; c < 4; c++)
+            {
+                for (size_t r = 0; r < 4; r++) t[4*c+r] = s[st[4*((c+r)%4)+r]];
+            }
+
+            //mix columns on all but the last round
+            if (round != 10) for (size_t c = 0; c < 4; c++)
+            {
+                const uint8_t *a = t + 4*c;
+                const uint8_t x = a[0] ^ a[1] ^ a[2] ^ a[3];
+                st[4*c+0] = a[0] ^ x ^ xtime(a[0] ^ a[1]);
+                st[4*c+1] = a[1] ^ x ^ xtime(a[1] ^ a[2]);
+                st[4*c+2] = a[2] ^ x ^ xtime(a[2] ^ a[3]);
+                st[4*c+3] = a[3] ^ x ^ xtime(a[3] ^ a[0]);
+            }
+            else std::memcpy(st, t, 16);
+
+            for (size_t i = 0; i < 16; i++) st[i] ^= rk[16*round+i];
+        }
+        std::memcpy(block, st, 16);
+    }
+
+    #ifdef LORA_AES_NI
+    //! Encrypt up to LANES blocks in place, each with its own key schedule
+    LORA_AES_NI_TARGET static void encryptBlocksNi(const uint8_t *const *rk, uint8_t *const *blocks, const size_t n)
+    {
+        __m128i st[LANES];
+        for (size_t i = 0; i < n; i++)
+        {
+            st[i] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(blocks[i])), _mm_loadu_si128(reinterpret_cast<const __m128i *>(rk[i])));
+        }
+        for (size_t round = 1; round < 10; round++)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                st[i] = _mm_aesenc_si128(st[i], _mm_loadu_si128(reinterpret_cast<const __m128i *>(rk[i] + 16*round)));
+            }
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            st[i] = _mm_aesenclast_si128(st[i], _mm_loadu_si128(reinterpret_cast<const __m128i *>(rk[i] + 160)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(blocks[i]), st[i]);
+        }
+    }
+    #endif
+
+    uint8_t _roundKeys[176];
+    uint8_t _k1[16];
+    uint8_t _k2[16];
+};
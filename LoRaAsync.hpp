@@ -0,0 +1,382 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#if !defined(__cpp_impl_coroutine)
+#error "LoRaAsync.hpp requires C++20 coroutines"
+#endif
+#include "LoRaSpscQueue.hpp"
+#include "LoRaPacketEncoder.hpp"
+#include "LoRaPacketDecoder.hpp"
+#include "LoRaModulator.hpp"
+#include "LoRaDemodulator.hpp"
+#include <coroutine>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+
+/***********************************************************************
+ * Awaitable interfaces over the PHY cores for code on an event loop.
+ * The samples are processed on the thread that pushes or pulls them,
+ * and the results cross to the awaiting coroutine through lock-free
+ * queues, so there is no thread handoff per packet.
+ **********************************************************************/
+
+/*!
+ * The coroutine handle of a single waiting consumer.
+ * The waiting side re-checks its condition after publishing the handle,
+ * so that a wake between the check and the suspend is not lost.
+ */
+class LoRaAsyncWaiter
+{
+public:
+    LoRaAsyncWaiter(void):
+        _handle(nullptr)
+    {
+        return;
+    }
+
+    /*!
+     * Resume the waiter with the executor, or inline on the calling thread.
+     * An event loop sets an executor that posts the handle to the loop.
+     */
+    void setExecutor(std::function<void(std::coroutine_handle<>)> executor)
+    {
+        _executor = std::move(executor);
+    }
+
+    //! Publish the handle, false when the condition is met and the handle is taken back
+    template <typename Ready>
+    bool suspend(const std::coroutine_handle<> h, const Ready &ready)
+    {
+        _handle.store(h.address(), std::memory_order_release);
+        if (not ready()) return true;
+        void *expected = h.address();
+        return not _handle.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel);
+    }
+
+    //! Resume the waiting coroutine if there is one
+    void wake(void)
+    {
+        void *address = _handle.exchange(nullptr, std::memory_order_acq_rel);
+        if (address == nullptr) return;
+        auto h = std::coroutine_handle<>::from_address(address);
+        if (_executor) _executor(h);
+        else h.resume();
+    }
+
+private:
+    std::atomic<void *> _handle;
+    std::function<void(std::coroutine_handle<>)> _executor;
+};
+
+//! A decoded packet with the measurements from its sync
+struct LoRaAsyncPacket
+{
+    std::vector<uint8_t> payload;
+    unsigned long long index; //!< input sample index of the first data symbol
+    int cfo; //!< coarse frequency error in bins
+    float snr;
+    float power;
+};
+
+/*!
+ * Receive packets from pushed sample spans.
+ * One thread pushes samples: the demodulator and decoder run inline,
+ * and decoded packets are queued for one coroutine awaiting next().
+ *
+ *     while (auto packet = co_await rx.next()) handle(*packet);
+ */
+class LoRaAsyncRx
+{
+public:
+    LoRaAsyncRx(const size_t sf, const size_t queueSize = 64):
+        _demod(sf),
+        _packets(queueSize),
+        _index(0),
+        _closed(false),
+        _dropped(0),
+        _errors(0)
+    {
+        _decoder.sf = sf;
+        _decoder.errorCheck = true;
+        _demod.enableLabels(false);
+    }
+
+    //! Configure the demodulator before the first push
+    LoRaDemodulator &demodulator(void)
+    {
+        return _demod;
+    }
+
+    //! Configure the decoder before the first push
+    LoRaPacketDecoder &decoder(void)
+    {
+        return _decoder;
+    }
+
+    void setExecutor(std::function<void(std::coroutine_handle<>)> executor)
+    {
+        _waiter.setExecutor(std::move(executor));
+    }
+
+    /*!
+     * Producer: demodulate the next samples of the stream.
+     * Whole steps are read from the span in place, and only the samples
+     * of a step that straddles two pushes are copied.
+     * \return the number of packets queued
+     */
+    size_t push(std::span<const std::complex<float>> samps)
+    {
+        size_t numPackets = 0;
+        _steps.process(_demod, samps.data(), samps.size(),
+            [this, &numPackets](const std::complex<float> *in){return this->step(in, numPackets);});
+
+        if (numPackets != 0) _waiter.wake();
+        return numPackets;
+    }
+
+    //! Producer: end the stream, next() returns an empty result once the queue drains
+    void close(void)
+    {
+        _closed.store(true, std::memory_order_release);
+        _waiter.wake();
+    }
+
+    //! The number of packets dropped on a full queue
+    unsigned long long dropped(void) const
+    {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+    //! The number of demodulated packets that failed to decode
+    unsigned long long errors(void) const
+    {
+        return _errors.load(std::memory_order_relaxed);
+    }
+
+    //! Consumer: await the next decoded packet, empty when closed
+    auto next(void)
+    {
+        struct Awaiter
+        {
+            LoRaAsyncRx &rx;
+            std::optional<LoRaAsyncPacket> packet;
+
+            bool await_ready(void)
+            {
+                return rx.tryPop(packet) or rx.isClosed();
+            }
+
+            bool await_suspend(const std::coroutine_handle<> h)
+            {
+                return rx._waiter.suspend(h, [this]{return not rx._packets.empty() or rx.isClosed();});
+            }
+
+            std::optional<LoRaAsyncPacket> await_resume(void)
+            {
+                if (not packet) rx.tryPop(packet);
+                return std::move(packet);
+            }
+        };
+        return Awaiter{*this, std::nullopt};
+    }
+
+private:
+    size_t step(const std::complex<float> *in, size_t &numPackets)
+    {
+        const size_t consumed = _demod.step(in);
+        _index += consumed;
+        if (_demod.syncFound())
+        {
+            _sync.index = _index + _demod.dataSymbolsDelay();
+            _sync.cfo = _demod.freqError();
+            _sync.snr = _demod.snr();
+            _sync.power = _demod.power();
+        }
+        if (not _demod.packetReady()) return consumed;
+
+        if (_decoder.decode(_demod.symbols(), _demod.numSymbols()) != LoRaPacketDecoder::DECODE_OK)
+        {
+            _errors.fetch_add(1, std::memory_order_relaxed);
+            return consumed;
+        }
+        LoRaAsyncPacket packet(_sync);
+        packet.payload.assign(_decoder.payload(), _decoder.payload() + _decoder.length());
+        if (_packets.push(std::move(packet))) numPackets++;
+        else _dropped.fetch_add(1, std::memory_order_relaxed);
+        return consumed;
+    }
+
+    bool tryPop(std::optional<LoRaAsyncPacket> &packet)
+    {
+        LoRaAsyncPacket p;
+        if (not _packets.pop(p)) return false;
+        packet = std::move(p);
+        return true;
+    }
+
+    bool isClosed(void) const
+    {
+        return _closed.load(std::memory_order_acquire);
+    }
+
+    LoRaDemodulator _demod;
+    LoRaPacketDecoder _decoder;
+    LoRaSpscQueue<LoRaAsyncPacket> _packets;
+    LoRaAsyncWaiter _waiter;
+    LoRaStepBuffer _steps;
+    unsigned long long _index;
+    LoRaAsyncPacket _sync;
+    std::atomic<bool> _closed;
+    std::atomic<unsigned long long> _dropped;
+    std::atomic<unsigned long long> _errors;
+};
+
+/*!
+ * Transmit payloads as samples pulled by the radio.
+ * One coroutine sends payloads and awaits their completion,
+ * and one thread pulls the modulated samples for the radio.
+ *
+ *     tx.send(payload);
+ *     co_await tx.sent();
+ */
+class LoRaAsyncTx
+{
+public:
+    LoRaAsyncTx(const size_t sf, const size_t queueSize = 16):
+        _mod(sf),
+        _payloads(queueSize),
+        _offset(0),
+        _stepEnd(false),
+        _completed(0),
+        _reported(0)
+    {
+        _encoder.sf = sf;
+    }
+
+    //! Configure the modulator before the first pull
+    LoRaModulator &modulator(void)
+    {
+        return _mod;
+    }
+
+    //! Configure the encoder before the first pull
+    LoRaPacketEncoder &encoder(void)
+    {
+        return _encoder;
+    }
+
+    void setExecutor(std::function<void(std::coroutine_handle<>)> executor)
+    {
+        _waiter.setExecutor(std::move(executor));
+    }
+
+    //! Consumer: queue a payload to transmit, false when the queue is full
+    bool send(std::vector<uint8_t> payload)
+    {
+        return _payloads.push(std::move(payload));
+    }
+
+    //! Consumer: await the completion of sent payloads, returns the number completed
+    auto sent(void)
+    {
+        struct Awaiter
+        {
+            LoRaAsyncTx &tx;
+
+            bool await_ready(void)
+            {
+                return tx.ready();
+            }
+
+            bool await_suspend(const std::coroutine_handle<> h)
+            {
+                return tx._waiter.suspend(h, [this]{return tx.ready();});
+            }
+
+            size_t await_resume(void)
+            {
+                const size_t completed = tx._completed.load(std::memory_order_acquire);
+                const size_t num = completed - tx._reported;
+                tx._reported = completed;
+                return num;
+            }
+        };
+        return Awaiter{*this};
+    }
+
+    /*!
+     * Producer: fill the radio buffer with the queued frames.
+     * A payload completes when the last of its samples is written.
+     * \return the number of samples written, less than the span when idle
+     */
+    size_t pull(std::span<std::complex<float>> out)
+    {
+        size_t produced = 0;
+        size_t completed = 0;
+        while (produced < out.size())
+        {
+            //the rest of a step that did not fit the last pull
+            if (_offset < _step.size())
+            {
+                const size_t n = std::min(out.size() - produced, _step.size() - _offset);
+                std::copy(_step.begin() + _offset, _step.begin() + _offset + n, out.data() + produced);
+                _offset += n;
+                produced += n;
+                if (_offset == _step.size() and _stepEnd) completed++;
+                continue;
+            }
+
+            if (not _mod.active())
+            {
+                std::vector<uint8_t> payload;
+                if (not _payloads.pop(payload)) break;
+                _encoder.encode(payload.data(), payload.size(), _symbols);
+                _mod.start(_symbols.data(), _symbols.size());
+            }
+
+            //step directly into the output when there is room
+            bool txEnd = false;
+            const size_t room = out.size() - produced;
+            if (room >= _mod.maxStepSamples())
+            {
+                produced += _mod.step(out.data() + produced, _id, txEnd);
+                if (txEnd) completed++;
+            }
+            else
+            {
+                _step.resize(_mod.maxStepSamples());
+                _step.resize(_mod.step(_step.data(), _id, txEnd));
+                _offset = 0;
+                _stepEnd = txEnd;
+            }
+        }
+
+        if (completed != 0)
+        {
+            _completed.fetch_add(completed, std::memory_order_acq_rel);
+            _waiter.wake();
+        }
+        return produced;
+    }
+
+private:
+    bool ready(void) const
+    {
+        return _completed.load(std::memory_order_acquire) != _reported;
+    }
+
+    LoRaModulator _mod;
+    LoRaPacketEncoder _encoder;
+    LoRaSpscQueue<std::vector<uint8_t>> _payloads;
+    LoRaAsyncWaiter _waiter;
+    std::vector<uint16_t> _symbols;
+    std::vector<std::complex<float>> _step;
+    size_t _offset;
+    bool _stepEnd;
+    std::string _id;
+    std::atomic<size_t> _completed;
+    size_t _reported;
+};
@@ -0,0 +1,165 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+/*!
+ * Block floating point compression of complex samples.
+ * Each block of samples shares one exponent byte, chosen from the largest
+ * component in the block, followed by the I and Q mantissas in 8 bits,
+ * or in 6 bits packed four to three bytes. The encoded block size is fixed,
+ * so the byte offset of any sample in a capture is known without a search.
+ * The loops work on whole blocks without branches so that they vectorise.
+ */
+class LoRaBfpCodec
+{
+public:
+    //! The size of the capture file header in bytes
+    enum {HEADER_SIZE = 16};
+
+    /*!
+     * Create a codec, the caller validates the parameters.
+     * \param bits the mantissa size: 6 or 8
+     * \param blockSize the number of complex samples per block, a multiple of 2
+     */
+    LoRaBfpCodec(const size_t bits = 8, const size_t blockSize = 32):
+        _bits(bits),
+        _blockSize(blockSize),
+        _mantissas(2*blockSize)
+    {
+        return;
+    }
+
+    size_t bits(void) const
+    {
+        return _bits;
+    }
+
+    //! The number of complex samples per block
+    size_t blockSize(void) const
+    {
+        return _blockSize;
+    }
+
+    //! The number of encoded bytes per block
+    size_t blockBytes(void) const
+    {
+        return 1 + (2*_blockSize*_bits)/8;
+    }
+
+    //! Encode one block of samples into blockBytes() bytes
+    void encode(const std::complex<float> *in, uint8_t *out)
+    {
+        const float *x = reinterpret_cast<const float *>(in);
+        const size_t n = 2*_blockSize;
+
+        //the bits of a positive float order the same as its value
+        uint32_t peakBits = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            uint32_t b;
+            std::memcpy(&b, x + i, sizeof(b));
+            peakBits = std::max(peakBits, b & 0x7fffffff);
+        }
+        float peak;
+        std::memcpy(&peak, &peakBits, sizeof(peak));
+
+        //the largest component maps just below the full scale mantissa
+        int exp = 0;
+        std::frexp(peak, &exp);
+        exp = std::max(-100, std::min(100, exp));
+        const int top = (1 << (_bits-1)) - 1;
+        const float scale = std::ldexp(1.0f, int(_bits) - 1 - exp);
+        for (size_t i = 0; i < n; i++)
+        {
+            const float v = x[i]*scale;
+            const int q = int(v + ((v < 0.0f) ? -0.5f : 0.5f));
+            _mantissas[i] = int8_t(std::max(-top, std::min(top, q)));
+        }
+
+        out[0] = uint8_t(int8_t(exp));
+        if (_bits == 8) std::memcpy(out + 1, _mantissas.data(), n);
+        else pack6(_mantissas.data(), out + 1, n);
+    }
+
+    //! Decode one block of blockBytes() bytes into samples
+    void decode(const uint8_t *in, std::complex<float> *out)
+    {
+        float *y = reinterpret_cast<float *>(out);
+        const size_t n = 2*_blockSize;
+        const int exp = int8_t(in[0]);
+        const float scale = std::ldexp(1.0f, exp - (int(_bits) - 1));
+        if (_bits == 8) std::memcpy(_mantissas.data(), in + 1, n);
+        else unpack6(in + 1, _mantissas.data(), n);
+        for (size_t i = 0; i < n; i++) y[i] = _mantissas[i]*scale;
+    }
+
+    //! Write the capture file header for the number of samples
+    void encodeHeader(uint8_t *hdr, const unsigned long long numSamples) const
+    {
+        std::memset(hdr, 0, HEADER_SIZE);
+        std::memcpy(hdr, "LBFP", 4);
+        hdr[4] = 1; //version
+        hdr[5] = uint8_t(_bits);
+        hdr[6] = uint8_t(_blockSize & 0xff);
+        hdr[7] = uint8_t(_blockSize >> 8);
+        for (size_t i = 0; i < 8; i++) hdr[8+i] = uint8_t(numSamples >> (8*i));
+    }
+
+    /*!
+     * Read a capture file header and configure the codec to match.
+     * \return false when the header is not a supported capture
+     */
+    bool decodeHeader(const uint8_t *hdr, unsigned long long &numSamples)
+    {
+        if (std::memcmp(hdr, "LBFP", 4) != 0 or hdr[4] != 1) return false;
+        const size_t bits = hdr[5];
+        const size_t blockSize = hdr[6] | (size_t(hdr[7]) << 8);
+        if ((bits != 6 and bits != 8) or blockSize == 0 or blockSize % 2 != 0) return false;
+        *this = LoRaBfpCodec(bits, blockSize);
+        numSamples = 0;
+        for (size_t i = 0; i < 8; i++) numSamples |= (unsigned long long)(hdr[8+i]) << (8*i);
+        return true;
+    }
+
+private:
+    //! Pack four 6-bit mantissas into three bytes
+    static void pack6(const int8_t *in, uint8_t *out, const size_t n)
+    {
+        for (size_t i = 0; i < n/4; i++)
+        {
+            const uint32_t w =
+                (uint32_t(in[4*i+0] & 0x3f) << 0) |
+                (uint32_t(in[4*i+1] & 0x3f) << 6) |
+                (uint32_t(in[4*i+2] & 0x3f) << 12) |
+                (uint32_t(in[4*i+3] & 0x3f) << 18);
+            out[3*i+0] = uint8_t(w >> 0);
+            out[3*i+1] = uint8_t(w >> 8);
+            out[3*i+2] = uint8_t(w >> 16);
+        }
+    }
+
+    //! Unpack three bytes into four sign extended 6-bit mantissas
+    static void unpack6(const uint8_t *in, int8_t *out, const size_t n)
+    {
+        for (size_t i = 0; i < n/4; i++)
+        {
+            const uint32_t w = in[3*i+0] | (uint32_t(in[3*i+1]) << 8) | (uint32_t(in[3*i+2]) << 16);
+            out[4*i+0] = int8_t(uint8_t(w << 2)) >> 2;
+            out[4*i+1] = int8_t(uint8_t(w >> 4)) >> 2;
+            out[4*i+2] = int8_t(uint8_t(w >> 10)) >> 2;
+            out[4*i+3] = int8_t(uint8_t(w >> 16)) >> 2;
+        }
+    }
+
+    size_t _bits;
+    size_t _blockSize;
+    std::vector<int8_t> _mantissas;
+};
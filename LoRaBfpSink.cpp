@@ -0,0 +1,170 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Framework.hpp>
+#include "LoRaBfpCodec.hpp"
+#include <complex>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+
+/***********************************************************************
+ * |PothosDoc LoRa BFP Capture Sink
+ *
+ * Record a complex sample stream to a compressed capture file.
+ * The samples are stored in block floating point: each block of samples
+ * shares an exponent, and each I and Q component keeps an 8 or 6-bit mantissa.
+ * An 8-bit capture is about 4 times smaller than complex float32,
+ * and a 6-bit capture about 5 times smaller, with a quantization SNR
+ * of about 42 and 30 dB over the peak of each block.
+ * The blocks are a fixed size, so that the LoRa BFP Capture Source
+ * can start a replay at any sample index without reading the file.
+ *
+ * The file is a 16 byte header ("LBFP", version, mantissa bits,
+ * block size, and the number of samples) followed by the encoded blocks.
+ * The last block is zero padded, and the header is completed on deactivation.
+ *
+ * |category /LoRa
+ * |keywords lora capture record file compress
+ *
+ * |param path[File Path] The path of the capture file to write.
+ * |default ""
+ * |widget FileEntry(mode=save)
+ *
+ * |param bits[Mantissa bits] The number of bits per I and Q component.
+ * A change while recording takes effect on the next activation.
+ * |option [8 bits] 8
+ * |option [6 bits] 6
+ * |default 8
+ *
+ * |param blockSize[Block size] The number of samples that share an exponent.
+ * Smaller blocks follow the signal envelope more closely at the cost of an exponent byte per block.
+ * A change while recording takes effect on the next activation.
+ * |units samples
+ * |default 32
+ *
+ * |factory /lora/bfp_capture_sink(path)
+ * |setter setBits(bits)
+ * |setter setBlockSize(blockSize)
+ **********************************************************************/
+class LoRaBfpSink : public Pothos::Block
+{
+public:
+    LoRaBfpSink(const std::string &path):
+        _path(path),
+        _bits(8),
+        _blockSize(32),
+        _numSamples(0)
+    {
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaBfpSink, setBits));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaBfpSink, setBlockSize));
+        this->setupInput(0, typeid(std::complex<float>));
+    }
+
+    static Block *make(const std::string &path)
+    {
+        return new LoRaBfpSink(path);
+    }
+
+    void setBits(const size_t bits)
+    {
+        if (bits != 6 and bits != 8) throw Pothos::InvalidArgumentException("LoRaBfpSink::setBits("+std::to_string(bits)+")", "mantissa bits must be 6 or 8");
+        _bits = bits;
+    }
+
+    void setBlockSize(const size_t blockSize)
+    {
+        if (blockSize == 0 or blockSize % 2 != 0 or blockSize > 0xffff) throw Pothos::InvalidArgumentException("LoRaBfpSink::setBlockSize("+std::to_string(blockSize)+")", "block size must be even and non-zero");
+        _blockSize = blockSize;
+    }
+
+    void activate(void)
+    {
+        _codec = LoRaBfpCodec(_bits, _blockSize);
+        _file.open(_path, std::ios::binary | std::ios::trunc);
+        if (not _file) throw Pothos::FileException("LoRaBfpSink::activate("+_path+")", "failed to open");
+        _numSamples = 0;
+        _partial.clear();
+        this->writeHeader();
+    }
+
+    void deactivate(void)
+    {
+        //zero pad the last block and complete the header
+        if (not _partial.empty())
+        {
+            _partial.resize(_codec.blockSize(), 0.0f);
+            this->writeBlocks(_partial.data(), 1);
+        }
+        _file.seekp(0);
+        this->writeHeader();
+        _file.close();
+    }
+
+    void work(void)
+    {
+        auto inPort = this->input(0);
+        const size_t num = inPort->elements();
+        if (num == 0) return;
+        auto in = inPort->buffer().as<const std::complex<float> *>();
+        size_t i = 0;
+
+        //split by the codec block size, the setters only apply on activation
+        const size_t blockSize = _codec.blockSize();
+
+        //complete a partial block from the last call
+        if (not _partial.empty())
+        {
+            i = std::min(num, blockSize - _partial.size());
+            _partial.insert(_partial.end(), in, in + i);
+            if (_partial.size() < blockSize)
+            {
+                _numSamples += i;
+                return inPort->consume(i);
+            }
+            this->writeBlocks(_partial.data(), 1);
+            _partial.clear();
+        }
+
+        //encode whole blocks directly from the input buffer
+        const size_t numBlocks = (num - i)/blockSize;
+        if (numBlocks != 0) this->writeBlocks(in + i, numBlocks);
+        i += numBlocks*blockSize;
+
+        _partial.assign(in + i, in + num);
+        _numSamples += num;
+        inPort->consume(num);
+    }
+
+private:
+    void writeBlocks(const std::complex<float> *in, const size_t numBlocks)
+    {
+        _bytes.resize(numBlocks*_codec.blockBytes());
+        for (size_t i = 0; i < numBlocks; i++)
+        {
+            _codec.encode(in + i*_codec.blockSize(), _bytes.data() + i*_codec.blockBytes());
+        }
+        _file.write(reinterpret_cast<const char *>(_bytes.data()), _bytes.size());
+        if (not _file) throw Pothos::FileException("LoRaBfpSink::work("+_path+")", "write failed");
+    }
+
+    void writeHeader(void)
+    {
+        uint8_t hdr[LoRaBfpCodec::HEADER_SIZE];
+        _codec.encodeHeader(hdr, _numSamples);
+        _file.write(reinterpret_cast<const char *>(hdr), sizeof(hdr));
+        if (not _file) throw Pothos::FileException("LoRaBfpSink::writeHeader("+_path+")", "write failed");
+    }
+
+    const std::string _path;
+    size_t _bits;
+    size_t _blockSize;
+    unsigned long long _numSamples;
+    LoRaBfpCodec _codec;
+    std::ofstream _file;
+    std::vector<uint8_t> _bytes;
+    std::vector<std::complex<float>> _partial;
+};
+
+static Pothos::BlockRegistry registerLoRaBfpSink(
+    "/lora/bfp_capture_sink", &LoRaBfpSink::make);
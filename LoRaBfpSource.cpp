@@ -0,0 +1,198 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Framework.hpp>
+#include "LoRaBfpCodec.hpp"
+#include <complex>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+
+/***********************************************************************
+ * |PothosDoc LoRa BFP Capture Source
+ *
+ * Replay a compressed capture file from the LoRa BFP Capture Sink
+ * as a complex sample stream. The mantissa bits and block size
+ * are read from the file header.
+ *
+ * The encoded blocks are a fixed size, so the replay can start
+ * at any sample index: the block that holds the start index
+ * is found from its byte offset, and the samples before
+ * the start index are dropped from the first decoded block.
+ * A repeated replay restarts from the start index.
+ *
+ * A capture that was cut short, such as by a recorder that did not
+ * finish, ends the stream after the last whole block in the file.
+ *
+ * |category /LoRa
+ * |keywords lora capture replay file compress
+ *
+ * |param path[File Path] The path of the capture file to read.
+ * |default ""
+ * |widget FileEntry(mode=open)
+ *
+ * |param start[Start index] The sample index to start the replay from.
+ * |units samples
+ * |default 0
+ *
+ * |param repeat Enable/disable repeating the replay when the end of the capture is reached.
+ * |option [On] true
+ * |option [Off] false
+ * |default false
+ *
+ * |factory /lora/bfp_capture_source(path)
+ * |setter setStartIndex(start)
+ * |setter enableRepeat(repeat)
+ **********************************************************************/
+class LoRaBfpSource : public Pothos::Block
+{
+public:
+    LoRaBfpSource(const std::string &path):
+        _path(path),
+        _start(0),
+        _repeat(false),
+        _numSamples(0),
+        _index(0)
+    {
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaBfpSource, setStartIndex));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaBfpSource, enableRepeat));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaBfpSource, getNumSamples));
+        this->setupOutput(0, typeid(std::complex<float>));
+    }
+
+    static Block *make(const std::string &path)
+    {
+        return new LoRaBfpSource(path);
+    }
+
+    void setStartIndex(const unsigned long long start)
+    {
+        _start = start;
+    }
+
+    void enableRepeat(const bool repeat)
+    {
+        _repeat = repeat;
+    }
+
+    //! The number of samples in the capture, available once active
+    unsigned long long getNumSamples(void) const
+    {
+        return _numSamples;
+    }
+
+    void activate(void)
+    {
+        _file.open(_path, std::ios::binary);
+        uint8_t hdr[LoRaBfpCodec::HEADER_SIZE];
+        if (not _file.read(reinterpret_cast<char *>(hdr), sizeof(hdr)) or not _codec.decodeHeader(hdr, _numSamples))
+        {
+            throw Pothos::FileException("LoRaBfpSource::activate("+_path+")", "not a capture file");
+        }
+
+        //the samples of the whole blocks present in a short file
+        _file.seekg(0, std::ios::end);
+        const unsigned long long fileBytes = _file.tellg();
+        const unsigned long long numBlocks = (fileBytes - LoRaBfpCodec::HEADER_SIZE)/_codec.blockBytes();
+        _numSamples = std::min(_numSamples, numBlocks*_codec.blockSize());
+
+        if (_start > _numSamples) throw Pothos::RangeException("LoRaBfpSource::activate("+_path+")", "start index beyond the capture");
+        this->seek(_start);
+    }
+
+    void deactivate(void)
+    {
+        _file.close();
+    }
+
+    void work(void)
+    {
+        if (_index >= _numSamples)
+        {
+            if (not _repeat or _start == _numSamples) return;
+            this->seek(_start);
+        }
+
+        auto outPort = this->output(0);
+        auto out = outPort->buffer().as<std::complex<float> *>();
+        const size_t B = _codec.blockSize();
+        const size_t room = std::min<unsigned long long>(outPort->elements(), _numSamples - _index);
+        size_t produced = 0;
+
+        //the rest of the block that holds the start index
+        if (_index % B != 0)
+        {
+            _block.resize(B);
+            this->readBlocks(1);
+            _codec.decode(_bytes.data(), _block.data());
+            produced = std::min<size_t>(room, B - _index % B);
+            std::copy(_block.begin() + _index % B, _block.begin() + _index % B + produced, out);
+            if (produced < B - _index % B) this->seekBlock(_index + produced);
+        }
+
+        //decode whole blocks directly into the output buffer
+        const size_t numBlocks = (room - produced)/B;
+        if (numBlocks != 0)
+        {
+            this->readBlocks(numBlocks);
+            for (size_t i = 0; i < numBlocks; i++)
+            {
+                _codec.decode(_bytes.data() + i*_codec.blockBytes(), out + produced + i*B);
+            }
+            produced += numBlocks*B;
+        }
+
+        //the end of the capture or a short output buffer ends in a partial block
+        if (produced == 0 and room != 0)
+        {
+            _block.resize(B);
+            this->readBlocks(1);
+            _codec.decode(_bytes.data(), _block.data());
+            produced = room;
+            std::copy(_block.begin(), _block.begin() + produced, out);
+            this->seekBlock(_index + produced);
+        }
+
+        _index += produced;
+        outPort->produce(produced);
+    }
+
+private:
+    //! Position the replay at a sample index
+    void seek(const unsigned long long index)
+    {
+        _file.clear();
+        this->seekBlock(index);
+        _index = index;
+    }
+
+    //! Position the file at the start of the block that holds the sample index
+    void seekBlock(const unsigned long long index)
+    {
+        const auto block = index/_codec.blockSize();
+        _file.seekg(std::streamoff(LoRaBfpCodec::HEADER_SIZE + block*_codec.blockBytes()));
+    }
+
+    //! Read whole blocks, which activate() found in the file
+    void readBlocks(const size_t numBlocks)
+    {
+        _bytes.resize(numBlocks*_codec.blockBytes());
+        if (not _file.read(reinterpret_cast<char *>(_bytes.data()), _bytes.size()))
+        {
+            throw Pothos::FileException("LoRaBfpSource::work("+_path+")", "read failed");
+        }
+    }
+
+    const std::string _path;
+    unsigned long long _start;
+    bool _repeat;
+    unsigned long long _numSamples;
+    unsigned long long _index;
+    LoRaBfpCodec _codec;
+    std::ifstream _file;
+    std::vector<uint8_t> _bytes;
+    std::vector<std::complex<float>> _block;
+};
+
+static Pothos::BlockRegistry registerLoRaBfpSource(
+    "/lora/bfp_capture_source", &LoRaBfpSource::make);
@@ -1,3 +1,8 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
 /***********************************************************************
  * Defines
  **********************************************************************/
@@ -14,6 +19,22 @@ static inline unsigned roundUp(unsigned num, unsigned factor)
     return ((num + factor - 1) / factor) * factor;
 }
 
+/***********************************************************************
+ * Coding rate strings "4/4" through "4/8" to RDD (parity bits)
+ **********************************************************************/
+static inline bool parseCodingRate(const std::string &cr, size_t &rdd)
+{
+    if (cr.size() != 3 or cr[0] != '4' or cr[1] != '/') return false;
+    if (cr[2] < '4' or cr[2] > '8') return false;
+    rdd = size_t(cr[2] - '4');
+    return true;
+}
+
+static inline std::string codingRateString(const size_t rdd)
+{
+    return std::string("4/") + char('4' + rdd);
+}
+
 /***********************************************************************
  * Simple 8-bit checksum routine
  **********************************************************************/
@@ -5,7 +5,8 @@
 #include <Pothos/Framework.hpp>
 #include <iostream>
 #include <cstring>
-#include "LoRaCodes.hpp"
+#include "LoRaPacketDecoder.hpp"
+#include "LoRaMetadata.hpp"
 
 /***********************************************************************
  * |PothosDoc LoRa Decoder
@@ -19,7 +20,13 @@
  *
  * A packet message with a payload containing LoRa modulation symbols.
  * The format of the packet payload is a buffer of unsigned shorts.
- * A 16-bit short can fit all size symbols from 7 to 12 bits.
+ * A 16-bit short can fit all size symbols from 5 to 12 bits.
+ * The "sf", "cr", and "explicit" metadata keys override the
+ * spread factor, coding rate, and header mode for that packet.
+ * In explicit header mode, the payload coding rate is read from the header,
+ * so one decoder can serve every coding rate.
+ * The "alternates" and "margins" metadata keys from the LoRa Demod
+ * provide the runner-up bins used to retry failed packets.
  *
  * <h2>Output format</h2>
  *
@@ -80,6 +87,12 @@
  * |option [Off] false
  * |default true
  *
+ * |param retries[Retries] The maximum number of decode retries for a failed packet.
+ * Each retry substitutes a combination of the least reliable symbols
+ * with their runner-up bins, and is accepted only when the packet crc matches.
+ * This requires the alternates from the LoRa Demod and a packet crc.
+ * |default 0
+ *
  * |factory /lora/lora_decoder()
  * |setter setSpreadFactor(sf)
  * |setter setSymbolSize(ppm)
@@ -91,6 +104,7 @@
  * |setter enableWhitening(whitening)
  * |setter enableInterleaving(interleaving)
  * |setter enableErrorCheck(errorCheck)
+ * |setter setRetries(retries)
  **********************************************************************/
 class LoRaDecoder : public Pothos::Block
 {
@@ -106,6 +120,7 @@ public:
 		_explicit(true),
         _hdr(false),
 		_dataLength(8),
+        _retries(0),
         _dropped(0)
     {
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDecoder, setSpreadFactor));
@@ -118,6 +133,7 @@ public:
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDecoder, enableHdr));
 		this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDecoder, setDataLength));
 		this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDecoder, enableErrorCheck));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDecoder, setRetries));
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDecoder, getDropped));
 
         this->registerSignal("dropped");
@@ -142,12 +158,7 @@ public:
 
     void setCodingRate(const std::string &cr)
     {
-        if (cr == "4/4") _rdd = 0;
-        else if (cr == "4/5") _rdd = 1;
-        else if (cr == "4/6") _rdd = 2;
-        else if (cr == "4/7") _rdd = 3;
-        else if (cr == "4/8") _rdd = 4;
-        else throw Pothos::InvalidArgumentException("LoRaDecoder::setCodingRate("+cr+")", "unknown coding rate");
+        if (not parseCodingRate(cr, _rdd)) throw Pothos::InvalidArgumentException("LoRaDecoder::setCodingRate("+cr+")", "unknown coding rate");
     }
 
     void enableWhitening(const bool whitening)
@@ -182,6 +193,11 @@ public:
 		_dataLength = dataLength;
 	}
 
+    void setRetries(const size_t retries)
+    {
+        _retries = retries;
+    }
+
     unsigned long long getDropped(void) const
     {
         return _dropped;
@@ -198,202 +214,60 @@ public:
 		auto outPort = this->output(0);
 		if (not inPort->hasMessage()) return;
 
-		const size_t PPM = (_ppm == 0) ? _sf : _ppm;
-		if (PPM > _sf) throw Pothos::Exception("LoRaDecoder::work()", "failed check: PPM <= SF");
-
 		//extract the input symbols
 		auto msg = inPort->popMessage();
 		auto pkt = msg.extract<Pothos::Packet>();
-        
-        if (pkt.payload.elements() < N_HEADER_SYMBOLS) return; // need at least a header
-        
-		const size_t numSymbols = roundUp(pkt.payload.elements(), 4 + _rdd);
-		const size_t numCodewords = (numSymbols / (4 + _rdd))*PPM;
-		std::vector<uint16_t> symbols(numSymbols);
-		std::memcpy(symbols.data(), pkt.payload.as<const void *>(), pkt.payload.length);
 
-        int rdd = _rdd; //make a copy to be changed in header decode
-
-		//gray encode, when SF > PPM, depad the LSBs with rounding
-		for (auto &sym : symbols){
-			sym += (1 << (_sf - PPM)) / 2; //increment by 1/2
-			sym >>= (_sf - PPM); //down shift to PPM bits
-			sym = binaryToGray16(sym);
-		}
-		//deinterleave / dewhiten the symbols into codewords
-		std::vector<uint8_t> codewords(numCodewords);
-		if (_interleaving) {
-			size_t sOfs = 0;
-			size_t cOfs = 0;
-			if (rdd != HEADER_RDD) {
-				diagonalDeterleaveSx(symbols.data(), N_HEADER_SYMBOLS, codewords.data(), PPM, HEADER_RDD);
-				if (_explicit) {
-					Sx1272ComputeWhiteningLfsr(codewords.data() + N_HEADER_CODEWORDS, PPM - N_HEADER_CODEWORDS, 0, HEADER_RDD);
-				}
-				else {
-					Sx1272ComputeWhiteningLfsr(codewords.data(), PPM, 0, HEADER_RDD);
-				}
-				cOfs += PPM;
-				sOfs += N_HEADER_SYMBOLS;
-				if (numSymbols - sOfs > 0) {
-					diagonalDeterleaveSx(symbols.data() + sOfs, numSymbols-sOfs, codewords.data() + cOfs, PPM, rdd);
-					if (_explicit) {
-						Sx1272ComputeWhiteningLfsr(codewords.data() + cOfs, numCodewords - cOfs, PPM-N_HEADER_CODEWORDS, rdd);
-					}
-					else {
-						Sx1272ComputeWhiteningLfsr(codewords.data() + cOfs, numCodewords - cOfs, PPM, rdd);
-					}
-				}
-			}else{
-				diagonalDeterleaveSx(symbols.data(), numSymbols, codewords.data(), PPM, rdd);
-				if (_explicit) {
-					Sx1272ComputeWhiteningLfsr(codewords.data()+N_HEADER_CODEWORDS, numCodewords-N_HEADER_CODEWORDS, 0, rdd);
-				}
-				else {
-					Sx1272ComputeWhiteningLfsr(codewords.data(), numCodewords, 0, rdd);
-				}
+		//apply the per-packet settings over the block defaults
+		_decoder.sf = getPacketSpreadFactor(pkt, _sf);
+		_decoder.ppm = _ppm;
+		_decoder.rdd = getPacketCodingRate(pkt, _rdd);
+		_decoder.crcc = _crcc;
+		_decoder.interleaving = _interleaving;
+		_decoder.errorCheck = _errorCheck;
+		_decoder.explicitHeader = getPacketSetting<bool>(pkt, "explicit", _explicit);
+		_decoder.hdr = _hdr;
+		_decoder.dataLength = _dataLength;
+		_decoder.retries = _retries;
+		if (_decoder.symbolSize() > _decoder.sf) throw Pothos::Exception("LoRaDecoder::work()", "failed check: PPM <= SF");
+
+		//runner-up bins from the demodulator for retries
+		const uint16_t *alternates = nullptr;
+		const float *margins = nullptr;
+		std::vector<uint16_t> altSymbols;
+		std::vector<float> altMargins;
+		if (_retries != 0)
+		{
+			altSymbols = getPacketSetting(pkt, "alternates", altSymbols);
+			altMargins = getPacketSetting(pkt, "margins", altMargins);
+			if (altSymbols.size() == pkt.payload.elements() and altMargins.size() == altSymbols.size())
+			{
+				alternates = altSymbols.data();
+				margins = altMargins.data();
 			}
-		/*
-			Pothos::Packet out;
-			out.payload = Pothos::BufferChunk(typeid(uint8_t), numCodewords);
-			std::memcpy(out.payload.as<void *>(), codewords.data(), numCodewords);
-			outPort->postMessage(out);
-			return;
-		*/
 		}
-		else {
+
+		const auto status = _decoder.decode(pkt.payload.as<const uint16_t *>(), pkt.payload.elements(), alternates, margins);
+		if (status == LoRaPacketDecoder::DECODE_SHORT) return; // need at least a header
+
+		//interleaving disabled: post the gray coded symbols
+		if (status == LoRaPacketDecoder::DECODE_SYMBOLS)
+		{
+			const auto &symbols = _decoder.symbols();
 			Pothos::Packet out;
-			out.payload = Pothos::BufferChunk(typeid(uint16_t), numSymbols);
+			out.payload = Pothos::BufferChunk(typeid(uint16_t), symbols.size());
 			std::memcpy(out.payload.as<void *>(), symbols.data(), out.payload.length);
 			outPort->postMessage(out);
 			return;
 		}
 
-		bool error = false;
-		bool bad = false;
-		std::vector<uint8_t> bytes((codewords.size()+1) / 2);
-		size_t dOfs = 0;
-		size_t cOfs = 0;
-        
-        size_t packetLength = 0;
-        size_t dataLength = 0;
-        bool checkCrc = _crcc;
-		
-		if (_explicit) {
-			bytes[0] = decodeHamming84sx(codewords[1], error, bad) & 0xf;
-			bytes[0] |= decodeHamming84sx(codewords[0], error, bad) << 4;	// length
-
-			bytes[1] = decodeHamming84sx(codewords[2], error, bad) & 0xf;	// coding rate and crc enable
+		if (status != LoRaPacketDecoder::DECODE_OK) return this->drop();
 
-			bytes[2] = decodeHamming84sx(codewords[4], error, bad) & 0xf;
-			bytes[2] |= decodeHamming84sx(codewords[3], error, bad) << 4;	// checksum
-			
-			bytes[2] ^= headerChecksum(bytes.data());
-
-			if (error && _errorCheck) return this->drop();
-            
-            if (0 == (bytes[1] & 1)) checkCrc = false;	// disable crc check if not present in the packet
-            rdd = (bytes[1] >> 1) & 0x7;				// header contains error correction info
-            if (rdd > 4) return this->drop();
-            
-            packetLength = bytes[0];
-            dataLength = packetLength + ((bytes[1] & 1)?5:3);  // include  header and crc
-            
-			cOfs = N_HEADER_CODEWORDS;
-			dOfs = 6;
-        }else{
-            packetLength = _dataLength;
-            if (_crcc){
-                dataLength = packetLength + 2;
-            }else{
-                dataLength = packetLength;
-            }
-        }
-        
-        if (dataLength > bytes.size()) return this->drop();
-		
-		for (; cOfs < PPM; cOfs++, dOfs++) {
-			if (dOfs & 1)
-				bytes[dOfs >> 1] |= decodeHamming84sx(codewords[cOfs], error, bad) << 4;
-			else
-				bytes[dOfs >> 1] = decodeHamming84sx(codewords[cOfs], error, bad) & 0xf;
-		}
-
-		if (dOfs & 1) {
-			if (rdd == 0){
-				bytes[dOfs>>1] |= codewords[cOfs++] << 4;
-			}
-			else if (rdd == 1){
-				bytes[dOfs >> 1] |= checkParity54(codewords[cOfs++], error) << 4;
-			}
-			else if (rdd == 2) {
-				bytes[dOfs >> 1] |= checkParity64(codewords[cOfs++], error) << 4;
-			}
-			else if (rdd == 3){
-				bytes[dOfs >> 1] |= decodeHamming74sx(codewords[cOfs++], error) << 4;
-			}
-			else if (rdd == 4){
-				bytes[dOfs >> 1] |= decodeHamming84sx(codewords[cOfs++], error, bad) << 4;
-			}
-			dOfs++;
-		}
-		dOfs >>= 1;
-
-		if (error && _errorCheck) return this->drop();
-
-
-		//decode each codeword as 2 bytes with correction
-		if (rdd == 0) for (size_t i = dOfs; i < dataLength; i++) {
-			bytes[i] = codewords[cOfs++] & 0xf;
-			bytes[i] |= codewords[cOfs++] << 4;
-		}else if (rdd == 1) for (size_t i = dOfs; i < dataLength; i++) {
-			bytes[i] = checkParity54(codewords[cOfs++],error);
-			bytes[i] |= checkParity54(codewords[cOfs++], error) << 4;
-		}else if (rdd == 2) for (size_t i = dOfs; i < dataLength; i++) {
-			bytes[i] = checkParity64(codewords[cOfs++], error);
-			bytes[i] |= checkParity64(codewords[cOfs++],error) << 4;
-		}else if (rdd == 3) for (size_t i = dOfs; i < dataLength; i++){
-			bytes[i] = decodeHamming74sx(codewords[cOfs++], error) & 0xf;
-			bytes[i] |= decodeHamming74sx(codewords[cOfs++], error) << 4;
-		}else if (rdd == 4) for (size_t i = dOfs; i < dataLength; i++){
-			bytes[i] = decodeHamming84sx(codewords[cOfs++], error, bad) & 0xf;
-			bytes[i] |= decodeHamming84sx(codewords[cOfs++], error, bad) << 4;
-		}
-		
-		if (error && _errorCheck) return this->drop();
-        
-        dOfs = 0;
-        
-		if (_explicit) {
-			if (bytes[1] & 1) {							// always compute crc if present
-				uint16_t crc = sx1272DataChecksum(bytes.data() + 3, packetLength);
-				uint16_t packetCrc = bytes[3 + packetLength] | (bytes[4 + packetLength] << 8);
-				if (crc != packetCrc && checkCrc) return this->drop();
-				bytes[3 + packetLength] ^= crc;
-				bytes[4 + packetLength] ^= (crc >> 8);
-			}
-            if (!_hdr){
-                dOfs = 3;
-                dataLength -= 5;
-            }
-		}
-		else {
-            if (checkCrc) {
-                uint16_t crc = sx1272DataChecksum(bytes.data(), _dataLength);
-                uint16_t packetCrc = bytes[_dataLength] | (bytes[_dataLength + 1] << 8);
-                if (crc != packetCrc) return this->drop();
-                bytes[_dataLength + 0] ^= crc;
-                bytes[_dataLength + 1] ^= (crc >> 8);
-            }
-		}
-		
 		//post the output bytes
 		Pothos::Packet out;
-		out.payload = Pothos::BufferChunk(typeid(uint8_t), dataLength);
-		std::memcpy(out.payload.as<void *>(), bytes.data()+dOfs, out.payload.length);
+		out.payload = Pothos::BufferChunk(typeid(uint8_t), _decoder.length());
+		std::memcpy(out.payload.as<void *>(), _decoder.payload(), out.payload.length);
 		outPort->postMessage(out);
-		return;
-
     }
 
 private:
@@ -414,7 +288,9 @@ private:
 	bool _explicit;
     bool _hdr;
 	size_t _dataLength;
+    size_t _retries;
     unsigned long long _dropped;
+    LoRaPacketDecoder _decoder;
 };
 
 static Pothos::BlockRegistry registerLoRaDecoder(
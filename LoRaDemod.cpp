@@ -5,8 +5,9 @@
 #include <iostream>
 #include <complex>
 #include <cstring>
-#include <cmath>
-#include "LoRaDetector.hpp"
+#include "LoRaDemodulator.hpp"
+#include "LoRaPacketDecoder.hpp"
+#include "LoRaMetadata.hpp"
 
 /***********************************************************************
  * |PothosDoc LoRa Demod
@@ -22,18 +23,72 @@
  *
  * The output port 0 produces a packet containing demodulated symbols.
  * The format of the packet payload is a buffer of unsigned shorts.
- * A 16-bit short can fit all size symbols from 7 to 12 bits.
+ * A 16-bit short can fit all size symbols from 5 to 12 bits.
+ * The packet metadata contains the following fields:
+ * <ul>
+ * <li>sf - the spread factor of the symbols</li>
+ * <li>fineFreqError - the tracked frequency error in bins at the end of the packet</li>
+ * <li>drift - the tracked sampling clock drift in ppm</li>
+ * <li>alternates - when enabled, the runner-up bin of each symbol (std::vector&lt;uint16_t&gt;)</li>
+ * <li>margins - when enabled, the peak over runner-up power of each symbol in dB (std::vector&lt;float&gt;)</li>
+ * </ul>
+ *
+ * <h2>Streaming mode</h2>
+ *
+ * In the streaming mode, the demodulator follows a continuous stream
+ * from the LoRa Mod in streaming mode: after the preamble, the data symbols
+ * continue until the squelch closes for several symbols in a row,
+ * so a short fade costs symbol errors rather than the stream,
+ * and the MTU does not apply.
+ * The pilot symbols steer the tracking loop and are removed,
+ * and the explicit header of each packet delimits the packets in the stream.
+ * The idle blocks are skipped. When a header fails its checksum,
+ * the symbols are slipped one at a time to find the next valid header,
+ * and a packet that fails its crc or is not followed by a valid header
+ * is taken for a false header, so the search starts again inside it.
+ * With a resync interval, the demodulator returns to frame sync
+ * for each repeated preamble of the LoRa Mod, and when the search
+ * for a header goes on too long, so a late start or a lost stream
+ * is acquired again at the next preamble.
+ * The symbol size (ppm) must match the encoder to read the headers.
  *
  * <h2>Debug port raw</h2>
  *
  * The raw debug port outputs the LoRa signal annotated with labels
  * for important synchronization points in the input sample stream.
+ * The output buffers reference the input buffers without a copy.
  *
  * <h2>Debug port dec</h2>
  *
  * The dec debug port outputs the LoRa signal downconverted
  * by a locally generated chirp with the same annotation labels as the raw output.
  *
+ * <h2>Frame events</h2>
+ *
+ * The frameDetected signal is emitted as soon as the frame sync is found,
+ * before the symbols are demodulated, with a dictionary of:
+ * index (input sample index of the first data symbol), sf,
+ * cfo (coarse frequency error in bins), snr and power (in dB).
+ *
+ * In explicit header mode, the headerDecoded signal is emitted
+ * once the header block is demodulated and the header passes its checksum,
+ * with a dictionary of:
+ * index (input sample index at the end of the header block),
+ * endIndex (predicted input sample index at the end of the frame),
+ * length (payload bytes), cr (coding rate string), and crc (true when present).
+ *
+ * <h2>Statistics</h2>
+ *
+ * The getStats() call returns a dictionary of demodulator counters
+ * for tuning the threshold: steps and samples spent in each state
+ * (keys frameSyncSteps, frameSyncSamples, dataSymbolsSteps...),
+ * noiseSymbols, preambleSymbols, syncAttempts, syncWordMismatches,
+ * frames, falseAlarms (frames squelched before a full header block),
+ * squelchEnds and mtuEnds (how the frames ended),
+ * pilotSymbols, idleBlocks, framingSlips and resyncs (streaming mode),
+ * threshold (the threshold in use in dB) and noiseFloor (median idle SNR in dB).
+ * The counters are cleared on activation.
+ *
  * |category /LoRa
  * |keywords lora
  *
@@ -48,34 +103,132 @@
  *
  * |param thresh[Threshold] The minimum required level in dB for the detector.
  * The threshold level is used to enter and exit the demodulation state machine.
+ * With a false alarm rate, the threshold is the lower bound of the adaptive threshold.
  * |units dB
  * |default -30.0
  *
+ * |param far[False alarm rate] Adapt the threshold to the measured noise floor.
+ * The detector SNR of idle symbols is tracked, and the threshold is raised
+ * to the level that noise exceeds with approximately this probability per symbol.
+ * The special value of zero uses the fixed threshold only.
+ * |default 0.0
+ * |option [Fixed] 0.0
+ * |option [1e-3] 1e-3
+ * |option [1e-4] 1e-4
+ * |widget ComboBox(editable=true)
+ * |preview valid
+ *
  * |param mtu[Symbol MTU] Produce MTU at most symbols after sync is found.
  * The demodulator does not inspect the payload and will produce at most
  * the specified MTU number of symbols or less if the detector squelches.
  * |units symbols
  * |default 256
  *
+ * |param ppm[Symbol size] The size of the symbol set (_ppm &lt;= SF),
+ * used to read the header for the headerDecoded signal.
+ * The special value of zero uses the full symbol set (PPM == SF).
+ * |default 0
+ * |option [Full set] 0
+ * |widget ComboBox(editable=true)
+ * |preview valid
+ *
+ * |param explicit Enable/disable explicit header mode.
+ * This must match the encoder: the headerDecoded signal is only emitted
+ * in explicit header mode, since an implicit header link has no header to read.
+ * |option [On] true
+ * |option [Off] false
+ * |default true
+ *
+ * |param tracking Enable/disable tracking of the frequency and timing drift over the data symbols.
+ * The fractional bin offset of each symbol steers the frequency correction,
+ * and a persistent ramp is attributed to sampling clock drift,
+ * which slips the symbol boundary to follow long packets.
+ * |option [On] true
+ * |option [Off] false
+ * |default true
+ *
+ * |param alternates Enable/disable the runner-up bin and reliability of each symbol.
+ * The LoRa Decoder uses them to retry failed packets.
+ * |option [On] true
+ * |option [Off] false
+ * |default false
+ *
+ * |param incremental Enable/disable incremental processing of the data symbols.
+ * The data symbols are dechirped and the first transform stage runs
+ * as the input arrives, instead of once the symbol completes.
+ * This spreads the processing over the symbol and shortens the latency
+ * from the last sample of a symbol to its decision.
+ * |option [On] true
+ * |option [Off] false
+ * |default false
+ *
+ * |param highRate[High rate] Enable/disable the high rate mode for wide bandwidths.
+ * Wide bandwidth signals such as 812.5 and 1625 kHz at 2.4 GHz
+ * run at MS/s rates with symbols as short as 32 samples (SF5),
+ * so the per-call overhead of the scheduler dominates one symbol per call.
+ * The high rate mode steps through every symbol that the input buffer holds
+ * per call and uses larger input buffers.
+ * The dec and fft debug ports are not produced in this mode.
+ * |option [On] true
+ * |option [Off] false
+ * |default false
+ *
+ * |param streaming Enable/disable the continuous streaming mode.
+ * |option [On] true
+ * |option [Off] false
+ * |default false
+ *
+ * |param pilots[Pilot interval] The number of data symbols between pilot symbols in streaming mode.
+ * This must match the pilot interval of the LoRa Mod.
+ * |units symbols
+ * |default 16
+ *
+ * |param resync[Resync interval] The number of blocks between repeated preambles in streaming mode.
+ * This must match the resync interval of the LoRa Mod.
+ * |units blocks
+ * |default 0
+ *
  * |factory /lora/lora_demod(sf)
  * |setter setSync(sync)
  * |setter setThreshold(thresh)
+ * |setter setFalseAlarmRate(far)
  * |setter setMTU(mtu)
+ * |setter setSymbolSize(ppm)
+ * |setter enableExplicit(explicit)
+ * |setter enableTracking(tracking)
+ * |setter enableAlternates(alternates)
+ * |setter enableIncremental(incremental)
+ * |setter enableHighRate(highRate)
+ * |setter enableStreaming(streaming)
+ * |setter setPilotInterval(pilots)
+ * |setter setResyncInterval(resync)
  **********************************************************************/
 class LoRaDemod : public Pothos::Block
 {
 public:
     LoRaDemod(const size_t sf):
         N(1 << sf),
-        _fineSteps(128),
-        _detector(N),
-        _sync(0x12),
-        _thresh(-30.0),
-        _mtu(256)
+        _sf(sf),
+        _explicit(true),
+        _alternates(false),
+        _incremental(false),
+        _highRate(false),
+        _demod(sf)
     {
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setSync));
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setThreshold));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setFalseAlarmRate));
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setMTU));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setSymbolSize));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, enableExplicit));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, enableTracking));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, enableAlternates));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, enableIncremental));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, enableHighRate));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, enableStreaming));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setPilotInterval));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, setResyncInterval));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDemod, getStats));
         this->setupInput(0, typeid(std::complex<float>));
         this->setupOutput(0);
         this->setupOutput("raw", typeid(std::complex<float>));
@@ -85,35 +238,18 @@ public:
         this->registerSignal("error");
         this->registerSignal("power");
         this->registerSignal("snr");
+        this->registerSignal("frameDetected");
+        this->registerSignal("headerDecoded");
 
         //use at most two input symbols available
-        this->input(0)->setReserve(N*2);
+        this->input(0)->setReserve(_demod.reserve());
 
         //store port pointers to avoid lookup by name
         _rawPort = this->output("raw");
         _decPort = this->output("dec");
         _fftPort = this->output("fft");
-        
-        //generate chirp table
-        float phase = -M_PI;
-        double phaseAccum = 0.0;
-        for (size_t i = 0; i < N; i++)
-        {
-            phaseAccum += phase;
-            auto entry = std::polar(1.0, phaseAccum);
-            _upChirpTable.push_back(std::complex<float>(std::conj(entry)));
-            _downChirpTable.push_back(std::complex<float>(entry));
-            phase += (2*M_PI)/N;
-        }
-        phaseAccum = 0.0;
-        phase = 2.0 * M_PI / (N * _fineSteps);
-        for (size_t i = 0; i < N * _fineSteps; i++){
-            phaseAccum += phase;
-            auto entry = std::polar(1.0, phaseAccum);
-            _fineTuneTable.push_back(std::complex<float>(entry));
-        }
-        
-        _fineTuneIndex = 0;
+
+        _header.sf = sf;
     }
 
     static Block *make(const size_t sf)
@@ -123,213 +259,166 @@ public:
 
     void setSync(const unsigned char sync)
     {
-        _sync = sync;
+        _demod.setSync(sync);
     }
 
     void setThreshold(const double thresh_dB)
     {
-        _thresh = thresh_dB;
+        _demod.setThreshold(thresh_dB);
+    }
+
+    void setFalseAlarmRate(const double pfa)
+    {
+        _demod.setFalseAlarmRate(pfa);
     }
 
     void setMTU(const size_t mtu)
     {
-        _mtu = mtu;
+        _demod.setMTU(mtu);
+    }
+
+    void setSymbolSize(const size_t ppm)
+    {
+        if (ppm > _sf) throw Pothos::InvalidArgumentException("LoRaDemod::setSymbolSize("+std::to_string(ppm)+")", "failed check: PPM <= SF");
+        _header.ppm = ppm;
+        _demod.setSymbolSize(ppm);
+    }
+
+    void enableExplicit(const bool __explicit)
+    {
+        _explicit = __explicit;
+    }
+
+    void enableTracking(const bool tracking)
+    {
+        _demod.enableTracking(tracking);
+    }
+
+    void enableAlternates(const bool alternates)
+    {
+        _alternates = alternates;
+        _demod.enableAlternates(alternates);
+    }
+
+    void enableIncremental(const bool incremental)
+    {
+        _incremental = incremental;
+        _demod.enableIncremental(incremental);
+    }
+
+    void enableHighRate(const bool highRate)
+    {
+        _highRate = highRate;
+    }
+
+    void enableStreaming(const bool streaming)
+    {
+        _demod.enableStreaming(streaming);
+    }
+
+    void setPilotInterval(const size_t interval)
+    {
+        _demod.setPilotInterval(interval);
+    }
+
+    void setResyncInterval(const size_t interval)
+    {
+        _demod.setResyncInterval(interval);
+    }
+
+    Pothos::ObjectKwargs getStats(void) const
+    {
+        return getDemodStats(_demod.stats(), _demod.threshold(), _demod.noiseFloor());
     }
 
     void activate(void)
     {
-        _state = STATE_FRAMESYNC;
-        _chirpTable = _upChirpTable.data();
+        _demod.reset();
+        _demod.resetStats();
     }
 
     void work(void)
     {
+        if (_highRate) return this->workHighRate();
+
         auto inPort = this->input(0);
-        if (inPort->elements() < N*2) return;
-        
-        size_t total = 0;
         auto inBuff = inPort->buffer().as<const std::complex<float> *>();
-        auto rawBuff = _rawPort->buffer().as<std::complex<float> *>();
+        if (inPort->elements() < _demod.required())
+        {
+            //process a partial data symbol and wait for more input
+            const size_t fed = _demod.feed(inBuff, inPort->elements());
+            if (fed == 0) inPort->setReserve(_demod.required());
+            else inPort->setReserve(std::min(inPort->elements()+1, _demod.required()));
+            return;
+        }
+
         auto decBuff = _decPort->buffer().as<std::complex<float> *>();
         auto fftBuff = _fftPort->buffer().as<std::complex<float> *>();
 
         //process the available symbol
-        for (size_t i = 0; i < N; i++){
-            auto samp = inBuff[i];
-            auto decd = samp*_chirpTable[i] * _fineTuneTable[_fineTuneIndex];
-            _fineTuneIndex -= _finefreqError * _fineSteps;
-            if (_fineTuneIndex < 0) _fineTuneIndex += N * _fineSteps;
-            else if (_fineTuneIndex >= int(N * _fineSteps)) _fineTuneIndex -= N * _fineSteps;
-            rawBuff[i] = samp;
-            decBuff[i] = decd;
-            _detector.feed(i, decd);
-        }
-        float power = 0;
-        float powerAvg = 0;
-        float snr = 0;
-        float fIndex = 0;
-        
-        auto value = _detector.detect(power,powerAvg,fIndex,fftBuff);
-        snr = power - powerAvg;
-        const bool squelched = (snr < _thresh);
+        const size_t total = _demod.step(inBuff, decBuff, fftBuff);
 
-        switch (_state)
-        {
-        ////////////////////////////////////////////////////////////////
-        case STATE_FRAMESYNC:
-        ////////////////////////////////////////////////////////////////
-        {
-            //format as observed from inspecting RN2483
-            bool syncd = not squelched and (_prevValue+4)/8 == 0;
-            bool match0 = (value+4)/8 == unsigned(_sync>>4);
-            bool match1 = false;
-
-            //if the symbol matches sync word0 then check sync word1 as well
-            //otherwise assume its the frame sync and adjust for frequency error
-            if (syncd and match0)
-            {
-                int ft = _fineTuneIndex;
-                for (size_t i = 0; i < N; i++)
-                {
-                    auto samp = inBuff[i + N];
-                    auto decd = samp*_chirpTable[i] * _fineTuneTable[ft];
-                    ft -= _finefreqError * _fineSteps;
-                    if (ft < 0) ft += N * _fineSteps;
-                    else if (ft >= int(N * _fineSteps)) ft -= N * _fineSteps;
-                    rawBuff[i+N] = samp;
-                    decBuff[i+N] = decd;
-                    _detector.feed(i, decd);
-                }
-                auto value1 = _detector.detect(power,powerAvg,fIndex);
-                //format as observed from inspecting RN2483
-                match1 = (value1+4)/8 == unsigned(_sync & 0xf);
-            }
+        this->postEvents(inPort->totalElements() + total);
 
-            if (syncd and match0 and match1)
-            {
-                total = 2*N;
-                _state = STATE_DOWNCHIRP0;
-                _chirpTable = _downChirpTable.data();
-                _id = "SYNC";
-            }
-
-            //otherwise its a frequency error
-            else if (not squelched)
-            {
-                total = N - value;
-                _finefreqError += fIndex;
-				std::stringstream stream;
-				stream.precision(4);
-				stream << std::fixed << "P " << fIndex;
-				_id = stream.str();
- //               _id = "P " + std::to_string(fIndex);
-            }
-
-            //just noise
-            else
-            {
-                total = N;
-                _finefreqError = 0;
-                _fineTuneIndex = 0;
-                _id = "";
-            }
-
-        } break;
-
-        ////////////////////////////////////////////////////////////////
-        case STATE_DOWNCHIRP0:
-        ////////////////////////////////////////////////////////////////
-        {
-            _state = STATE_DOWNCHIRP1;
-            total = N;
-            _id = "DC";
-            int error = value;
-            if (value > N/2) error -= N;
-            //std::cout << "error0 " << error << std::endl;
-            _freqError = error;
-        } break;
-
-        ////////////////////////////////////////////////////////////////
-        case STATE_DOWNCHIRP1:
-        ////////////////////////////////////////////////////////////////
-        {
-            _state = STATE_QUARTERCHIRP;
-            total = N;
-            _chirpTable = _upChirpTable.data();
-            _id = "";
-            _outSymbols = Pothos::BufferChunk(typeid(int16_t), _mtu);
-
-            int error = value;
-            if (value > N/2) error -= N;
-            //std::cout << "error1 " << error << std::endl;
-            _freqError = (_freqError + error)/2;
-
-            this->emitSignal("error", _freqError);
-            this->emitSignal("power", power);
-            this->emitSignal("snr", snr);
-        } break;
-
-        ////////////////////////////////////////////////////////////////
-        case STATE_QUARTERCHIRP:
-        ////////////////////////////////////////////////////////////////
+        const auto &id = _demod.id();
+        if (not id.empty())
         {
-            _state = STATE_DATASYMBOLS;
-            
-            total = N/4 + (_freqError / 2);
-            _finefreqError += (_freqError / 2);
-            
-            _symCount = 0;
-            _id = "QC";
-        } break;
-
-        ////////////////////////////////////////////////////////////////
-        case STATE_DATASYMBOLS:
-        ////////////////////////////////////////////////////////////////
-        {
-            total = N;
-            _outSymbols.as<int16_t *>()[_symCount++] = int16_t(value);
-            if (_symCount >= _mtu or squelched)
-            {
-                //for (size_t j = 0; j < _symCount; j++)
-                //    std::cout << "demod[" << j << "]=" << _outSymbols.as<const uint16_t *>()[j] << std::endl;
-                Pothos::Packet pkt;
-                pkt.payload = _outSymbols;
-                pkt.payload.length = _symCount*sizeof(int16_t);
-                this->output(0)->postMessage(pkt);
-                _finefreqError = 0;
-                _state = STATE_FRAMESYNC;
-            }
-			std::stringstream stream;
-			stream.precision(4);
-			stream << std::fixed << "S" << _symCount << " " << fIndex;
-			_id = stream.str();
-            //_id = "S" + std::to_string(_symCount) + " " + std::to_string(fIndex);
-            
-           // _finefreqError += fIndex;
-            
-        } break;
-
+            _rawPort->postLabel(Pothos::Label(id, Pothos::Object(), 0));
+            _decPort->postLabel(Pothos::Label(id, Pothos::Object(), 0));
+            _fftPort->postLabel(Pothos::Label(id, Pothos::Object(), 0));
         }
 
-        if (not _id.empty())
+        //the raw output references the consumed input without a copy
+        if (total != 0)
         {
-            _rawPort->postLabel(Pothos::Label(_id, Pothos::Object(), 0));
-            _decPort->postLabel(Pothos::Label(_id, Pothos::Object(), 0));
-            _fftPort->postLabel(Pothos::Label(_id, Pothos::Object(), 0));
+            auto rawBuff = inPort->buffer();
+            rawBuff.length = total*sizeof(std::complex<float>);
+            _rawPort->postBuffer(std::move(rawBuff));
         }
+
         inPort->consume(total);
-        _rawPort->produce(total);
+        inPort->setReserve(_incremental ? 1 : _demod.required());
         _decPort->produce(total);
         
         _fftPort->produce(N);
-        
-        _prevValue = value;
+    }
+
+    //! Step through every symbol that the input buffer holds
+    void workHighRate(void)
+    {
+        auto inPort = this->input(0);
+        const size_t available = inPort->elements();
+        auto inBuff = inPort->buffer().as<const std::complex<float> *>();
+        size_t consumed = 0;
+        while (consumed + _demod.required() <= available)
+        {
+            const size_t offset = consumed;
+            consumed += _demod.step(inBuff + offset);
+            this->postEvents(inPort->totalElements() + consumed);
+
+            const auto &id = _demod.id();
+            if (not id.empty()) _rawPort->postLabel(Pothos::Label(id, Pothos::Object(), offset));
+        }
+
+        //the raw output references the consumed input without a copy
+        if (consumed != 0)
+        {
+            auto rawBuff = inPort->buffer();
+            rawBuff.length = consumed*sizeof(std::complex<float>);
+            _rawPort->postBuffer(std::move(rawBuff));
+        }
+        inPort->consume(consumed);
+
+        //process a partial data symbol and wait for more input
+        const size_t fed = _demod.feed(inBuff + consumed, available - consumed);
+        if (fed == 0) inPort->setReserve(_demod.required());
+        else inPort->setReserve(std::min(available - consumed + 1, _demod.required()));
     }
 
     //! Custom output buffer manager with slabs large enough for debug output
     Pothos::BufferManager::Sptr getOutputBufferManager(const std::string &name, const std::string &domain)
     {
-        if (name == "raw" or name == "dec")
+        if (name == "dec")
         {
             this->output(name)->setReserve(N * 2);
             Pothos::BufferManagerArgs args;
@@ -352,44 +441,72 @@ public:
             Pothos::BufferManagerArgs args;
             args.bufferSize = std::max(args.bufferSize,
                               N*2*sizeof(std::complex<float>));
+            if (_highRate) args.bufferSize = std::max<size_t>(args.bufferSize, 1 << 17); //many symbols per call
             return Pothos::BufferManager::make("generic", args);
         }
         return Pothos::Block::getInputBufferManager(name, domain);
     }
 
 private:
-    //configuration
+
+    //! Emit the signals and packets for the last step, index is the input sample index after the step
+    void postEvents(const unsigned long long index)
+    {
+        if (_demod.syncFound())
+        {
+            this->emitSignal("error", _demod.freqError());
+            this->emitSignal("power", _demod.power());
+            this->emitSignal("snr", _demod.snr());
+
+            Pothos::ObjectKwargs event;
+            event["index"] = Pothos::Object(index + _demod.dataSymbolsDelay());
+            event["sf"] = Pothos::Object(_sf);
+            event["cfo"] = Pothos::Object(_demod.freqError());
+            event["snr"] = Pothos::Object(_demod.snr());
+            event["power"] = Pothos::Object(_demod.power());
+            this->emitSignal("frameDetected", event);
+        }
+
+        if (_explicit and _demod.headerReady() and _header.decodeHeader(_demod.symbols(), _demod.numSymbols()) == LoRaPacketDecoder::DECODE_OK)
+        {
+            Pothos::ObjectKwargs event;
+            event["index"] = Pothos::Object(index);
+            event["endIndex"] = Pothos::Object(index + (_header.packetSymbols() - N_HEADER_SYMBOLS)*N);
+            event["length"] = Pothos::Object(_header.length());
+            event["cr"] = Pothos::Object(codingRateString(_header.codingRate()));
+            event["crc"] = Pothos::Object(_header.crcPresent());
+            this->emitSignal("headerDecoded", event);
+        }
+
+        if (_demod.packetReady())
+        {
+            Pothos::Packet pkt;
+            pkt.metadata["sf"] = Pothos::Object(_sf);
+            pkt.metadata["fineFreqError"] = Pothos::Object(_demod.fineFreqError());
+            pkt.metadata["drift"] = Pothos::Object(_demod.drift()*1e6/N);
+            if (_alternates)
+            {
+                const size_t num = _demod.numSymbols();
+                pkt.metadata["alternates"] = Pothos::Object(std::vector<uint16_t>(_demod.alternates(), _demod.alternates() + num));
+                pkt.metadata["margins"] = Pothos::Object(std::vector<float>(_demod.margins(), _demod.margins() + num));
+            }
+            pkt.payload = Pothos::BufferChunk(typeid(int16_t), _demod.numSymbols());
+            std::memcpy(pkt.payload.as<void *>(), _demod.symbols(), pkt.payload.length);
+            this->output(0)->postMessage(pkt);
+        }
+    }
+
     const size_t N;
-    const size_t _fineSteps;
-    LoRaDetector<float> _detector;
-    std::complex<float> *_chirpTable;
-    std::vector<std::complex<float>> _upChirpTable;
-    std::vector<std::complex<float>> _downChirpTable;
-    std::vector<std::complex<float>> _fineTuneTable;
-    unsigned char _sync;
-    float _thresh;
-    size_t _mtu;
+    const size_t _sf;
+    bool _explicit;
+    bool _alternates;
+    bool _incremental;
+    bool _highRate;
+    LoRaDemodulator _demod;
+    LoRaPacketDecoder _header;
     Pothos::OutputPort *_rawPort;
     Pothos::OutputPort *_decPort;
     Pothos::OutputPort *_fftPort;
-
-    //state
-    enum LoraDemodState
-    {
-        STATE_FRAMESYNC,
-        STATE_DOWNCHIRP0,
-        STATE_DOWNCHIRP1,
-        STATE_QUARTERCHIRP,
-        STATE_DATASYMBOLS,
-    };
-    LoraDemodState _state;
-    size_t _symCount;
-    Pothos::BufferChunk _outSymbols;
-    std::string _id;
-    short _prevValue;
-    int _freqError;
-    int _fineTuneIndex;
-    float _finefreqError;
 };
 
 static Pothos::BlockRegistry registerLoRaDemod(
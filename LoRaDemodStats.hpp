@@ -0,0 +1,55 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <cstddef>
+
+/*!
+ * Counters of the demodulator state machine activity.
+ * The counters accumulate across packets until resetStats().
+ */
+struct LoRaDemodStats
+{
+    enum {NUM_STATES = 5};
+
+    //! The name of a state machine state, the index into the stats arrays
+    static const char *stateName(const size_t state)
+    {
+        static const char *names[NUM_STATES] = {"frameSync", "downChirp0", "downChirp1", "quarterChirp", "dataSymbols"};
+        return (state < NUM_STATES) ? names[state] : "unknown";
+    }
+
+    //! Steps and input samples consumed in each state
+    unsigned long long stateSteps[NUM_STATES];
+    unsigned long long stateSamples[NUM_STATES];
+
+    //! Squelched steps while searching for a frame
+    unsigned long long noiseSymbols;
+
+    //! Steps above the threshold that adjusted the preamble alignment
+    unsigned long long preambleSymbols;
+
+    //! Steps that followed the preamble with a symbol other than the preamble
+    unsigned long long syncAttempts;
+
+    //! Sync attempts that did not match the configured sync word
+    unsigned long long syncWordMismatches;
+
+    //! Frames that passed the sync word check
+    unsigned long long frames;
+
+    //! Frames that squelched before a complete header block
+    unsigned long long falseAlarms;
+
+    //! Frames ended by the squelch and by the symbol MTU
+    unsigned long long squelchEnds;
+    unsigned long long mtuEnds;
+
+    //! Streaming mode: pilot symbols, idle blocks, and symbols slipped to find a header
+    unsigned long long pilotSymbols;
+    unsigned long long idleBlocks;
+    unsigned long long framingSlips;
+
+    //! Streaming mode: returns to frame sync for a repeated preamble or after losing the framing
+    unsigned long long resyncs;
+};
@@ -0,0 +1,803 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include "LoRaDetector.hpp"
+#include "LoRaCodes.hpp"
+#include "LoRaNoiseFloor.hpp"
+#include "LoRaStreamFramer.hpp"
+#include "LoRaDemodStats.hpp"
+#include "FastSinCos.hpp"
+#include <complex>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+/*!
+ * Demodulate LoRa packets from complex samples into symbols.
+ * Each step() dechirps and detects one symbol of input and advances
+ * the synchronization state machine, consuming a variable number of
+ * samples to track the symbol boundary. Completed symbol packets are
+ * available from symbols() when packetReady() returns true.
+ * This is the demodulation used by the LoRa Demod and LoRa RX blocks.
+ */
+class LoRaDemodulator
+{
+public:
+    //! Streaming mode: squelched symbols in a row that end the stream,
+    //! and symbols slipped without a header that lose the framing
+    enum {STREAM_SQUELCH_SYMBOLS = 4, STREAM_HUNT_SYMBOLS = 256};
+
+    LoRaDemodulator(const size_t sf, const size_t channels = 1):
+        N(1 << sf),
+        _channels(channels),
+        _fineSteps(128),
+        _detector(N, channels),
+        _sync(0x12),
+        _thresh(-30.0),
+        _falseAlarmRate(0.0),
+        _mtu(256),
+        _labels(true),
+        _alternates(false),
+        _incremental(false),
+        _streaming(false),
+        _pilotInterval(16),
+        _resyncInterval(0),
+        _tracking(true),
+        _trackAlpha(0.25f),
+        _trackBeta(0.02f)
+    {
+        //generate chirp table
+        std::vector<float> phases(N);
+        float phase = -M_PI;
+        double phaseAccum = 0.0;
+        for (size_t i = 0; i < N; i++)
+        {
+            phaseAccum += phase;
+            phases[i] = float(std::remainder(phaseAccum, 2*M_PI));
+            phase += (2*M_PI)/N;
+        }
+        _downChirpTable.resize(N);
+        fastPolar(phases.data(), _downChirpTable.data(), N);
+        for (const auto &entry : _downChirpTable) _upChirpTable.push_back(std::conj(entry));
+
+        //generate fine tune table
+        phases.resize(N * _fineSteps);
+        const double finePhase = 2.0 * M_PI / (N * _fineSteps);
+        for (size_t i = 0; i < N * _fineSteps; i++){
+            phases[i] = float(std::remainder((i+1)*finePhase, 2*M_PI));
+        }
+        _fineTuneTable.resize(N * _fineSteps);
+        fastPolar(phases.data(), _fineTuneTable.data(), N * _fineSteps);
+        _decSamples.resize(N);
+        _framer.setSpreadFactor(sf);
+
+        this->reset();
+        this->resetStats();
+    }
+
+    void setSync(const unsigned char sync)
+    {
+        _sync = sync;
+    }
+
+    void setThreshold(const double thresh_dB)
+    {
+        _thresh = thresh_dB;
+        _activeThresh = this->adaptiveThreshold();
+    }
+
+    /*!
+     * Adapt the threshold to the noise floor of the idle symbols.
+     * The threshold is raised to the level that noise exceeds
+     * with the given probability, and never set below setThreshold().
+     * A rate of zero disables the adaptation.
+     */
+    void setFalseAlarmRate(const double pfa)
+    {
+        _falseAlarmRate = pfa;
+        _activeThresh = this->adaptiveThreshold();
+    }
+
+    void setMTU(const size_t mtu)
+    {
+        _mtu = mtu;
+    }
+
+    /*!
+     * Enable/disable tracking of the frequency and timing drift over the data symbols.
+     * The fractional bin offset of each symbol feeds a second order loop
+     * that steers the fine tune NCO. The integrated ramp is attributed
+     * to sampling clock drift and slips the symbol boundary a sample at a time.
+     */
+    void enableTracking(const bool tracking)
+    {
+        _tracking = tracking;
+    }
+
+    /*!
+     * Enable/disable the runner-up bin and reliability of each data symbol.
+     * The runner-up is the strongest bin outside of the detected peak,
+     * the margin is the power of the peak over the runner-up in dB.
+     */
+    void enableAlternates(const bool alternates)
+    {
+        _alternates = alternates;
+    }
+
+    /*!
+     * Enable/disable incremental processing of the data symbols.
+     * feed() dechirps and runs the first transform stage on a partial symbol,
+     * so step() only finishes the transform once the symbol is complete,
+     * and a data symbol step requires only one symbol of input.
+     */
+    void enableIncremental(const bool incremental)
+    {
+        _incremental = incremental;
+    }
+
+    /*!
+     * Enable/disable the continuous streaming mode.
+     * After the preamble, the data symbols continue until the squelch
+     * closes for STREAM_SQUELCH_SYMBOLS in a row, so a short fade
+     * only costs symbol errors, with a pilot symbol (bin 0)
+     * after every pilot interval of data symbols.
+     * The pilots steer the tracking loop, and the packets are delimited
+     * from their explicit headers by the stream framer (see LoRaStreamFramer).
+     * The MTU does not apply in this mode.
+     */
+    void enableStreaming(const bool streaming)
+    {
+        _streaming = streaming;
+    }
+
+    //! The number of data symbols between pilots in streaming mode, zero for no pilots
+    void setPilotInterval(const size_t interval)
+    {
+        _pilotInterval = interval;
+    }
+
+    /*!
+     * The number of blocks (packets and idle blocks) between the preambles
+     * that the modulator repeats in streaming mode, zero for a single preamble.
+     * The demodulator returns to frame sync for each repeated preamble,
+     * so a receiver that missed the start of the stream acquires it there.
+     * With repeated preambles, a receiver that hunts for more than
+     * STREAM_HUNT_SYMBOLS without a header has lost the framing,
+     * and also waits for the next preamble.
+     */
+    void setResyncInterval(const size_t interval)
+    {
+        _resyncInterval = interval;
+    }
+
+    //! The symbol set size used to read the stream headers (PPM <= SF, zero for SF)
+    void setSymbolSize(const size_t ppm)
+    {
+        _framer.setSymbolSize(ppm);
+    }
+
+    //! Enable/disable formatting of the debug label ids
+    void enableLabels(const bool labels)
+    {
+        _labels = labels;
+    }
+
+    //! Return to frame sync and forget any packet in progress and the noise floor
+    void reset(void)
+    {
+        _noiseFloor.reset();
+        _activeThresh = _thresh;
+        _state = STATE_FRAMESYNC;
+        _chirpTable = _upChirpTable.data();
+        _fineTuneIndex = 0;
+        _finefreqError = 0;
+        _packetFreqError = 0;
+        _freqError = 0;
+        _prevValue = 0;
+        _symCount = 0;
+        _squelchCount = 0;
+        _streamBlocks = 0;
+        _driftRate = 0;
+        _timingOffset = 0;
+        _syncFound = false;
+        _headerReady = false;
+        _packetReady = false;
+        _fed = 0;
+        _framer.reset();
+    }
+
+    //! Clear the state machine counters
+    void resetStats(void)
+    {
+        _stats = LoRaDemodStats();
+    }
+
+    //! The state machine counters
+    const LoRaDemodStats &stats(void) const
+    {
+        return _stats;
+    }
+
+    //! The number of input samples that step() may read
+    size_t reserve(void) const
+    {
+        return N*2;
+    }
+
+    //! The number of input samples that the next step() requires
+    size_t required(void) const
+    {
+        //a data symbol reads one symbol, plus a sample when the boundary slips
+        if (_incremental and _state == STATE_DATASYMBOLS) return N+1;
+        return this->reserve();
+    }
+
+    /*!
+     * Process a partial symbol of input ahead of the next step().
+     * This only has an effect on data symbols with incremental processing.
+     * \param in the input samples, the same start of input as the next step()
+     * \param num the number of input samples available
+     * \return the number of samples of the symbol processed so far
+     */
+    size_t feed(const std::complex<float> *in, const size_t num)
+    {
+        return this->feed(&in, num);
+    }
+
+    //! Process a partial symbol of input from every channel
+    size_t feed(const std::complex<float> *const *in, const size_t num)
+    {
+        if (not _incremental or _state != STATE_DATASYMBOLS) return 0;
+        if (_fed == 0) _detector.enableIncremental(true);
+        const size_t end = std::min(num, N);
+        if (end > _fed) this->dechirp(in, 0, _fed, end, _fineTuneIndex, _decSamples.data());
+        _fed = std::max(_fed, end);
+        return _fed;
+    }
+
+    /*!
+     * Process the next symbol of input.
+     * \param in the input samples, at least reserve() available
+     * \param [out] dec optional dechirped samples, reserve() in size
+     * \param [out] fft optional fft output of the symbol, N in size
+     * \return the number of input samples consumed
+     */
+    size_t step(const std::complex<float> *in, std::complex<float> *dec = nullptr, std::complex<float> *fft = nullptr)
+    {
+        return this->step(&in, dec, fft);
+    }
+
+    /*!
+     * Process the next symbol of input from every channel.
+     * The channels share the timing and frequency correction,
+     * and the detector combines their spectra non-coherently.
+     * \param in an array of channels() sample aligned inputs
+     * \param [out] dec optional dechirped samples of the first channel
+     * \param [out] fft optional fft output of the first channel
+     * \return the number of input samples consumed from every channel
+     */
+    size_t step(const std::complex<float> *const *in, std::complex<float> *dec = nullptr, std::complex<float> *fft = nullptr)
+    {
+        size_t total = 0;
+        _syncFound = false;
+        _headerReady = false;
+        _packetReady = false;
+        _id.clear();
+
+        //process the available symbol, after any partial symbol from feed()
+        if (_fed == 0) _detector.enableIncremental(_incremental and _state == STATE_DATASYMBOLS);
+        else if (dec != nullptr) std::copy(_decSamples.begin(), _decSamples.begin() + _fed, dec);
+        this->dechirp(in, 0, _fed, N, _fineTuneIndex, dec);
+        _fed = 0;
+        float power = 0;
+        float powerAvg = 0;
+        float snr = 0;
+        float fIndex = 0;
+
+        auto value = _detector.detect(power,powerAvg,fIndex,fft);
+        snr = power - powerAvg;
+        const bool squelched = (snr < _activeThresh);
+        const auto state = _state;
+
+        switch (_state)
+        {
+        ////////////////////////////////////////////////////////////////
+        case STATE_FRAMESYNC:
+        ////////////////////////////////////////////////////////////////
+        {
+            //format as observed from inspecting RN2483
+            bool syncd = not squelched and (_prevValue+4)/8 == 0;
+            bool match0 = (value+4)/8 == unsigned(_sync>>4);
+            bool match1 = false;
+
+            //if the symbol matches sync word0 then check sync word1 as well
+            //otherwise assume its the frame sync and adjust for frequency error
+            if (syncd and match0)
+            {
+                int ft = _fineTuneIndex;
+                this->dechirp(in, N, 0, N, ft, dec);
+                auto value1 = _detector.detect(power,powerAvg,fIndex);
+                //format as observed from inspecting RN2483
+                match1 = (value1+4)/8 == unsigned(_sync & 0xf);
+            }
+
+            //symbols away from the aligned preamble bin sample the noise floor
+            if (not (syncd and match0 and match1) and std::min<size_t>(value, N-value) > 4)
+            {
+                _noiseFloor.update(snr);
+                _activeThresh = this->adaptiveThreshold();
+            }
+            if (syncd and (value+4)/8 != 0)
+            {
+                _stats.syncAttempts++;
+                if (not (match0 and match1)) _stats.syncWordMismatches++;
+            }
+
+            if (syncd and match0 and match1)
+            {
+                total = 2*N;
+                _state = STATE_DOWNCHIRP0;
+                _chirpTable = _downChirpTable.data();
+                _stats.frames++;
+                if (_labels) _id = "SYNC";
+            }
+
+            //otherwise its a frequency error
+            else if (not squelched)
+            {
+                total = N - value;
+                _finefreqError += fIndex;
+                _stats.preambleSymbols++;
+                if (_labels)
+                {
+                    std::stringstream stream;
+                    stream.precision(4);
+                    stream << std::fixed << "P " << fIndex;
+                    _id = stream.str();
+                }
+            }
+
+            //just noise
+            else
+            {
+                total = N;
+                _finefreqError = 0;
+                _fineTuneIndex = 0;
+                _stats.noiseSymbols++;
+            }
+
+        } break;
+
+        ////////////////////////////////////////////////////////////////
+        case STATE_DOWNCHIRP0:
+        ////////////////////////////////////////////////////////////////
+        {
+            _state = STATE_DOWNCHIRP1;
+            total = N;
+            if (_labels) _id = "DC";
+            int error = value;
+            if (value > N/2) error -= N;
+            _freqError = error;
+        } break;
+
+        ////////////////////////////////////////////////////////////////
+        case STATE_DOWNCHIRP1:
+        ////////////////////////////////////////////////////////////////
+        {
+            _state = STATE_QUARTERCHIRP;
+            total = N;
+            _chirpTable = _upChirpTable.data();
+            _symbols.resize(_mtu);
+            _altSymbols.resize(_mtu);
+            _margins.resize(_mtu);
+            _framer.reset();
+
+            int error = value;
+            if (value > N/2) error -= N;
+            _freqError = (_freqError + error)/2;
+
+            _syncFound = true;
+            _power = power;
+            _snr = snr;
+        } break;
+
+        ////////////////////////////////////////////////////////////////
+        case STATE_QUARTERCHIRP:
+        ////////////////////////////////////////////////////////////////
+        {
+            _state = STATE_DATASYMBOLS;
+
+            total = N/4 + (_freqError / 2);
+            _finefreqError += (_freqError / 2);
+
+            _symCount = 0;
+            _squelchCount = 0;
+            _streamBlocks = 0;
+            _driftRate = 0;
+            _timingOffset = 0;
+            if (_labels) _id = "QC";
+        } break;
+
+        ////////////////////////////////////////////////////////////////
+        case STATE_DATASYMBOLS:
+        ////////////////////////////////////////////////////////////////
+        {
+            if (_streaming)
+            {
+                total = this->streamSymbol(value, power, fIndex, squelched);
+                break;
+            }
+            total = N;
+            if (_alternates)
+            {
+                float altPower = 0;
+                _altSymbols[_symCount] = uint16_t(_detector.runnerUp(altPower));
+                _margins[_symCount] = power - altPower;
+            }
+            _symbols[_symCount++] = uint16_t(value);
+            _headerReady = (_symCount == N_HEADER_SYMBOLS);
+            if (_tracking and not squelched) total += this->track(fIndex);
+            if (_symCount >= _mtu or squelched)
+            {
+                _packetReady = true;
+                if (squelched) _stats.squelchEnds++;
+                else _stats.mtuEnds++;
+                if (squelched and _symCount <= N_HEADER_SYMBOLS) _stats.falseAlarms++;
+                _packetFreqError = _finefreqError;
+                _finefreqError = 0;
+                _state = STATE_FRAMESYNC;
+            }
+            if (_labels)
+            {
+                std::stringstream stream;
+                stream.precision(4);
+                stream << std::fixed << "S" << _symCount << " " << fIndex;
+                _id = stream.str();
+            }
+        } break;
+
+        }
+
+        _stats.stateSteps[state]++;
+        _stats.stateSamples[state] += total;
+        _prevValue = value;
+        return total;
+    }
+
+    //! The label id for the start of the last step or empty
+    const std::string &id(void) const
+    {
+        return _id;
+    }
+
+    //! True when the last step found a frame sync
+    bool syncFound(void) const
+    {
+        return _syncFound;
+    }
+
+    //! True when the last step completed the header block of symbols
+    bool headerReady(void) const
+    {
+        return _headerReady;
+    }
+
+    //! True when the last step completed a packet of symbols
+    bool packetReady(void) const
+    {
+        return _packetReady;
+    }
+
+    //! The demodulated symbols: the header block after headerReady(), the packet after packetReady()
+    const uint16_t *symbols(void) const
+    {
+        return _streaming ? _framer.symbols() : _symbols.data();
+    }
+
+    //! The runner-up bin of each symbol when alternates are enabled
+    const uint16_t *alternates(void) const
+    {
+        return _streaming ? _framer.alternates() : _altSymbols.data();
+    }
+
+    //! The peak over runner-up power in dB of each symbol when alternates are enabled
+    const float *margins(void) const
+    {
+        return _streaming ? _framer.margins() : _margins.data();
+    }
+
+    //! The number of demodulated symbols
+    size_t numSymbols(void) const
+    {
+        return _streaming ? _framer.numSymbols() : _symCount;
+    }
+
+    //! After syncFound(), the number of samples from the end of the step to the first data symbol
+    int dataSymbolsDelay(void) const
+    {
+        return int(N/4) + (_freqError / 2);
+    }
+
+    //! The coarse frequency error in bins measured at sync
+    int freqError(void) const
+    {
+        return _freqError;
+    }
+
+    //! The fine frequency correction in bins at the end of the completed packet
+    float fineFreqError(void) const
+    {
+        return _packetFreqError;
+    }
+
+    //! The tracked sampling clock drift in samples per symbol
+    float drift(void) const
+    {
+        return _driftRate;
+    }
+
+    //! The detector power in dB measured at sync
+    float power(void) const
+    {
+        return _power;
+    }
+
+    //! The detector SNR in dB measured at sync
+    float snr(void) const
+    {
+        return _snr;
+    }
+
+    //! The detection threshold in dB in use
+    float threshold(void) const
+    {
+        return _activeThresh;
+    }
+
+    //! The median detector SNR in dB of the idle symbols
+    float noiseFloor(void) const
+    {
+        return _noiseFloor.floor();
+    }
+
+    //! The number of input channels
+    size_t channels(void) const
+    {
+        return _channels;
+    }
+
+    //! The symbol size
+    const size_t N;
+
+private:
+    //! Dechirp and fine tune input samples [begin, end) of the symbol at offset into the detector
+    void dechirp(const std::complex<float> *const *in, const size_t offset, const size_t begin, const size_t end, int &ft, std::complex<float> *dec)
+    {
+        const int tableSize = int(_fineTuneTable.size());
+        for (size_t i = begin; i < end; i++){
+            const auto tune = _chirpTable[i] * _fineTuneTable[ft];
+            ft -= _finefreqError * _fineSteps;
+            ft %= tableSize;
+            if (ft < 0) ft += tableSize;
+            for (size_t ch = 0; ch < _channels; ch++)
+            {
+                auto decd = in[ch][offset + i] * tune;
+                if (ch == 0 and dec != nullptr) dec[offset + i] = decd;
+                _detector.feed(i, decd, ch);
+            }
+        }
+    }
+
+    //! Handle a data symbol of the stream, return the number of samples consumed
+    size_t streamSymbol(const size_t value, const float power, const float fIndex, const bool squelched)
+    {
+        size_t total = N;
+        const bool pilot = _pilotInterval != 0 and (_symCount % (_pilotInterval + 1)) == _pilotInterval;
+        _symCount++;
+
+        //the stream ends when the squelch stays closed, and a partial packet is lost,
+        //the symbols of a shorter fade go to the framer for the decoder to correct
+        _squelchCount = squelched ? _squelchCount + 1 : 0;
+        if (_squelchCount >= STREAM_SQUELCH_SYMBOLS)
+        {
+            _stats.squelchEnds++;
+            _packetFreqError = _finefreqError;
+            _finefreqError = 0;
+            _framer.reset();
+            _state = STATE_FRAMESYNC;
+        }
+
+        //the pilot is known to be bin 0, so its offset is free of decision errors
+        else if (pilot)
+        {
+            const float offset = int(value) - ((value > N/2) ? int(N) : 0) + fIndex;
+            if (_tracking and not squelched) total += this->track(std::max(-1.0f, std::min(1.0f, offset)));
+            _stats.pilotSymbols++;
+        }
+
+        else
+        {
+            float altPower = 0;
+            const auto alt = _alternates ? uint16_t(_detector.runnerUp(altPower)) : uint16_t(0);
+            const auto idleBlocks = _framer.idleBlocks();
+            const auto slips = _framer.slips();
+            _framer.push(uint16_t(value), alt, power - altPower);
+            _stats.idleBlocks += _framer.idleBlocks() - idleBlocks;
+            _stats.framingSlips += _framer.slips() - slips;
+            _packetReady = _framer.packetReady();
+            if (_packetReady) _packetFreqError = _finefreqError;
+            if (_tracking and not squelched) total += this->track(fIndex);
+
+            //return to frame sync for the repeated preamble, or when the framing is lost,
+            //the tracked frequency carries over and the framer resets after the preamble
+            _streamBlocks += _framer.idleBlocks() - idleBlocks + (_packetReady ? 1 : 0);
+            if (_resyncInterval != 0 and (_streamBlocks >= _resyncInterval or _framer.huntSymbols() > STREAM_HUNT_SYMBOLS))
+            {
+                _stats.resyncs++;
+                _state = STATE_FRAMESYNC;
+            }
+        }
+
+        if (_labels)
+        {
+            std::stringstream stream;
+            stream.precision(4);
+            stream << std::fixed << (pilot ? "P" : "S") << _symCount << " " << fIndex;
+            _id = stream.str();
+        }
+        return total;
+    }
+
+    float adaptiveThreshold(void) const
+    {
+        if (_falseAlarmRate <= 0.0 or not _noiseFloor.ready()) return _thresh;
+        return std::max(_thresh, _noiseFloor.threshold(_falseAlarmRate));
+    }
+
+    //! Update the tracking loop with a symbol's fractional bin offset, return the boundary slip
+    int track(const float fIndex)
+    {
+        _driftRate += _trackBeta * fIndex;
+        _finefreqError += _trackAlpha * fIndex + _driftRate;
+        _timingOffset -= _driftRate;
+        int slip = 0;
+        if (_timingOffset >= 0.5f)
+        {
+            _timingOffset -= 1;
+            _finefreqError += 1;
+            slip = 1;
+        }
+        else if (_timingOffset <= -0.5f)
+        {
+            _timingOffset += 1;
+            _finefreqError -= 1;
+            slip = -1;
+        }
+
+        //an offset of N bins is no offset, keep the correction within half the band
+        _finefreqError = std::remainder(_finefreqError, float(N));
+        return slip;
+    }
+
+    //configuration
+    const size_t _channels;
+    const size_t _fineSteps;
+    LoRaDetector<float> _detector;
+    std::complex<float> *_chirpTable;
+    std::vector<std::complex<float>> _upChirpTable;
+    std::vector<std::complex<float>> _downChirpTable;
+    std::vector<std::complex<float>> _fineTuneTable;
+    unsigned char _sync;
+    float _thresh;
+    double _falseAlarmRate;
+    size_t _mtu;
+    bool _labels;
+    bool _alternates;
+    bool _incremental;
+    bool _streaming;
+    size_t _pilotInterval;
+    size_t _resyncInterval;
+    bool _tracking;
+    float _trackAlpha;
+    float _trackBeta;
+
+    //state, in the order of LoRaDemodStats::stateName()
+    enum LoraDemodState
+    {
+        STATE_FRAMESYNC,
+        STATE_DOWNCHIRP0,
+        STATE_DOWNCHIRP1,
+        STATE_QUARTERCHIRP,
+        STATE_DATASYMBOLS,
+    };
+    LoraDemodState _state;
+    size_t _symCount;
+    size_t _squelchCount;
+    size_t _streamBlocks;
+    std::vector<uint16_t> _symbols;
+    std::vector<uint16_t> _altSymbols;
+    std::vector<float> _margins;
+    std::vector<std::complex<float>> _decSamples;
+    size_t _fed;
+    std::string _id;
+    short _prevValue;
+    int _freqError;
+    int _fineTuneIndex;
+    float _finefreqError;
+    float _packetFreqError;
+    float _driftRate;
+    float _timingOffset;
+    bool _syncFound;
+    bool _headerReady;
+    bool _packetReady;
+    float _power;
+    float _snr;
+    LoRaDemodStats _stats;
+    LoRaNoiseFloor _noiseFloor;
+    float _activeThresh;
+    LoRaStreamFramer _framer;
+};
+
+/*!
+ * Step a demodulator over a stream that arrives in chunks of any size.
+ * Whole steps read each chunk in place, and only the samples of a step
+ * that straddles two chunks are copied and kept for the next chunk.
+ * This is the buffering of the async RX and the Python demodulator.
+ */
+class LoRaStepBuffer
+{
+public:
+    /*!
+     * Step through the next chunk of the stream.
+     * \param demod the demodulator that sizes the steps
+     * \param step a callable step(const std::complex<float> *) that steps
+     * the demodulator at the pointer and returns the samples consumed
+     */
+    template <typename Step>
+    void process(const LoRaDemodulator &demod, const std::complex<float> *in, const size_t num, Step &&step)
+    {
+        size_t i = 0;
+
+        //finish the steps that straddle the last chunk
+        if (not _pending.empty())
+        {
+            const size_t take = std::min(num, 2*demod.reserve());
+            _pending.insert(_pending.end(), in, in + take);
+            size_t consumed = 0;
+            while (consumed + demod.required() <= _pending.size())
+            {
+                consumed += step(_pending.data() + consumed);
+            }
+            const size_t left = _pending.size() - consumed;
+            if (left <= take)
+            {
+                i = take - left;
+                _pending.clear();
+            }
+            else
+            {
+                i = take;
+                _pending.erase(_pending.begin(), _pending.begin() + consumed);
+            }
+        }
+
+        while (i + demod.required() <= num)
+        {
+            i += step(in + i);
+        }
+        _pending.insert(_pending.end(), in + i, in + num);
+    }
+
+    //! Drop the samples kept from the last chunk
+    void clear(void)
+    {
+        _pending.clear();
+    }
+
+private:
+    std::vector<std::complex<float>> _pending;
+};
@@ -1,44 +1,105 @@
 // Copyright (c) 2016-2016 Lime Microsystems
 // SPDX-License-Identifier: BSL-1.0
 
+#pragma once
 #include "kissfft.hh"
 #include <complex>
 #include <vector>
+#include <algorithm>
 
+/*!
+ * Detect the strongest bin of a dechirped symbol.
+ * With multiple channels, each channel is transformed separately
+ * and the bin powers are summed for non-coherent diversity combining.
+ * A pair of channels is transformed together across the lanes
+ * of kissfft_lanes, at about the cost of one transform.
+ */
 template <typename Type>
 class LoRaDetector
 {
 public:
-    LoRaDetector(const size_t N):
+    LoRaDetector(const size_t N, const size_t channels = 1):
         N(N),
-        _fftInput(N),
-        _fftOutput(N),
-        _fft(N, false)
+        _channels(channels),
+        _fftInput(N*channels),
+        _fftOutput(N*channels),
+        _mag2(N),
+        _fft(N, false),
+        _incremental(false),
+        _subOutput(N/4),
+        _twiddles(N),
+        _subFft(N/4, false),
+        _pairIn(channels == 2 ? 4*N : 0),
+        _pairOut(channels == 2 ? 4*N : 0),
+        _pairFft(channels == 2 ? N : 2, false)
     {
         _powerScale = 20*std::log10(N);
+        _maxIndex = 0;
+
+        //twiddles between the radix-4 input stage and the N/4 point transforms
+        const size_t L = N/4;
+        for (size_t k = 0; k < 4; k++)
+        {
+            for (size_t n = 0; n < L; n++)
+            {
+                _twiddles[k*L + n] = std::polar(Type(1), Type(-2*M_PI*n*k/N));
+            }
+        }
         return;
     }
 
-    //! feed simply sets an input sample
-    void feed(const size_t i, const std::complex<Type> &samp)
+    /*!
+     * Enable/disable incremental transforms.
+     * The first radix-4 decimation in frequency stage runs in feed(),
+     * the samples must be fed in order starting from index 0.
+     * Only the twiddles and four N/4 point transforms remain for detect().
+     */
+    void enableIncremental(const bool incremental)
+    {
+        _incremental = incremental;
+    }
+
+    //! feed simply sets an input sample of a channel
+    void feed(const size_t i, const std::complex<Type> &samp, const size_t ch = 0)
     {
-        _fftInput[i] = samp;
+        if (not _incremental and _channels == 2)
+        {
+            _pairIn[2*i + ch] = samp.real();
+            _pairIn[2*N + 2*i + ch] = samp.imag();
+            return;
+        }
+        if (not _incremental)
+        {
+            _fftInput[ch*N + i] = samp;
+            return;
+        }
+
+        //accumulate the 4 point DFT across the quarters of the symbol
+        const size_t L = N/4;
+        const size_t n = i % L;
+        const std::complex<Type> jsamp(-samp.imag(), samp.real());
+        auto *acc = _fftInput.data() + ch*N;
+        switch (i / L)
+        {
+        case 0: acc[n] = samp; acc[L+n] = samp; acc[2*L+n] = samp; acc[3*L+n] = samp; break;
+        case 1: acc[n] += samp; acc[L+n] -= jsamp; acc[2*L+n] -= samp; acc[3*L+n] += jsamp; break;
+        case 2: acc[n] += samp; acc[L+n] -= samp; acc[2*L+n] += samp; acc[3*L+n] -= samp; break;
+        case 3: acc[n] += samp; acc[L+n] += jsamp; acc[2*L+n] -= samp; acc[3*L+n] -= jsamp; break;
+        }
     }
 
-    //! calculates argmax(abs(fft(input)))
+    //! calculates argmax(abs(fft(input))), fftOutput receives the first channel
     size_t detect(Type &power, Type &powerAvg, Type &fIndex, std::complex<Type> *fftOutput = nullptr)
     {
-        if (fftOutput == nullptr) fftOutput = _fftOutput.data();
-        _fft.transform(_fftInput.data(), fftOutput);
+        if (not _incremental and _channels == 2) this->transformPair(fftOutput);
+        else this->transformChannels(fftOutput);
+
         size_t maxIndex = 0;
         Type maxValue = 0;
         double total = 0;
         for (size_t i = 0; i < N; i++)
         {
-            auto bin = fftOutput[i];
-            auto re = bin.real();
-            auto im = bin.imag();
-            auto mag2 = re*re + im*im;
+            auto mag2 = _mag2[i];
             total += mag2;
             if (mag2 > maxValue)
             {
@@ -53,20 +114,98 @@ public:
         powerAvg = 20*std::log10(noise) - _powerScale;
         power = 20*std::log10(fundamental) - _powerScale;
 
-        auto left = std::abs(fftOutput[maxIndex > 0?maxIndex-1:N-1]);
-        auto right = std::abs(fftOutput[maxIndex < N-1?maxIndex+1:0]);
+        auto left = std::sqrt(_mag2[maxIndex > 0?maxIndex-1:N-1]);
+        auto right = std::sqrt(_mag2[maxIndex < N-1?maxIndex+1:0]);
 
         const auto demon = (2.0 * fundamental) - right - left;
         if (demon == 0.0) fIndex = 0.0; //check for divide by 0
         else fIndex = 0.5 * (right - left) / demon;
 
+        _maxIndex = maxIndex;
+        return maxIndex;
+    }
+
+    //! the strongest bin of the last detect() outside of the peak and its neighbours
+    size_t runnerUp(Type &power) const
+    {
+        const size_t lo = (_maxIndex + N - 1) % N;
+        const size_t hi = (_maxIndex + 1) % N;
+        size_t maxIndex = (_maxIndex + 2) % N;
+        Type maxValue = 0;
+        for (size_t i = 0; i < N; i++)
+        {
+            if (i == lo or i == _maxIndex or i == hi) continue;
+            auto mag2 = _mag2[i];
+            if (mag2 > maxValue)
+            {
+                maxIndex = i;
+                maxValue = mag2;
+            }
+        }
+        power = 10*std::log10(maxValue) - _powerScale;
         return maxIndex;
     }
 
 private:
+    //! transform each channel and sum their bin powers
+    void transformChannels(std::complex<Type> *fftOutput)
+    {
+        for (size_t ch = 0; ch < _channels; ch++)
+        {
+            auto out = (ch == 0 and fftOutput != nullptr) ? fftOutput : _fftOutput.data() + ch*N;
+            if (_incremental) this->finishTransform(_fftInput.data() + ch*N, out);
+            else _fft.transform(_fftInput.data() + ch*N, out);
+            for (size_t i = 0; i < N; i++)
+            {
+                auto re = out[i].real();
+                auto im = out[i].imag();
+                _mag2[i] = (ch == 0) ? re*re + im*im : _mag2[i] + re*re + im*im;
+            }
+        }
+    }
+
+    //! transform both channels at once and sum their bin powers
+    void transformPair(std::complex<Type> *fftOutput)
+    {
+        const Type *inRe = _pairIn.data(), *inIm = inRe + 2*N;
+        Type *outRe = _pairOut.data(), *outIm = outRe + 2*N;
+        _pairFft.transform(inRe, inIm, outRe, outIm);
+        for (size_t i = 0; i < N; i++)
+        {
+            const auto re0 = outRe[2*i], im0 = outIm[2*i];
+            const auto re1 = outRe[2*i+1], im1 = outIm[2*i+1];
+            _mag2[i] = re0*re0 + im0*im0 + re1*re1 + im1*im1;
+            if (fftOutput != nullptr) fftOutput[i] = std::complex<Type>(re0, im0);
+        }
+    }
+
+    //! twiddle and transform the accumulated quarters, bin 4*k+q is in quarter q
+    void finishTransform(std::complex<Type> *acc, std::complex<Type> *fftOutput)
+    {
+        const size_t L = N/4;
+        for (size_t i = 0; i < N; i++) acc[i] *= _twiddles[i];
+        for (size_t q = 0; q < 4; q++)
+        {
+            _subFft.transform(acc + q*L, _subOutput.data());
+            for (size_t k = 0; k < L; k++) fftOutput[4*k + q] = _subOutput[k];
+        }
+    }
+
     const size_t N;
+    const size_t _channels;
     Type _powerScale;
+    size_t _maxIndex;
     std::vector<std::complex<Type>> _fftInput;
     std::vector<std::complex<Type>> _fftOutput;
+    std::vector<Type> _mag2;
     kissfft<Type> _fft;
+    bool _incremental;
+    std::vector<std::complex<Type>> _subOutput;
+    std::vector<std::complex<Type>> _twiddles;
+    kissfft<Type> _subFft;
+
+    //lane interleaved real then imaginary parts of a channel pair
+    std::vector<Type> _pairIn;
+    std::vector<Type> _pairOut;
+    kissfft_lanes<Type, 2> _pairFft;
 };
@@ -0,0 +1,242 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Framework.hpp>
+#include <complex>
+#include <cstring>
+#include "LoRaDemodulator.hpp"
+#include "LoRaMetadata.hpp"
+
+/***********************************************************************
+ * |PothosDoc LoRa Diversity Demod
+ *
+ * Demodulate LoRa packets from two receive channels into symbols.
+ * The demodulator acquires on the combined signal of both channels:
+ * the dechirped spectra are combined non-coherently (summed power)
+ * before the peak search, so the channels may have any phase relation.
+ * The frame sync, timing and frequency error estimation
+ * and tracking run once, and the correction is shared by both channels.
+ *
+ * <h2>Input format</h2>
+ *
+ * The input ports 0 and 1 accept complex sample streams of modulated chirps
+ * received at the specified bandwidth and carrier frequency.
+ * The streams must be sample aligned, as from two channels of the same receiver.
+ *
+ * <h2>Output format</h2>
+ *
+ * The output port 0 produces a packet containing demodulated symbols,
+ * in the same format as the LoRa Demod block.
+ * The packet metadata contains the following fields:
+ * <ul>
+ * <li>sf - the spread factor of the symbols</li>
+ * <li>fineFreqError - the tracked frequency error in bins at the end of the packet</li>
+ * <li>drift - the tracked sampling clock drift in ppm</li>
+ * <li>alternates - when enabled, the runner-up bin of each symbol (std::vector&lt;uint16_t&gt;)</li>
+ * <li>margins - when enabled, the peak over runner-up power of each symbol in dB (std::vector&lt;float&gt;)</li>
+ * </ul>
+ *
+ * <h2>Frame events</h2>
+ *
+ * The frameDetected signal is emitted as soon as the frame sync is found,
+ * with the same dictionary as the LoRa Demod block.
+ * The getStats() call returns the same counters as the LoRa Demod block.
+ *
+ * |category /LoRa
+ * |keywords lora diversity
+ *
+ * |param sf[Spread factor] The spreading factor controls the symbol spread.
+ * Each symbol will occupy 2^SF number of samples given the waveform BW.
+ * |default 10
+ *
+ * |param sync[Sync word] The sync word is a 2-nibble, 2-symbol sync value.
+ * The demodulator ignores packets that do not match the sync word.
+ * |default 0x12
+ *
+ * |param thresh[Threshold] The minimum required level in dB for the detector.
+ * The threshold level is used to enter and exit the demodulation state machine.
+ * |units dB
+ * |default -30.0
+ *
+ * |param far[False alarm rate] Adapt the threshold to the measured noise floor.
+ * The special value of zero uses the fixed threshold only.
+ * |default 0.0
+ * |option [Fixed] 0.0
+ * |option [1e-3] 1e-3
+ * |option [1e-4] 1e-4
+ * |widget ComboBox(editable=true)
+ * |preview valid
+ *
+ * |param mtu[Symbol MTU] Produce MTU at most symbols after sync is found.
+ * |units symbols
+ * |default 256
+ *
+ * |param tracking Enable/disable tracking of the frequency and timing drift over the data symbols.
+ * |option [On] true
+ * |option [Off] false
+ * |default true
+ *
+ * |param alternates Enable/disable the runner-up bin and reliability of each symbol.
+ * The LoRa Decoder uses them to retry failed packets.
+ * |option [On] true
+ * |option [Off] false
+ * |default false
+ *
+ * |factory /lora/lora_diversity_demod(sf)
+ * |setter setSync(sync)
+ * |setter setThreshold(thresh)
+ * |setter setFalseAlarmRate(far)
+ * |setter setMTU(mtu)
+ * |setter enableTracking(tracking)
+ * |setter enableAlternates(alternates)
+ **********************************************************************/
+class LoRaDiversityDemod : public Pothos::Block
+{
+public:
+    LoRaDiversityDemod(const size_t sf):
+        N(1 << sf),
+        _sf(sf),
+        _alternates(false),
+        _demod(sf, 2)
+    {
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDiversityDemod, setSync));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDiversityDemod, setThreshold));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDiversityDemod, setFalseAlarmRate));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDiversityDemod, setMTU));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDiversityDemod, enableTracking));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDiversityDemod, enableAlternates));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaDiversityDemod, getStats));
+        this->setupInput(0, typeid(std::complex<float>));
+        this->setupInput(1, typeid(std::complex<float>));
+        this->setupOutput(0);
+
+        this->registerSignal("error");
+        this->registerSignal("power");
+        this->registerSignal("snr");
+        this->registerSignal("frameDetected");
+
+        //use at most two input symbols available
+        this->input(0)->setReserve(_demod.reserve());
+        this->input(1)->setReserve(_demod.reserve());
+    }
+
+    static Block *make(const size_t sf)
+    {
+        return new LoRaDiversityDemod(sf);
+    }
+
+    void setSync(const unsigned char sync)
+    {
+        _demod.setSync(sync);
+    }
+
+    void setThreshold(const double thresh_dB)
+    {
+        _demod.setThreshold(thresh_dB);
+    }
+
+    void setFalseAlarmRate(const double pfa)
+    {
+        _demod.setFalseAlarmRate(pfa);
+    }
+
+    void setMTU(const size_t mtu)
+    {
+        _demod.setMTU(mtu);
+    }
+
+    void enableTracking(const bool tracking)
+    {
+        _demod.enableTracking(tracking);
+    }
+
+    void enableAlternates(const bool alternates)
+    {
+        _alternates = alternates;
+        _demod.enableAlternates(alternates);
+    }
+
+    Pothos::ObjectKwargs getStats(void) const
+    {
+        return getDemodStats(_demod.stats(), _demod.threshold(), _demod.noiseFloor());
+    }
+
+    void activate(void)
+    {
+        _demod.reset();
+        _demod.resetStats();
+    }
+
+    void work(void)
+    {
+        auto inPort0 = this->input(0);
+        auto inPort1 = this->input(1);
+        if (std::min(inPort0->elements(), inPort1->elements()) < _demod.required()) return;
+
+        const std::complex<float> *ins[2] = {
+            inPort0->buffer().as<const std::complex<float> *>(),
+            inPort1->buffer().as<const std::complex<float> *>()};
+
+        //process the available symbol on both channels
+        const size_t total = _demod.step(ins);
+
+        if (_demod.syncFound())
+        {
+            this->emitSignal("error", _demod.freqError());
+            this->emitSignal("power", _demod.power());
+            this->emitSignal("snr", _demod.snr());
+
+            Pothos::ObjectKwargs event;
+            event["index"] = Pothos::Object(inPort0->totalElements() + total + _demod.dataSymbolsDelay());
+            event["sf"] = Pothos::Object(_sf);
+            event["cfo"] = Pothos::Object(_demod.freqError());
+            event["snr"] = Pothos::Object(_demod.snr());
+            event["power"] = Pothos::Object(_demod.power());
+            this->emitSignal("frameDetected", event);
+        }
+
+        if (_demod.packetReady())
+        {
+            Pothos::Packet pkt;
+            pkt.metadata["sf"] = Pothos::Object(_sf);
+            pkt.metadata["fineFreqError"] = Pothos::Object(_demod.fineFreqError());
+            pkt.metadata["drift"] = Pothos::Object(_demod.drift()*1e6/N);
+            if (_alternates)
+            {
+                const size_t num = _demod.numSymbols();
+                pkt.metadata["alternates"] = Pothos::Object(std::vector<uint16_t>(_demod.alternates(), _demod.alternates() + num));
+                pkt.metadata["margins"] = Pothos::Object(std::vector<float>(_demod.margins(), _demod.margins() + num));
+            }
+            pkt.payload = Pothos::BufferChunk(typeid(int16_t), _demod.numSymbols());
+            std::memcpy(pkt.payload.as<void *>(), _demod.symbols(), pkt.payload.length);
+            this->output(0)->postMessage(pkt);
+        }
+
+        inPort0->consume(total);
+        inPort1->consume(total);
+        inPort0->setReserve(_demod.required());
+        inPort1->setReserve(_demod.required());
+    }
+
+    //! Custom input buffer manager with slabs large enough for fft input
+    Pothos::BufferManager::Sptr getInputBufferManager(const std::string &name, const std::string &domain)
+    {
+        if (name == "0" or name == "1")
+        {
+            Pothos::BufferManagerArgs args;
+            args.bufferSize = std::max(args.bufferSize,
+                              _demod.reserve()*sizeof(std::complex<float>));
+            return Pothos::BufferManager::make("generic", args);
+        }
+        return Pothos::Block::getInputBufferManager(name, domain);
+    }
+
+private:
+    const size_t N;
+    const size_t _sf;
+    bool _alternates;
+    LoRaDemodulator _demod;
+};
+
+static Pothos::BlockRegistry registerLoRaDiversityDemod(
+    "/lora/lora_diversity_demod", &LoRaDiversityDemod::make);
@@ -0,0 +1,83 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <Pothos/Framework.hpp>
+#include "LoRaCodes.hpp"
+#include "LoRaDemodStats.hpp"
+#include <string>
+
+/***********************************************************************
+ * Per-packet settings carried in packet metadata.
+ * When present, these keys override the block configuration for one packet:
+ *  - "sf" the spread factor (5 to 12)
+ *  - "cr" the coding rate string "4/4" through "4/8"
+ *  - "sync" the sync word
+ *  - "explicit" the header mode (true for explicit)
+ **********************************************************************/
+#define LORA_MIN_SF 5
+#define LORA_MAX_SF 12
+
+template <typename T>
+T getPacketSetting(const Pothos::Packet &pkt, const std::string &key, const T &defaultValue)
+{
+    const auto it = pkt.metadata.find(key);
+    if (it == pkt.metadata.end()) return defaultValue;
+    return it->second.template convert<T>();
+}
+
+static inline size_t getPacketSpreadFactor(const Pothos::Packet &pkt, const size_t defaultSf, const size_t maxSf = LORA_MAX_SF)
+{
+    const auto it = pkt.metadata.find("sf");
+    if (it == pkt.metadata.end()) return defaultSf;
+    const auto sf = it->second.convert<size_t>();
+    if (sf < LORA_MIN_SF or sf > maxSf)
+    {
+        throw Pothos::InvalidArgumentException("LoRa packet metadata sf=" + std::to_string(sf), "unsupported spread factor");
+    }
+    return sf;
+}
+
+static inline size_t getPacketCodingRate(const Pothos::Packet &pkt, const size_t defaultRdd)
+{
+    const auto it = pkt.metadata.find("cr");
+    if (it == pkt.metadata.end()) return defaultRdd;
+    const auto cr = it->second.convert<std::string>();
+    size_t rdd = 0;
+    if (not parseCodingRate(cr, rdd))
+    {
+        throw Pothos::InvalidArgumentException("LoRa packet metadata cr=" + cr, "unknown coding rate");
+    }
+    return rdd;
+}
+
+/***********************************************************************
+ * Demodulator state machine counters as a dictionary for a query call:
+ * one key per event counter, per state "<state>Steps" and "<state>Samples",
+ * and the detection threshold and noise floor in use
+ **********************************************************************/
+static inline Pothos::ObjectKwargs getDemodStats(const LoRaDemodStats &stats, const float threshold, const float noiseFloor)
+{
+    Pothos::ObjectKwargs out;
+    for (size_t i = 0; i < LoRaDemodStats::NUM_STATES; i++)
+    {
+        const std::string name(LoRaDemodStats::stateName(i));
+        out[name+"Steps"] = Pothos::Object(stats.stateSteps[i]);
+        out[name+"Samples"] = Pothos::Object(stats.stateSamples[i]);
+    }
+    out["noiseSymbols"] = Pothos::Object(stats.noiseSymbols);
+    out["preambleSymbols"] = Pothos::Object(stats.preambleSymbols);
+    out["syncAttempts"] = Pothos::Object(stats.syncAttempts);
+    out["syncWordMismatches"] = Pothos::Object(stats.syncWordMismatches);
+    out["frames"] = Pothos::Object(stats.frames);
+    out["falseAlarms"] = Pothos::Object(stats.falseAlarms);
+    out["squelchEnds"] = Pothos::Object(stats.squelchEnds);
+    out["mtuEnds"] = Pothos::Object(stats.mtuEnds);
+    out["pilotSymbols"] = Pothos::Object(stats.pilotSymbols);
+    out["idleBlocks"] = Pothos::Object(stats.idleBlocks);
+    out["framingSlips"] = Pothos::Object(stats.framingSlips);
+    out["resyncs"] = Pothos::Object(stats.resyncs);
+    out["threshold"] = Pothos::Object(threshold);
+    out["noiseFloor"] = Pothos::Object(noiseFloor);
+    return out;
+}
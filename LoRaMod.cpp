@@ -2,10 +2,13 @@
 // SPDX-License-Identifier: BSL-1.0
 
 #include <Pothos/Framework.hpp>
-#include "ChirpGenerator.hpp"
+#include "LoRaModulator.hpp"
+#include "LoRaPacketEncoder.hpp"
+#include "LoRaMetadata.hpp"
 #include <iostream>
 #include <complex>
 #include <cmath>
+#include <algorithm>
 
 /***********************************************************************
  * |PothosDoc LoRa Mod
@@ -16,18 +19,37 @@
  *
  * The input port 0 accepts a packet containing pre-modulated symbols.
  * The format of the packet payload is a buffer of unsigned shorts.
- * A 16-bit short can fit all size symbols from 7 to 12 bits.
+ * A 16-bit short can fit all size symbols from 5 to 12 bits.
+ * The "sf" and "sync" metadata keys override the spread factor
+ * and sync word for that packet, so that one modulator can serve
+ * every data rate up to the max spread factor.
  *
  * <h2>Output format</h2>
  *
  * The output port 0 produces a complex sample stream of modulated chirps
  * to be transmitted at the specified bandwidth and carrier frequency.
  *
+ * <h2>Streaming mode</h2>
+ *
+ * In the streaming mode, the first packet starts a stream with a preamble,
+ * and the following packets continue the stream without a preamble,
+ * saving the 14.25 symbols of preamble and sync per packet.
+ * The packets must be encoded with an explicit header,
+ * which the LoRa Demod uses to delimit the packets in the stream.
+ * When no packet is waiting, the stream is filled with idle blocks
+ * (empty packets of one header block), and after the configured number
+ * of consecutive idle blocks the stream ends with the padding.
+ * A pilot symbol is inserted after every pilot interval of data symbols,
+ * and the preamble is repeated after every resync interval of blocks
+ * (packets and idle blocks), for receivers that start late or lose the stream.
+ * Per-packet "sf" and "sync" metadata only apply when a stream starts.
+ *
  * |category /LoRa
  * |keywords lora
  *
  * |param sf[Spread factor] The spreading factor controls the symbol spread.
  * Each symbol will occupy 2^SF number of samples given the waveform BW.
+ * This is the default for packets without "sf" metadata.
  * |default 10
  *
  * |param sync[Sync word] The sync word is a 2-nibble, 2-symbol sync value.
@@ -43,32 +65,86 @@
  * |param ampl[Amplitude] The digital transmit amplitude.
  * |default 0.3
  *
- * |param ovs[Oversampling ratio] The oversampling ratio.
+ * |param ovs[Oversampling ratio] The oversampling ratio (sample rate / bandwidth).
+ * Fractional ratios are supported to match the DAC rate without a resampler,
+ * in which case the chirps are synthesised directly at the output sample rate
+ * and each symbol spans N*ovs samples on average.
  * |default 1
  *
+ * |param maxSf[Max spread factor] The largest spread factor of the "sf" packet metadata.
+ * The output buffers are sized for the chirps of this spread factor,
+ * and packets with a larger spread factor are rejected.
+ * The special value of zero allows only the spread factor above,
+ * which keeps the buffers small on a fixed rate link at high oversampling.
+ * |default 0
+ * |option [Fixed] 0
+ * |option [SF12] 12
+ * |widget ComboBox(editable=true)
+ * |preview valid
+ *
+ * |param streaming Enable/disable the continuous streaming mode.
+ * |option [On] true
+ * |option [Off] false
+ * |default false
+ *
+ * |param pilots[Pilot interval] The number of data symbols between pilot symbols in streaming mode.
+ * The receiver uses the pilots to track the frequency and timing drift of long streams.
+ * The special value of zero disables the pilots.
+ * |units symbols
+ * |default 16
+ *
+ * |param resync[Resync interval] The number of blocks between repeated preambles in streaming mode.
+ * A receiver that missed the start of the stream, or lost it, acquires it at the next preamble.
+ * The special value of zero sends a single preamble per stream.
+ * |units blocks
+ * |default 0
+ *
+ * |param idle[Idle blocks] The number of idle blocks to wait for a packet before the stream ends.
+ * |default 8
+ *
+ * |param ppm[Symbol size] The size of the symbol set (_ppm &lt;= SF) used to code the idle blocks,
+ * which must match the encoder of the stream.
+ * The special value of zero uses the full symbol set (PPM == SF).
+ * |default 0
+ * |option [Full set] 0
+ * |widget ComboBox(editable=true)
+ * |preview valid
+ *
  * |factory /lora/lora_mod(sf)
  * |initializer setOvs(ovs)
+ * |initializer setMaxSpreadFactor(maxSf)
  * |setter setSync(sync)
  * |setter setPadding(padding)
  * |setter setAmplitude(ampl)
+ * |setter enableStreaming(streaming)
+ * |setter setPilotInterval(pilots)
+ * |setter setResyncInterval(resync)
+ * |setter setIdleBlocks(idle)
+ * |setter setSymbolSize(ppm)
  **********************************************************************/
 class LoRaMod : public Pothos::Block
 {
 public:
 	LoRaMod(const size_t sf) :
-		N(1 << sf),
-		_ovs(1),
+		_mod(sf),
+		_sf(sf),
+		_maxSf(sf),
 		_sync(0x12),
-		_padding(1),
-		_ampl(0.3f)
+		_idleBlocks(8),
+		_idleCount(0)
     {
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaMod, setSync));
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaMod, setPadding));
         this->registerCall(this, POTHOS_FCN_TUPLE(LoRaMod, setAmplitude));
 		this->registerCall(this, POTHOS_FCN_TUPLE(LoRaMod, setOvs));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaMod, setMaxSpreadFactor));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaMod, enableStreaming));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaMod, setPilotInterval));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaMod, setResyncInterval));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaMod, setIdleBlocks));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaMod, setSymbolSize));
         this->setupInput(0);
         this->setupOutput(0, typeid(std::complex<float>));
-		_phaseAccum = 0;
     }
 
     static Block *make(const size_t sf)
@@ -83,151 +159,112 @@ public:
 
     void setPadding(const size_t padding)
     {
-        _padding = padding;
+        _mod.setPadding(padding);
     }
 
     void setAmplitude(const float ampl)
     {
-        _ampl = ampl;
+        _mod.setAmplitude(ampl);
     }
 
-	void setOvs(const size_t ovs)
+	void setOvs(const double ovs)
 	{
-		if (ovs < 1 || ovs > 256) {
-			throw Pothos::InvalidArgumentException("LoRaDecoder::setOvs(" + std::to_string(ovs) + ")", "invalid oversampling ratio");
+		if (!(ovs >= 1 && ovs <= 256)) {
+			throw Pothos::InvalidArgumentException("LoRaMod::setOvs(" + std::to_string(ovs) + ")", "invalid oversampling ratio");
 		}
 		else {
-			_ovs = ovs;
+			_mod.setOvs(ovs);
 		}
 	}
 
+    void setMaxSpreadFactor(const size_t maxSf)
+    {
+        if (maxSf != 0 and (maxSf < _sf or maxSf > LORA_MAX_SF))
+        {
+            throw Pothos::InvalidArgumentException("LoRaMod::setMaxSpreadFactor(" + std::to_string(maxSf) + ")", "failed check: SF <= max SF <= 12");
+        }
+        _maxSf = (maxSf == 0) ? _sf : maxSf;
+    }
+
+    void enableStreaming(const bool streaming)
+    {
+        _mod.enableStreaming(streaming);
+    }
+
+    void setPilotInterval(const size_t interval)
+    {
+        _mod.setPilotInterval(interval);
+    }
+
+    void setResyncInterval(const size_t interval)
+    {
+        _mod.setResyncInterval(interval);
+    }
+
+    void setIdleBlocks(const size_t idle)
+    {
+        _idleBlocks = idle;
+    }
+
+    void setSymbolSize(const size_t ppm)
+    {
+        if (ppm > _sf) throw Pothos::InvalidArgumentException("LoRaMod::setSymbolSize("+std::to_string(ppm)+")", "failed check: PPM <= SF");
+        _idleEncoder.ppm = ppm;
+    }
+
     void activate(void)
     {
-        _state = STATE_WAITINPUT;
+        _mod.reset();
     }
 
     void work(void)
     {
         auto outPort = this->output(0);
-        //float freq = 0.0;
-        const size_t NN = N  * _ovs;
         auto samps = outPort->buffer().as<std::complex<float> *>();
-        size_t i = 0;
 
-        //std::cout << "mod state " << int(_state) << std::endl;
-        switch (_state)
-        {
-        ////////////////////////////////////////////////////////////////
-        case STATE_WAITINPUT:
-        ////////////////////////////////////////////////////////////////
+        //start the next packet
+        if (not _mod.active())
         {
-			if (not this->input(0)->hasMessage()) {
-				//for (i = 0; i < N; i++){
-					//samps[i] = 0;
-				//}
-				//outPort->produce(i);
-				return;
-			}
+            if (not this->input(0)->hasMessage()) return;
             auto msg = this->input(0)->popMessage();
             auto pkt = msg.extract<Pothos::Packet>();
             _payload = pkt.payload;
-            _state = STATE_FRAMESYNC;
-            _counter = 10;
-            _phaseAccum = 0;
-            _id = "";
-        } break;
-
-        ////////////////////////////////////////////////////////////////
-        case STATE_FRAMESYNC:
-        ////////////////////////////////////////////////////////////////
-        {
-            _counter--;
-            i = genChirp(samps, N, _ovs, NN, 0.0f, false, _ampl, _phaseAccum);
-            if (_counter == 0) _state = STATE_SYNCWORD0;
-        } break;
-
-        ////////////////////////////////////////////////////////////////
-        case STATE_SYNCWORD0:
-        ////////////////////////////////////////////////////////////////
-        {
-            const int sw0 = (_sync >> 4)*8;
-            const float freq = (2*M_PI*sw0)/NN;
-            i = genChirp(samps, N, _ovs, NN, freq, false, _ampl, _phaseAccum);
-            _state = STATE_SYNCWORD1;
-            _id = "SYNC";
-        } break;
-
-        ////////////////////////////////////////////////////////////////
-        case STATE_SYNCWORD1:
-        ////////////////////////////////////////////////////////////////
-        {
-            const int sw1 = (_sync & 0xf)*8;
-            const float freq = (2*M_PI*sw1)/NN;
-            i = genChirp(samps, N, _ovs, NN, freq, false, _ampl, _phaseAccum);
-            _state = STATE_DOWNCHIRP0;
-            _id = "";
-        } break;
+            const size_t sf = getPacketSpreadFactor(pkt, _sf, _maxSf);
+            _mod.setSpreadFactor(sf);
+            _mod.setSync(getPacketSetting<unsigned char>(pkt, "sync", _sync));
+            _mod.start(_payload.as<const uint16_t *>(), _payload.elements());
 
-        ////////////////////////////////////////////////////////////////
-        case STATE_DOWNCHIRP0:
-        ////////////////////////////////////////////////////////////////
-        {
-            i = genChirp(samps, N, _ovs, NN, 0.0f, true, _ampl, _phaseAccum);
-            _state = STATE_DOWNCHIRP1;
-            _id = "DC";
-        } break;
-
-        ////////////////////////////////////////////////////////////////
-        case STATE_DOWNCHIRP1:
-        ////////////////////////////////////////////////////////////////
-        {
-            i = genChirp(samps, N, _ovs, NN, 0.0f, true, _ampl, _phaseAccum);
-            _state = STATE_QUARTERCHIRP;
-            _id = "";
-        } break;
-
-        ////////////////////////////////////////////////////////////////
-        case STATE_QUARTERCHIRP:
-        ////////////////////////////////////////////////////////////////
-        {
-            i = genChirp(samps, N, _ovs, NN / 4, 0.0f, true, _ampl, _phaseAccum);
-            _state = STATE_DATASYMBOLS;
-            _counter = 0;
-            _id = "QC";
-        } break;
+            //the idle block of a stream is an empty packet without a crc
+            const uint8_t empty = 0;
+            _idleEncoder.sf = sf;
+            _idleEncoder.crc = false;
+            _idleEncoder.encode(&empty, 0, _idleSymbols);
+            _idleCount = 0;
+        }
 
-        ////////////////////////////////////////////////////////////////
-        case STATE_DATASYMBOLS:
-        ////////////////////////////////////////////////////////////////
+        //continue the stream with the next packet or an idle block
+        else if (_mod.streamWaiting())
         {
-            const int sym = _payload.as<const uint16_t *>()[_counter++];
-            const float freq = (2*M_PI*sym)/NN;
-            i = genChirp(samps, N, _ovs, NN, freq, false, _ampl, _phaseAccum);
-        
-            if (_counter >= _payload.elements())
+            if (this->input(0)->hasMessage())
             {
-                //for (size_t j = 0; j < _counter; j++)
-                //    std::cout << "mod[" << j << "]=" << _payload.as<const uint16_t *>()[j] << std::endl;
-                _state = STATE_PADSYMBOLS;
-                _counter = 0;
+                auto msg = this->input(0)->popMessage();
+                _payload = msg.extract<Pothos::Packet>().payload;
+                _mod.stream(_payload.as<const uint16_t *>(), _payload.elements());
+                _idleCount = 0;
             }
-            _id = "S" + std::to_string(_counter);
-        } break;
-
-        ////////////////////////////////////////////////////////////////
-        case STATE_PADSYMBOLS:
-        ////////////////////////////////////////////////////////////////
-        {
-            _counter++;
-            for (i = 0; i < NN; i++) samps[i] = 0.0f;
-            if (_counter >= _padding)
+            else if (_idleCount < _idleBlocks)
             {
-                _state = STATE_WAITINPUT;
-                outPort->postLabel(Pothos::Label("txEnd", Pothos::Object(), N-1));
+                _mod.stream(_idleSymbols.data(), _idleSymbols.size());
+                _idleCount++;
             }
-            _id = "";
-        } break;
+            else _mod.endStream();
+        }
 
+        bool txEnd = false;
+        const size_t i = _mod.step(samps, _id, txEnd);
+        if (txEnd)
+        {
+            outPort->postLabel(Pothos::Label("txEnd", Pothos::Object(), _mod.chirpSize()-1));
         }
 
         if (not _id.empty())
@@ -242,37 +279,24 @@ public:
     {
         if (name == "0")
         {
-            this->output(name)->setReserve(N * _ovs);
+            const size_t maxNN = _mod.maxStepSamples(_maxSf);
+            this->output(name)->setReserve(maxNN);
             Pothos::BufferManagerArgs args;
-            args.bufferSize = N * _ovs  *sizeof(std::complex<float>);
+            args.bufferSize = maxNN *sizeof(std::complex<float>);
             return Pothos::BufferManager::make("generic", args);
         }
         return Pothos::Block::getOutputBufferManager(name, domain);
     }
 
 private:
-    //configuration
-    const size_t N;
-	size_t _ovs;
+    LoRaModulator _mod;
+    const size_t _sf;
+    size_t _maxSf;
     unsigned char _sync;
-    size_t _padding;
-    float _ampl;
-	float _phaseAccum;
-    //state
-    enum LoraDemodState
-    {
-        STATE_WAITINPUT,
-        STATE_FRAMESYNC,
-        STATE_SYNCWORD0,
-        STATE_SYNCWORD1,
-        STATE_DOWNCHIRP0,
-        STATE_DOWNCHIRP1,
-        STATE_QUARTERCHIRP,
-        STATE_DATASYMBOLS,
-        STATE_PADSYMBOLS,
-    };
-    LoraDemodState _state;
-    size_t _counter;
+    size_t _idleBlocks;
+    size_t _idleCount;
+    LoRaPacketEncoder _idleEncoder;
+    std::vector<uint16_t> _idleSymbols;
     Pothos::BufferChunk _payload;
     std::string _id;
 };
@@ -0,0 +1,400 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include "ChirpGenerator.hpp"
+#include <complex>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+/*!
+ * Render LoRa packets from symbols into chirps, one chirp per step.
+ * The modulator produces the preamble, sync word, down-chirps,
+ * quarter chirp, data symbols, and padding for each packet.
+ * This is the modulation used by the LoRa Mod and LoRa TX blocks.
+ */
+class LoRaModulator
+{
+public:
+    LoRaModulator(const size_t sf):
+        N(1 << sf),
+        _ovs(1),
+        _sync(0x12),
+        _padding(1),
+        _ampl(0.3f),
+        _streaming(false),
+        _pilotInterval(16),
+        _resyncInterval(0),
+        _phaseAccum(0),
+        _timeOffset(0),
+        _state(STATE_WAITINPUT),
+        _counter(0),
+        _streamCount(0),
+        _streamBlocks(0),
+        _symbols(nullptr),
+        _numSymbols(0)
+    {
+        return;
+    }
+
+    //! Set the spread factor for the next packet, the caller validates the range
+    void setSpreadFactor(const size_t sf)
+    {
+        N = 1 << sf;
+    }
+
+    void setSync(const unsigned char sync)
+    {
+        _sync = sync;
+    }
+
+    void setPadding(const size_t padding)
+    {
+        _padding = padding;
+    }
+
+    void setAmplitude(const float ampl)
+    {
+        _ampl = ampl;
+    }
+
+    /*!
+     * Enable/disable the continuous streaming mode.
+     * After the data symbols of the first packet, the modulator waits
+     * in streamWaiting() for the caller to continue the stream with
+     * more symbols or to end it, rather than pad out the packet.
+     * A pilot symbol (bin 0) follows every pilot interval of data symbols.
+     */
+    void enableStreaming(const bool streaming)
+    {
+        _streaming = streaming;
+    }
+
+    //! The number of data symbols between pilots in streaming mode, zero for no pilots
+    void setPilotInterval(const size_t interval)
+    {
+        _pilotInterval = interval;
+    }
+
+    /*!
+     * Repeat the preamble before every interval of blocks in streaming mode,
+     * counting the packets from stream() and the first packet of the stream,
+     * so a receiver that missed the start of the stream or lost it can acquire it.
+     * The special value of zero sends a single preamble per stream.
+     */
+    void setResyncInterval(const size_t interval)
+    {
+        _resyncInterval = interval;
+    }
+
+    //! Set the oversampling ratio, the caller validates the range
+    void setOvs(const double ovs)
+    {
+        _ovs = ovs;
+    }
+
+    //! The most samples that a single step() can produce
+    size_t maxStepSamples(void) const
+    {
+        return size_t(std::ceil(N * _ovs));
+    }
+
+    //! The most samples that a single step() can produce at the given spread factor
+    size_t maxStepSamples(const size_t sf) const
+    {
+        return size_t(std::ceil((1 << sf) * _ovs));
+    }
+
+    //! The up-chirps of the preamble before the sync word
+    enum {PREAMBLE_UPCHIRPS = 10};
+
+    //! The symbols of preamble, sync word and down-chirps before the data symbols
+    static double syncSymbols(void)
+    {
+        return PREAMBLE_UPCHIRPS + 2 + 2.25;
+    }
+
+    //! The most samples that modulateFrame() can append for a packet of numSymbols
+    size_t maxFrameSamples(const size_t numSymbols) const
+    {
+        //a step per chirp: the preamble, 2 sync words, 2 down-chirps, the quarter chirp, then at least one pad step
+        return (PREAMBLE_UPCHIRPS + 5 + numSymbols + std::max<size_t>(_padding, 1))*this->maxStepSamples();
+    }
+
+    //! Abort any packet in progress
+    void reset(void)
+    {
+        _state = STATE_WAITINPUT;
+    }
+
+    //! True when a packet is being rendered
+    bool active(void) const
+    {
+        return _state != STATE_WAITINPUT;
+    }
+
+    /*!
+     * Begin rendering a new packet.
+     * The symbols must remain valid until the packet completes.
+     */
+    void start(const uint16_t *symbols, const size_t numSymbols)
+    {
+        _symbols = symbols;
+        _numSymbols = numSymbols;
+        _state = STATE_FRAMESYNC;
+        _counter = PREAMBLE_UPCHIRPS;
+        _phaseAccum = 0;
+        _timeOffset = 0;
+        _streamCount = 0;
+        _streamBlocks = 1;
+    }
+
+    //! True when the stream needs more symbols from stream() or endStream()
+    bool streamWaiting(void) const
+    {
+        return _state == STATE_STREAMWAIT;
+    }
+
+    /*!
+     * Continue the stream with the next symbols, without a preamble.
+     * The symbols must remain valid until the next streamWaiting().
+     */
+    void stream(const uint16_t *symbols, const size_t numSymbols)
+    {
+        _symbols = symbols;
+        _numSymbols = numSymbols;
+        _counter = 0;
+        _state = (_numSymbols == 0)? STATE_STREAMWAIT : STATE_DATASYMBOLS;
+        if (_numSymbols == 0 or _resyncInterval == 0 or (_streamBlocks++ % _resyncInterval) != 0) return;
+
+        //the repeated preamble continues the phase and timing of the stream
+        _state = STATE_FRAMESYNC;
+        _counter = PREAMBLE_UPCHIRPS;
+        _streamCount = 0;
+    }
+
+    //! End the stream with the padding
+    void endStream(void)
+    {
+        _counter = 0;
+        _state = STATE_PADSYMBOLS;
+    }
+
+    /*!
+     * Render the next chirp of the active packet.
+     * \param [out] samps output buffer with room for maxStepSamples()
+     * \param [out] id the label for the start of this chirp or empty
+     * \param [out] txEnd true when this step completed the packet
+     * \return the number of samples produced
+     */
+    size_t step(std::complex<float> *samps, std::string &id, bool &txEnd)
+    {
+        const double NN = N  * _ovs;
+        size_t i = 0;
+        txEnd = false;
+
+        switch (_state)
+        {
+        ////////////////////////////////////////////////////////////////
+        case STATE_WAITINPUT:
+        case STATE_STREAMWAIT:
+        ////////////////////////////////////////////////////////////////
+        {
+            id = "";
+        } break;
+
+        ////////////////////////////////////////////////////////////////
+        case STATE_FRAMESYNC:
+        ////////////////////////////////////////////////////////////////
+        {
+            _counter--;
+            i = this->genSymbol(samps, 0.0f, false, N);
+            if (_counter == 0) _state = STATE_SYNCWORD0;
+            id = "";
+        } break;
+
+        ////////////////////////////////////////////////////////////////
+        case STATE_SYNCWORD0:
+        ////////////////////////////////////////////////////////////////
+        {
+            const int sw0 = (_sync >> 4)*8;
+            const float freq = (2*M_PI*sw0)/NN;
+            i = this->genSymbol(samps, freq, false, N);
+            _state = STATE_SYNCWORD1;
+            id = "SYNC";
+        } break;
+
+        ////////////////////////////////////////////////////////////////
+        case STATE_SYNCWORD1:
+        ////////////////////////////////////////////////////////////////
+        {
+            const int sw1 = (_sync & 0xf)*8;
+            const float freq = (2*M_PI*sw1)/NN;
+            i = this->genSymbol(samps, freq, false, N);
+            _state = STATE_DOWNCHIRP0;
+            id = "";
+        } break;
+
+        ////////////////////////////////////////////////////////////////
+        case STATE_DOWNCHIRP0:
+        ////////////////////////////////////////////////////////////////
+        {
+            i = this->genSymbol(samps, 0.0f, true, N);
+            _state = STATE_DOWNCHIRP1;
+            id = "DC";
+        } break;
+
+        ////////////////////////////////////////////////////////////////
+        case STATE_DOWNCHIRP1:
+        ////////////////////////////////////////////////////////////////
+        {
+            i = this->genSymbol(samps, 0.0f, true, N);
+            _state = STATE_QUARTERCHIRP;
+            id = "";
+        } break;
+
+        ////////////////////////////////////////////////////////////////
+        case STATE_QUARTERCHIRP:
+        ////////////////////////////////////////////////////////////////
+        {
+            i = this->genSymbol(samps, 0.0f, true, N / 4);
+            if (_numSymbols != 0) _state = STATE_DATASYMBOLS;
+            else _state = _streaming ? STATE_STREAMWAIT : STATE_PADSYMBOLS;
+            _counter = 0;
+            id = "QC";
+        } break;
+
+        ////////////////////////////////////////////////////////////////
+        case STATE_DATASYMBOLS:
+        ////////////////////////////////////////////////////////////////
+        {
+            //the pilot is an unmodulated up-chirp between the data symbols
+            if (_streaming and _pilotInterval != 0 and (_streamCount++ % (_pilotInterval + 1)) == _pilotInterval)
+            {
+                i = this->genSymbol(samps, 0.0f, false, N);
+                id = "PILOT";
+                break;
+            }
+
+            const int sym = _symbols[_counter++];
+            const float freq = (2*M_PI*sym)/NN;
+            i = this->genSymbol(samps, freq, false, N);
+
+            if (_counter >= _numSymbols)
+            {
+                _state = _streaming ? STATE_STREAMWAIT : STATE_PADSYMBOLS;
+                _counter = 0;
+            }
+            id = "S" + std::to_string(_counter);
+        } break;
+
+        ////////////////////////////////////////////////////////////////
+        case STATE_PADSYMBOLS:
+        ////////////////////////////////////////////////////////////////
+        {
+            _counter++;
+            const size_t numPad = this->numSamples(N);
+            for (i = 0; i < numPad; i++) samps[i] = 0.0f;
+            if (_counter >= _padding)
+            {
+                _state = STATE_WAITINPUT;
+                txEnd = true;
+            }
+            id = "";
+        } break;
+
+        }
+
+        return i;
+    }
+
+    /*!
+     * Render a whole packet in one call, for tests and offline tools.
+     * The samples from the preamble through the padding are appended to samps.
+     * \return the number of samples appended
+     */
+    size_t modulateFrame(const uint16_t *symbols, const size_t numSymbols, std::vector<std::complex<float>> &samps)
+    {
+        const size_t begin = samps.size();
+        this->start(symbols, numSymbols);
+        std::string id;
+        bool txEnd = false;
+        while (this->active())
+        {
+            const size_t offset = samps.size();
+            samps.resize(offset + this->maxStepSamples());
+            samps.resize(offset + this->step(samps.data() + offset, id, txEnd));
+        }
+        return samps.size() - begin;
+    }
+
+    //! The chirp size without oversampling
+    size_t chirpSize(void) const
+    {
+        return N;
+    }
+
+private:
+    //! Is the oversampling ratio an integer?
+    bool isIntegerOvs(void) const
+    {
+        return _ovs == std::floor(_ovs);
+    }
+
+    //! Number of output samples spanned by the next numChips chips
+    size_t numSamples(const size_t numChips)
+    {
+        if (this->isIntegerOvs()) return numChips * size_t(_ovs);
+        const double len = numChips * _ovs;
+        const size_t n = size_t(std::ceil(len - _timeOffset));
+        _timeOffset += n - len;
+        return n;
+    }
+
+    //! Generate the next chirp using the integer or fractional generator
+    size_t genSymbol(std::complex<float> *samps, const float freq, const bool down, const size_t numChips)
+    {
+        if (this->isIntegerOvs())
+        {
+            const int ovs = int(_ovs);
+            return genChirp(samps, N, ovs, int(numChips * ovs), freq, down, _ampl, _phaseAccum);
+        }
+        return genChirpFrac(samps, N, _ovs, double(numChips), freq, down, _ampl, _phaseAccum, _timeOffset);
+    }
+
+    //configuration
+    size_t N;
+    double _ovs;
+    unsigned char _sync;
+    size_t _padding;
+    float _ampl;
+    bool _streaming;
+    size_t _pilotInterval;
+    size_t _resyncInterval;
+
+    //state
+    float _phaseAccum;
+    double _timeOffset;
+    enum LoraModState
+    {
+        STATE_WAITINPUT,
+        STATE_FRAMESYNC,
+        STATE_SYNCWORD0,
+        STATE_SYNCWORD1,
+        STATE_DOWNCHIRP0,
+        STATE_DOWNCHIRP1,
+        STATE_QUARTERCHIRP,
+        STATE_DATASYMBOLS,
+        STATE_PADSYMBOLS,
+        STATE_STREAMWAIT,
+    };
+    LoraModState _state;
+    size_t _counter;
+    size_t _streamCount;
+    size_t _streamBlocks;
+    const uint16_t *_symbols;
+    size_t _numSymbols;
+};
@@ -0,0 +1,84 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+/*!
+ * Track the detector SNR of idle symbols to set the detection threshold.
+ * Each update() moves three streaming quantile estimates (25%, 50%, 75%)
+ * by a fixed step in dB, so the cost per symbol is constant.
+ * The peak bin of a noise-only symbol is the maximum of many
+ * exponentially distributed bins, so the ratio follows a Gumbel law:
+ * the location and scale are fit from the quartiles and give the level
+ * that idle symbols exceed with the requested false alarm probability.
+ */
+class LoRaNoiseFloor
+{
+public:
+    LoRaNoiseFloor(void):
+        _step(0.05f)
+    {
+        this->reset();
+    }
+
+    //! Forget the tracked distribution
+    void reset(void)
+    {
+        _count = 0;
+        _lower = 0;
+        _median = 0;
+        _upper = 0;
+    }
+
+    //! Update with the detector SNR in dB of an idle symbol
+    void update(const float snr)
+    {
+        if (_count++ == 0)
+        {
+            _lower = _median = _upper = snr;
+            return;
+        }
+        quantileUpdate(_lower, snr, 0.25f);
+        quantileUpdate(_median, snr, 0.50f);
+        quantileUpdate(_upper, snr, 0.75f);
+    }
+
+    //! True once enough idle symbols were seen to trust the estimate
+    bool ready(void) const
+    {
+        return _count >= 256;
+    }
+
+    //! The median detector SNR in dB of the idle symbols
+    float floor(void) const
+    {
+        return _median;
+    }
+
+    //! The SNR in dB exceeded by idle symbols with probability pfa
+    float threshold(const double pfa) const
+    {
+        const double lower = std::pow(10.0, _lower/10);
+        const double upper = std::pow(10.0, _upper/10);
+        const double scale = std::max(upper - lower, 0.0)/1.5725; //Q(0.75) - Q(0.25) = 1.5725*scale
+        const double location = lower + 0.3266*scale; //Q(0.25) = location - 0.3266*scale
+        const double level = location - scale*std::log(-std::log1p(-pfa));
+        return float(10*std::log10(level));
+    }
+
+private:
+    void quantileUpdate(float &q, const float x, const float p) const
+    {
+        if (x < q) q -= _step*(1-p);
+        else q += _step*p;
+    }
+
+    const float _step;
+    size_t _count;
+    float _lower;
+    float _median;
+    float _upper;
+};
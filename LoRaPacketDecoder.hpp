@@ -0,0 +1,412 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// Copyright (c) 2016-2016 Arne Hennig
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <numeric>
+#include "LoRaCodes.hpp"
+
+/*!
+ * Decode LoRa modulation symbols into bytes.
+ * The decoder gray encodes to convert measurement error into bit errors,
+ * deinterleaves, handles error correction, and descrambles.
+ * This is the decoding used by the LoRa Decoder and LoRa RX blocks.
+ */
+class LoRaPacketDecoder
+{
+public:
+    //! The result of decoding a packet of symbols
+    enum Status
+    {
+        DECODE_OK, //!< the payload is available
+        DECODE_SYMBOLS, //!< interleaving is disabled, the gray coded symbols are available
+        DECODE_SHORT, //!< not enough symbols for a header
+        DECODE_HEADER_ERROR, //!< the header failed error checking
+        DECODE_LENGTH_ERROR, //!< the header length exceeds the symbols
+        DECODE_FEC_ERROR, //!< the payload failed error checking
+        DECODE_CRC_ERROR, //!< the payload crc did not match
+    };
+
+    LoRaPacketDecoder(void):
+        sf(10),
+        ppm(0),
+        rdd(4),
+        crcc(false),
+        interleaving(true),
+        errorCheck(false),
+        explicitHeader(true),
+        hdr(false),
+        dataLength(8),
+        retries(0),
+        _rdd(4),
+        _crcPresent(false),
+        _offset(0),
+        _length(0),
+        _attempts(0)
+    {
+        return;
+    }
+
+    //! The symbol set size (PPM <= SF)
+    size_t symbolSize(void) const
+    {
+        return (ppm == 0) ? sf : ppm;
+    }
+
+    /*!
+     * Decode a packet of symbols.
+     * The caller must ensure that symbolSize() <= sf.
+     * \param syms pointer to the demodulated symbols
+     * \param numSyms the number of symbols
+     * \return the decode status
+     */
+    Status decode(const uint16_t *syms, const size_t numSyms)
+    {
+        const size_t PPM = this->symbolSize();
+        if (numSyms < N_HEADER_SYMBOLS) return DECODE_SHORT; // need at least a header
+
+        int rdd = this->rdd; //make a copy to be changed in header decode
+        _rdd = rdd;
+        _crcPresent = crcc;
+
+        this->demapSymbols(syms, numSyms, roundUp(numSyms, 4 + rdd));
+        if (not interleaving) return DECODE_SYMBOLS;
+        this->deinterleaveHeader();
+        std::vector<uint8_t> &codewords = _codewords;
+
+        bool error = false;
+        bool bad = false;
+        uint8_t header[3];
+        size_t dOfs = 0;
+        size_t cOfs = 0;
+
+        size_t packetLength = 0;
+        size_t dataLength = 0;
+        bool checkCrc = crcc;
+
+        if (explicitHeader) {
+            this->decodeHeaderFields(header, error, bad);
+            if (error && errorCheck) return DECODE_HEADER_ERROR;
+
+            if (0 == (header[1] & 1)) checkCrc = false;	// disable crc check if not present in the packet
+            rdd = (header[1] >> 1) & 0x7;				// header contains error correction info
+            if (rdd > 4) return DECODE_HEADER_ERROR;
+            _rdd = rdd;
+            _crcPresent = (header[1] & 1) != 0;
+
+            packetLength = header[0];
+            dataLength = packetLength + ((header[1] & 1)?5:3);  // include  header and crc
+
+            cOfs = N_HEADER_CODEWORDS;
+            dOfs = 6;
+        }else{
+            packetLength = this->dataLength;
+            if (crcc){
+                dataLength = packetLength + 2;
+            }else{
+                dataLength = packetLength;
+            }
+        }
+
+        //deinterleave / dewhiten the payload blocks with the packet's coding rate
+        const size_t numPayloadSymbols = roundUp(numSyms - N_HEADER_SYMBOLS, 4 + rdd);
+        const size_t numCodewords = PPM + (numPayloadSymbols / (4 + rdd))*PPM;
+        if (numPayloadSymbols != 0) {
+            _symbols.resize(N_HEADER_SYMBOLS + numPayloadSymbols, 0);
+            codewords.resize(numCodewords + 1, 0);
+            diagonalDeterleaveSx(_symbols.data() + N_HEADER_SYMBOLS, numPayloadSymbols, codewords.data() + PPM, PPM, rdd);
+            if (explicitHeader) {
+                Sx1272ComputeWhiteningLfsr(codewords.data() + PPM, numCodewords - PPM, PPM-N_HEADER_CODEWORDS, rdd);
+            }
+            else {
+                Sx1272ComputeWhiteningLfsr(codewords.data() + PPM, numCodewords - PPM, PPM, rdd);
+            }
+        }
+
+        std::vector<uint8_t> &bytes = _bytes;
+        const size_t numBytes = (numCodewords+1) / 2;
+        bytes.assign(numBytes + 1, 0); //spare for the nibbles that follow the header
+        if (explicitHeader) std::memcpy(bytes.data(), header, sizeof(header));
+
+        if (dataLength > numBytes) return DECODE_LENGTH_ERROR;
+
+        for (; cOfs < PPM; cOfs++, dOfs++) {
+            if (dOfs & 1)
+                bytes[dOfs >> 1] |= decodeHamming84sx(codewords[cOfs], error, bad) << 4;
+            else
+                bytes[dOfs >> 1] = decodeHamming84sx(codewords[cOfs], error, bad) & 0xf;
+        }
+
+        if (dOfs & 1) {
+            if (rdd == 0){
+                bytes[dOfs>>1] |= codewords[cOfs++] << 4;
+            }
+            else if (rdd == 1){
+                bytes[dOfs >> 1] |= checkParity54(codewords[cOfs++], error) << 4;
+            }
+            else if (rdd == 2) {
+                bytes[dOfs >> 1] |= checkParity64(codewords[cOfs++], error) << 4;
+            }
+            else if (rdd == 3){
+                bytes[dOfs >> 1] |= decodeHamming74sx(codewords[cOfs++], error) << 4;
+            }
+            else if (rdd == 4){
+                bytes[dOfs >> 1] |= decodeHamming84sx(codewords[cOfs++], error, bad) << 4;
+            }
+            dOfs++;
+        }
+        dOfs >>= 1;
+
+        if (error && errorCheck) return DECODE_FEC_ERROR;
+
+        //the payload must fit in the deinterleaved codewords
+        if (dataLength > dOfs and cOfs + 2*(dataLength - dOfs) > numCodewords) return DECODE_LENGTH_ERROR;
+
+        //decode each codeword as 2 bytes with correction
+        if (rdd == 0) for (size_t i = dOfs; i < dataLength; i++) {
+            bytes[i] = codewords[cOfs++] & 0xf;
+            bytes[i] |= codewords[cOfs++] << 4;
+        }else if (rdd == 1) for (size_t i = dOfs; i < dataLength; i++) {
+            bytes[i] = checkParity54(codewords[cOfs++],error);
+            bytes[i] |= checkParity54(codewords[cOfs++], error) << 4;
+        }else if (rdd == 2) for (size_t i = dOfs; i < dataLength; i++) {
+            bytes[i] = checkParity64(codewords[cOfs++], error);
+            bytes[i] |= checkParity64(codewords[cOfs++],error) << 4;
+        }else if (rdd == 3) for (size_t i = dOfs; i < dataLength; i++){
+            bytes[i] = decodeHamming74sx(codewords[cOfs++], error) & 0xf;
+            bytes[i] |= decodeHamming74sx(codewords[cOfs++], error) << 4;
+        }else if (rdd == 4) for (size_t i = dOfs; i < dataLength; i++){
+            bytes[i] = decodeHamming84sx(codewords[cOfs++], error, bad) & 0xf;
+            bytes[i] |= decodeHamming84sx(codewords[cOfs++], error, bad) << 4;
+        }
+
+        if (error && errorCheck) return DECODE_FEC_ERROR;
+
+        dOfs = 0;
+
+        if (explicitHeader) {
+            if (bytes[1] & 1) {							// always compute crc if present
+                uint16_t crc = sx1272DataChecksum(bytes.data() + 3, packetLength);
+                uint16_t packetCrc = bytes[3 + packetLength] | (bytes[4 + packetLength] << 8);
+                if (crc != packetCrc && checkCrc) return DECODE_CRC_ERROR;
+                bytes[3 + packetLength] ^= crc;
+                bytes[4 + packetLength] ^= (crc >> 8);
+            }
+            if (!hdr){
+                dOfs = 3;
+                dataLength -= 5;
+            }
+        }
+        else {
+            if (checkCrc) {
+                uint16_t crc = sx1272DataChecksum(bytes.data(), this->dataLength);
+                uint16_t packetCrc = bytes[this->dataLength] | (bytes[this->dataLength + 1] << 8);
+                if (crc != packetCrc) return DECODE_CRC_ERROR;
+                bytes[this->dataLength + 0] ^= crc;
+                bytes[this->dataLength + 1] ^= (crc >> 8);
+            }
+        }
+
+        _offset = dOfs;
+        _length = dataLength;
+        return DECODE_OK;
+    }
+
+    /*!
+     * Decode a packet of symbols, retrying with runner-up bins on failure.
+     * The least reliable symbols are substituted with their runner-up bins
+     * in every combination, in order, for at most the configured retries.
+     * A retry is only accepted when the packet crc matches,
+     * so packets without a crc are never retried.
+     * \param syms pointer to the demodulated symbols
+     * \param numSyms the number of symbols
+     * \param alternates the runner-up bin of each symbol
+     * \param margins the reliability of each symbol, lower is less reliable
+     * \return the decode status
+     */
+    Status decode(const uint16_t *syms, const size_t numSyms, const uint16_t *alternates, const float *margins)
+    {
+        _attempts = 0;
+        const auto status = this->decode(syms, numSyms);
+        if (retries == 0 or alternates == nullptr or margins == nullptr) return status;
+        if (status == DECODE_OK or status == DECODE_SHORT or status == DECODE_SYMBOLS) return status;
+        if (not explicitHeader and not crcc) return status;
+
+        //the least reliable symbols, enough to enumerate the retries
+        size_t K = 0;
+        while (K < numSyms and K < 16 and ((size_t(1) << K) - 1) < retries) K++;
+        std::vector<size_t> order(numSyms);
+        std::iota(order.begin(), order.end(), 0);
+        std::partial_sort(order.begin(), order.begin() + K, order.end(),
+            [margins](const size_t a, const size_t b){return margins[a] < margins[b];});
+
+        //the crc decides, regardless of the configured crc check
+        const bool crcCheck = crcc;
+        crcc = true;
+        auto result = status;
+        std::vector<uint16_t> trial(syms, syms + numSyms);
+        for (size_t pattern = 1; pattern < (size_t(1) << K) and _attempts < retries; pattern++)
+        {
+            for (size_t k = 0; k < K; k++)
+            {
+                const size_t i = order[k];
+                trial[i] = ((pattern >> k) & 1) ? alternates[i] : syms[i];
+            }
+            _attempts++;
+            if (this->decode(trial.data(), numSyms) == DECODE_OK and _crcPresent)
+            {
+                result = DECODE_OK;
+                break;
+            }
+        }
+        crcc = crcCheck;
+        return result;
+    }
+
+    /*!
+     * Decode only the explicit header from the first block of symbols.
+     * This can run as soon as the header block is demodulated,
+     * to learn the length and coding rate before the packet ends.
+     * \param syms pointer to the demodulated symbols
+     * \param numSyms the number of symbols, at least a header block
+     * \return DECODE_OK when the header is correctable and passes its checksum
+     */
+    Status decodeHeader(const uint16_t *syms, const size_t numSyms)
+    {
+        if (numSyms < N_HEADER_SYMBOLS) return DECODE_SHORT;
+        this->demapSymbols(syms, N_HEADER_SYMBOLS, N_HEADER_SYMBOLS);
+        this->deinterleaveHeader();
+
+        bool error = false;
+        bool bad = false;
+        uint8_t header[3];
+        this->decodeHeaderFields(header, error, bad);
+        const size_t rdd = (header[1] >> 1) & 0x7;
+        if (bad or header[2] != 0 or rdd > 4) return DECODE_HEADER_ERROR;
+
+        _rdd = rdd;
+        _crcPresent = (header[1] & 1) != 0;
+        _offset = 0;
+        _length = header[0];
+        return DECODE_OK;
+    }
+
+    /*!
+     * The total number of symbols in the last packet after the header decode,
+     * including the header block, as the encoder would have produced it.
+     */
+    size_t packetSymbols(void) const
+    {
+        const size_t PPM = this->symbolSize();
+        const size_t payloadLength = _length + (_crcPresent ? 2 : 0);
+        const size_t numCodewords = std::max<size_t>(PPM, roundUp(payloadLength * 2 + N_HEADER_CODEWORDS, PPM));
+        return N_HEADER_SYMBOLS + (numCodewords / PPM - 1) * (4 + _rdd);
+    }
+
+    //! The decoded bytes after DECODE_OK
+    const uint8_t *payload(void) const
+    {
+        return _bytes.data() + _offset;
+    }
+
+    //! The number of decoded bytes after DECODE_OK, or the payload length after decodeHeader()
+    size_t length(void) const
+    {
+        return _length;
+    }
+
+    //! The gray coded symbols after DECODE_SYMBOLS
+    const std::vector<uint16_t> &symbols(void) const
+    {
+        return _symbols;
+    }
+
+    //! The coding rate (RDD) of the last packet, from the header when explicit
+    size_t codingRate(void) const
+    {
+        return _rdd;
+    }
+
+    //! The number of retries used by the last decode with alternates
+    size_t attempts(void) const
+    {
+        return _attempts;
+    }
+
+    //! Was a crc present in the last packet?
+    bool crcPresent(void) const
+    {
+        return _crcPresent;
+    }
+
+    //configuration
+    size_t sf;
+    size_t ppm;
+    size_t rdd;
+    bool crcc;
+    bool interleaving;
+    bool errorCheck;
+    bool explicitHeader;
+    bool hdr;
+    size_t dataLength;
+    size_t retries; //!< maximum decode retries with alternates
+
+private:
+    //! Gray encode the symbols, when SF > PPM, depad the LSBs with rounding
+    void demapSymbols(const uint16_t *syms, const size_t numSyms, const size_t padLength)
+    {
+        const size_t PPM = this->symbolSize();
+        _symbols.assign(padLength, 0);
+        std::memcpy(_symbols.data(), syms, numSyms*sizeof(uint16_t));
+        for (auto &sym : _symbols){
+            sym += (1 << (sf - PPM)) / 2; //increment by 1/2
+            sym >>= (sf - PPM); //down shift to PPM bits
+            sym = binaryToGray16(sym);
+        }
+    }
+
+    //! Deinterleave / dewhiten the header block, which is always coded with 8 bits
+    void deinterleaveHeader(void)
+    {
+        const size_t PPM = this->symbolSize();
+        _codewords.assign(PPM + 1, 0); //spare for the odd nibble that follows the header block
+        diagonalDeterleaveSx(_symbols.data(), N_HEADER_SYMBOLS, _codewords.data(), PPM, HEADER_RDD);
+        if (explicitHeader) {
+            Sx1272ComputeWhiteningLfsr(_codewords.data() + N_HEADER_CODEWORDS, PPM - N_HEADER_CODEWORDS, 0, HEADER_RDD);
+        }
+        else {
+            Sx1272ComputeWhiteningLfsr(_codewords.data(), PPM, 0, HEADER_RDD);
+        }
+    }
+
+    //! Decode the explicit header fields, the checksum byte is zero when valid
+    void decodeHeaderFields(uint8_t *header, bool &error, bool &bad) const
+    {
+        const std::vector<uint8_t> &codewords = _codewords;
+        header[0] = decodeHamming84sx(codewords[1], error, bad) & 0xf;
+        header[0] |= decodeHamming84sx(codewords[0], error, bad) << 4;	// length
+
+        header[1] = decodeHamming84sx(codewords[2], error, bad) & 0xf;	// coding rate and crc enable
+
+        header[2] = decodeHamming84sx(codewords[4], error, bad) & 0xf;
+        header[2] |= decodeHamming84sx(codewords[3], error, bad) << 4;	// checksum
+
+        header[2] ^= headerChecksum(header);
+    }
+
+    //scratch buffers reused across packets
+    std::vector<uint16_t> _symbols;
+    std::vector<uint8_t> _codewords;
+    std::vector<uint8_t> _bytes;
+
+    //results
+    size_t _rdd;
+    bool _crcPresent;
+    size_t _offset;
+    size_t _length;
+    size_t _attempts;
+};
@@ -0,0 +1,149 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// Copyright (c) 2016-2016 Arne Hennig
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include "LoRaCodes.hpp"
+
+/*!
+ * Encode bytes into LoRa modulation symbols.
+ * The encoder scrambles, adds error correction, interleaves,
+ * and gray decodes to handle measurement error.
+ * This is the encoding used by the LoRa Encoder and LoRa TX blocks.
+ */
+class LoRaPacketEncoder
+{
+public:
+    LoRaPacketEncoder(void):
+        sf(10),
+        ppm(0),
+        rdd(4),
+        explicitHeader(true),
+        crc(true),
+        whitening(true)
+    {
+        return;
+    }
+
+    //! The symbol set size (PPM <= SF)
+    size_t symbolSize(void) const
+    {
+        return (ppm == 0) ? sf : ppm;
+    }
+
+    /*!
+     * Encode a payload into symbols.
+     * The caller must ensure that symbolSize() <= sf.
+     * \param payload pointer to the payload bytes
+     * \param length the number of payload bytes
+     * \param [out] symbols the encoded symbols (resized to fit)
+     */
+    void encode(const uint8_t *payload, const size_t length, std::vector<uint16_t> &symbols)
+    {
+        const size_t PPM = this->symbolSize();
+        size_t payloadLength = length + (crc ? 2 : 0);
+        const size_t numCodewords = std::max<size_t>(PPM, roundUp(payloadLength * 2 + (explicitHeader ? N_HEADER_CODEWORDS:0), PPM));
+
+        //zero pad the bytes to cover every codeword nibble
+        _bytes.assign((numCodewords + 1) / 2, 0);
+        std::memcpy(_bytes.data(), payload, length);
+
+        const size_t numSymbols = N_HEADER_SYMBOLS + (numCodewords / PPM - 1) * (4 + rdd);		// header is always coded with 8 bits
+
+        size_t cOfs = 0;
+        size_t dOfs = 0;
+        _codewords.assign(numCodewords, 0);
+
+        if (crc) {
+            uint16_t checksum = sx1272DataChecksum(_bytes.data(), length);
+            _bytes[length] = checksum & 0xff;
+            _bytes[length+1] = (checksum >> 8) & 0xff;
+        }
+
+        if (explicitHeader) {
+            uint8_t hdr[3];
+            uint8_t len = length;
+            hdr[0] = len;
+            hdr[1] = (crc ? 1 : 0) | (rdd << 1);
+            hdr[2] = headerChecksum(hdr);
+
+            _codewords[cOfs++] = encodeHamming84sx(hdr[0] >> 4);
+            _codewords[cOfs++] = encodeHamming84sx(hdr[0] & 0xf);	// length
+            _codewords[cOfs++] = encodeHamming84sx(hdr[1] & 0xf);	// crc / fec info
+            _codewords[cOfs++] = encodeHamming84sx(hdr[2] >> 4);		// checksum
+            _codewords[cOfs++] = encodeHamming84sx(hdr[2] & 0xf);
+        }
+        size_t cOfs1 = cOfs;
+        encodeFec(_codewords, 4, cOfs, dOfs, _bytes.data(), PPM - cOfs);
+        if (whitening) {
+            Sx1272ComputeWhitening(_codewords.data() + cOfs1, PPM - cOfs1, 0, HEADER_RDD);
+        }
+
+        if (numCodewords > PPM) {
+            size_t cOfs2 = cOfs;
+            encodeFec(_codewords, rdd, cOfs, dOfs, _bytes.data(), numCodewords-PPM);
+            if (whitening) {
+                Sx1272ComputeWhitening(_codewords.data() + cOfs2, numCodewords - PPM, PPM - cOfs1, rdd);
+            }
+        }
+
+        //interleave the codewords into symbols
+        symbols.assign(numSymbols, 0);
+        diagonalInterleaveSx(_codewords.data(), PPM, symbols.data(), PPM, HEADER_RDD);
+        if (numCodewords > PPM) {
+            diagonalInterleaveSx(_codewords.data() + PPM, numCodewords-PPM, symbols.data()+N_HEADER_SYMBOLS, PPM, rdd);
+        }
+
+        //gray decode, when SF > PPM, pad out LSBs
+        for (auto &sym : symbols){
+            sym = grayToBinary16(sym);
+            sym <<= (sf - PPM);
+        }
+    }
+
+    //configuration
+    size_t sf;
+    size_t ppm;
+    size_t rdd;
+    bool explicitHeader;
+    bool crc;
+    bool whitening;
+
+private:
+    static void encodeFec(std::vector<uint8_t> &codewords, const size_t RDD, size_t &cOfs, size_t &dOfs, const uint8_t *bytes, const size_t count) {
+        if (RDD == 0) for (size_t i = 0; i < count; i++, dOfs++) {
+            if (dOfs & 1)
+                codewords[cOfs++] = bytes[dOfs >> 1] >> 4;
+            else
+                codewords[cOfs++] = bytes[dOfs >> 1] & 0xf;
+        } else if (RDD == 1) for (size_t i = 0; i < count; i++, dOfs++) {
+            if (dOfs & 1)
+                codewords[cOfs++] = encodeParity54(bytes[dOfs >> 1] >> 4);
+            else
+                codewords[cOfs++] = encodeParity54(bytes[dOfs >> 1] & 0xf);
+        } else if (RDD == 2) for (size_t i = 0; i < count; i++, dOfs++) {
+            if (dOfs & 1)
+                codewords[cOfs++] = encodeParity64(bytes[dOfs >> 1] >> 4);
+            else
+                codewords[cOfs++] = encodeParity64(bytes[dOfs >> 1] & 0xf);
+        } else if (RDD == 3) for (size_t i = 0; i < count; i++, dOfs++) {
+            if (dOfs & 1)
+                codewords[cOfs++] = encodeHamming74sx(bytes[dOfs >> 1] >> 4);
+            else
+                codewords[cOfs++] = encodeHamming74sx(bytes[dOfs >> 1] & 0xf);
+        } else if (RDD == 4) for (size_t i = 0; i < count; i++, dOfs++) {
+            if (dOfs & 1)
+                codewords[cOfs++] = encodeHamming84sx(bytes[dOfs >> 1] >> 4);
+            else
+                codewords[cOfs++] = encodeHamming84sx(bytes[dOfs >> 1] & 0xf);
+        }
+    }
+
+    //scratch buffers reused across packets
+    std::vector<uint8_t> _bytes;
+    std::vector<uint8_t> _codewords;
+};
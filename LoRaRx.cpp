@@ -0,0 +1,395 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Framework.hpp>
+#include "LoRaDemodulator.hpp"
+#include "LoRaPacketDecoder.hpp"
+#include "LoRaMetadata.hpp"
+#include <iostream>
+#include <complex>
+#include <cstring>
+#include <algorithm>
+
+/***********************************************************************
+ * |PothosDoc LoRa RX
+ *
+ * Demodulate and decode LoRa packets from a complex sample stream into bytes.
+ * This block combines the LoRa Demod and LoRa Decoder into a single block:
+ * completed symbol arrays are handed from the demodulator to the decoder
+ * in-thread, without an intermediate symbol packet or message queue hop.
+ *
+ * <h2>Input format</h2>
+ *
+ * The input port 0 accepts a complex sample stream of modulated chirps
+ * received at the specified bandwidth and carrier frequency.
+ *
+ * <h2>Output format</h2>
+ *
+ * A packet message with a payload containing bytes received.
+ * The packet metadata contains the following fields:
+ * <ul>
+ * <li>snr - the detector SNR in dB measured at sync</li>
+ * <li>power - the detector power in dB measured at sync</li>
+ * <li>freqError - the coarse frequency error in bins measured at sync</li>
+ * <li>fineFreqError - the tracked frequency error in bins at the end of the packet</li>
+ * <li>drift - the tracked sampling clock drift in ppm</li>
+ * <li>symbols - the number of demodulated symbols</li>
+ * <li>sf - the spread factor</li>
+ * <li>cr - the coding rate as a string such as "4/8"</li>
+ * <li>crc - true when the packet contained a crc</li>
+ * <li>retries - the number of decode retries used to recover the packet</li>
+ * </ul>
+ *
+ * <h2>Frame events</h2>
+ *
+ * The frameDetected and headerDecoded signals are emitted as the frame
+ * is received, with the same dictionaries as the LoRa Demod block.
+ * The headerDecoded signal requires explicit header mode.
+ *
+ * <h2>Statistics</h2>
+ *
+ * The getStats() call returns the same demodulator counters as the LoRa Demod block.
+ * The counters are cleared on activation.
+ *
+ * |category /LoRa
+ * |keywords lora
+ *
+ * |param sf[Spread factor] The spreading factor controls the symbol spread.
+ * Each symbol will occupy 2^SF number of samples given the waveform BW.
+ * |default 10
+ *
+ * |param sync[Sync word] The sync word is a 2-nibble, 2-symbol sync value.
+ * The sync word is encoded after the up-chirps and before the down-chirps.
+ * The demodulator ignores packets that do not match the sync word.
+ * |default 0x12
+ *
+ * |param thresh[Threshold] The minimum required level in dB for the detector.
+ * The threshold level is used to enter and exit the demodulation state machine.
+ * With a false alarm rate, the threshold is the lower bound of the adaptive threshold.
+ * |units dB
+ * |default -30.0
+ *
+ * |param far[False alarm rate] Adapt the threshold to the measured noise floor.
+ * The detector SNR of idle symbols is tracked, and the threshold is raised
+ * to the level that noise exceeds with approximately this probability per symbol.
+ * The special value of zero uses the fixed threshold only.
+ * |default 0.0
+ * |option [Fixed] 0.0
+ * |option [1e-3] 1e-3
+ * |option [1e-4] 1e-4
+ * |widget ComboBox(editable=true)
+ * |preview valid
+ *
+ * |param mtu[Symbol MTU] Demodulate MTU at most symbols after sync is found.
+ * |units symbols
+ * |default 256
+ *
+ * |param ppm[Symbol size] The size of the symbol set (_ppm &lt;= SF).
+ * Specify _ppm less than the spread factor to use a reduced symbol set.
+ * The special value of zero uses the full symbol set (PPM == SF).
+ * |default 0
+ * |option [Full set] 0
+ * |widget ComboBox(editable=true)
+ * |preview valid
+ *
+ * |param tracking Enable/disable tracking of the frequency and timing drift over the data symbols.
+ * |option [On] true
+ * |option [Off] false
+ * |default true
+ *
+ * |param incremental Enable/disable incremental processing of the data symbols.
+ * The data symbols are dechirped and the first transform stage runs
+ * as the input arrives, instead of once the symbol completes.
+ * This spreads the processing over the symbol and shortens the latency
+ * from the last sample of a symbol to its decision.
+ * |option [On] true
+ * |option [Off] false
+ * |default false
+ *
+ * |param cr[Coding Rate] The number of error correction bits.
+ * |option [4/4] "4/4"
+ * |option [4/5] "4/5"
+ * |option [4/6] "4/6"
+ * |option [4/7] "4/7"
+ * |option [4/8] "4/8"
+ * |default "4/8"
+ *
+ * |param explicit Enable/disable explicit header mode.
+ * |option [On] true
+ * |option [Off] false
+ * |default true
+ *
+ * |param hdr[Header Output] Enable/disable header output.
+ * |option [On] true
+ * |option [Off] false
+ * |default false
+ *
+ * |param dataLength implicit data length.
+ * |default 8
+ *
+ * |param crcc Enable/disable crc check of the decoded message.
+ * |option [On] true
+ * |option [Off] false
+ * |default false
+ *
+ * |param errorCheck Enable/disable error checking.
+ * |option [On] true
+ * |option [Off] false
+ * |default true
+ *
+ * |param retries[Retries] The maximum number of decode retries for a failed packet.
+ * Each retry substitutes a combination of the least reliable symbols
+ * with their runner-up bins, and is accepted only when the packet crc matches.
+ * |default 0
+ *
+ * |factory /lora/lora_rx(sf)
+ * |setter setSync(sync)
+ * |setter setThreshold(thresh)
+ * |setter setFalseAlarmRate(far)
+ * |setter setMTU(mtu)
+ * |setter setSymbolSize(ppm)
+ * |setter enableTracking(tracking)
+ * |setter enableIncremental(incremental)
+ * |setter setCodingRate(cr)
+ * |setter enableExplicit(explicit)
+ * |setter enableHdr(hdr)
+ * |setter setDataLength(dataLength)
+ * |setter enableCrcc(crcc)
+ * |setter enableErrorCheck(errorCheck)
+ * |setter setRetries(retries)
+ **********************************************************************/
+class LoRaRx : public Pothos::Block
+{
+public:
+    LoRaRx(const size_t sf):
+        _demod(sf),
+        _dropped(0)
+    {
+        _decoder.sf = sf;
+        _decoder.errorCheck = true;
+        _demod.enableLabels(false);
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaRx, setSync));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaRx, setThreshold));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaRx, setFalseAlarmRate));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaRx, setMTU));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaRx, setSymbolSize));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaRx, enableTracking));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaRx, enableIncremental));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaRx, setCodingRate));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaRx, enableExplicit));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaRx, enableHdr));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaRx, setDataLength));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaRx, enableCrcc));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaRx, enableErrorCheck));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaRx, setRetries));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaRx, getDropped));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaRx, getStats));
+        this->setupInput(0, typeid(std::complex<float>));
+        this->setupOutput(0);
+
+        this->registerSignal("dropped");
+        this->registerSignal("error");
+        this->registerSignal("power");
+        this->registerSignal("snr");
+        this->registerSignal("frameDetected");
+        this->registerSignal("headerDecoded");
+
+        //use at most two input symbols available
+        this->input(0)->setReserve(_demod.reserve());
+    }
+
+    static Block *make(const size_t sf)
+    {
+        return new LoRaRx(sf);
+    }
+
+    void setSync(const unsigned char sync)
+    {
+        _demod.setSync(sync);
+    }
+
+    void setThreshold(const double thresh_dB)
+    {
+        _demod.setThreshold(thresh_dB);
+    }
+
+    void setFalseAlarmRate(const double pfa)
+    {
+        _demod.setFalseAlarmRate(pfa);
+    }
+
+    void setMTU(const size_t mtu)
+    {
+        _demod.setMTU(mtu);
+    }
+
+    void setSymbolSize(const size_t ppm)
+    {
+        _decoder.ppm = ppm;
+    }
+
+    void enableTracking(const bool tracking)
+    {
+        _demod.enableTracking(tracking);
+    }
+
+    void enableIncremental(const bool incremental)
+    {
+        _demod.enableIncremental(incremental);
+    }
+
+    void setCodingRate(const std::string &cr)
+    {
+        if (not parseCodingRate(cr, _decoder.rdd)) throw Pothos::InvalidArgumentException("LoRaRx::setCodingRate("+cr+")", "unknown coding rate");
+    }
+
+    void enableExplicit(const bool __explicit)
+    {
+        _decoder.explicitHeader = __explicit;
+    }
+
+    void enableHdr(const bool hdr)
+    {
+        _decoder.hdr = hdr;
+    }
+
+    void setDataLength(const size_t dataLength)
+    {
+        _decoder.dataLength = dataLength;
+    }
+
+    void enableCrcc(const bool crcc)
+    {
+        _decoder.crcc = crcc;
+    }
+
+    void enableErrorCheck(const bool errorCheck)
+    {
+        _decoder.errorCheck = errorCheck;
+    }
+
+    void setRetries(const size_t retries)
+    {
+        _decoder.retries = retries;
+        _demod.enableAlternates(retries != 0);
+    }
+
+    unsigned long long getDropped(void) const
+    {
+        return _dropped;
+    }
+
+    Pothos::ObjectKwargs getStats(void) const
+    {
+        return getDemodStats(_demod.stats(), _demod.threshold(), _demod.noiseFloor());
+    }
+
+    void activate(void)
+    {
+        _demod.reset();
+        _demod.resetStats();
+        _dropped = 0;
+        this->emitSignal("dropped", _dropped);
+    }
+
+    void work(void)
+    {
+        auto inPort = this->input(0);
+        const size_t available = inPort->elements();
+        if (_decoder.symbolSize() > _decoder.sf) throw Pothos::Exception("LoRaRx::work()", "failed check: PPM <= SF");
+
+        //step through every symbol that the input buffer holds
+        auto inBuff = inPort->buffer().as<const std::complex<float> *>();
+        size_t consumed = 0;
+        while (consumed + _demod.required() <= available)
+        {
+            consumed += _demod.step(inBuff + consumed);
+            const auto index = inPort->totalElements() + consumed;
+
+            if (_demod.syncFound())
+            {
+                this->emitSignal("error", _demod.freqError());
+                this->emitSignal("power", _demod.power());
+                this->emitSignal("snr", _demod.snr());
+
+                Pothos::ObjectKwargs event;
+                event["index"] = Pothos::Object(index + _demod.dataSymbolsDelay());
+                event["sf"] = Pothos::Object(_decoder.sf);
+                event["cfo"] = Pothos::Object(_demod.freqError());
+                event["snr"] = Pothos::Object(_demod.snr());
+                event["power"] = Pothos::Object(_demod.power());
+                this->emitSignal("frameDetected", event);
+            }
+
+            if (_demod.headerReady() and _decoder.explicitHeader and
+                _decoder.decodeHeader(_demod.symbols(), _demod.numSymbols()) == LoRaPacketDecoder::DECODE_OK)
+            {
+                Pothos::ObjectKwargs event;
+                event["index"] = Pothos::Object(index);
+                event["endIndex"] = Pothos::Object(index + (_decoder.packetSymbols() - N_HEADER_SYMBOLS)*_demod.N);
+                event["length"] = Pothos::Object(_decoder.length());
+                event["cr"] = Pothos::Object(codingRateString(_decoder.codingRate()));
+                event["crc"] = Pothos::Object(_decoder.crcPresent());
+                this->emitSignal("headerDecoded", event);
+            }
+
+            if (_demod.packetReady()) this->decodePacket();
+        }
+        inPort->consume(consumed);
+
+        //process a partial data symbol and wait for more input
+        const size_t fed = _demod.feed(inBuff + consumed, available - consumed);
+        if (fed == 0) inPort->setReserve(_demod.required());
+        else inPort->setReserve(std::min(available - consumed + 1, _demod.required()));
+    }
+
+    //! Custom input buffer manager with slabs large enough for fft input
+    Pothos::BufferManager::Sptr getInputBufferManager(const std::string &name, const std::string &domain)
+    {
+        if (name == "0")
+        {
+            Pothos::BufferManagerArgs args;
+            args.bufferSize = std::max(args.bufferSize,
+                              _demod.reserve()*sizeof(std::complex<float>));
+            return Pothos::BufferManager::make("generic", args);
+        }
+        return Pothos::Block::getInputBufferManager(name, domain);
+    }
+
+private:
+
+    void decodePacket(void)
+    {
+        const auto status = _decoder.decode(_demod.symbols(), _demod.numSymbols(), _demod.alternates(), _demod.margins());
+        if (status == LoRaPacketDecoder::DECODE_SHORT) return;
+        if (status != LoRaPacketDecoder::DECODE_OK) return this->drop();
+
+        Pothos::Packet out;
+        out.payload = Pothos::BufferChunk(typeid(uint8_t), _decoder.length());
+        std::memcpy(out.payload.as<void *>(), _decoder.payload(), out.payload.length);
+        out.metadata["snr"] = Pothos::Object(_demod.snr());
+        out.metadata["power"] = Pothos::Object(_demod.power());
+        out.metadata["freqError"] = Pothos::Object(_demod.freqError());
+        out.metadata["fineFreqError"] = Pothos::Object(_demod.fineFreqError());
+        out.metadata["drift"] = Pothos::Object(_demod.drift()*1e6/_demod.N);
+        out.metadata["symbols"] = Pothos::Object(_demod.numSymbols());
+        out.metadata["sf"] = Pothos::Object(_decoder.sf);
+        out.metadata["cr"] = Pothos::Object(codingRateString(_decoder.codingRate()));
+        out.metadata["crc"] = Pothos::Object(_decoder.crcPresent());
+        out.metadata["retries"] = Pothos::Object(_decoder.attempts());
+        this->output(0)->postMessage(out);
+    }
+
+    void drop(void)
+    {
+        _dropped++;
+        this->emitSignal("dropped", _dropped);
+    }
+
+    LoRaDemodulator _demod;
+    LoRaPacketDecoder _decoder;
+    unsigned long long _dropped;
+};
+
+static Pothos::BlockRegistry registerLoRaRx(
+    "/lora/lora_rx", &LoRaRx::make);
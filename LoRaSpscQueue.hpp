@@ -0,0 +1,73 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+/*!
+ * A bounded lock-free queue between one producer thread and one consumer thread.
+ * The slots are a power of 2 ring, and the head and tail counters
+ * sit on their own cache lines so that the two sides do not share a line.
+ */
+template <typename T>
+class LoRaSpscQueue
+{
+public:
+    //! Create a queue with room for at least the capacity
+    LoRaSpscQueue(const size_t capacity):
+        _head(0),
+        _tail(0)
+    {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        _slots.resize(size);
+        _mask = size - 1;
+    }
+
+    //! The maximum number of elements in the queue
+    size_t capacity(void) const
+    {
+        return _slots.size();
+    }
+
+    //! Producer: add an element, false when the queue is full
+    bool push(T &&value)
+    {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) == _slots.size()) return false;
+        _slots[tail & _mask] = std::move(value);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! Consumer: remove the oldest element, false when the queue is empty
+    bool pop(T &value)
+    {
+        const size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) return false;
+        value = std::move(_slots[head & _mask]);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! True when there is nothing to pop, from either side
+    bool empty(void) const
+    {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+    }
+
+    //! The number of elements in the queue, from either side
+    size_t size(void) const
+    {
+        return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+    }
+
+private:
+    alignas(64) std::atomic<size_t> _head;
+    alignas(64) std::atomic<size_t> _tail;
+    alignas(64) std::vector<T> _slots;
+    size_t _mask;
+};
@@ -0,0 +1,230 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include "LoRaPacketDecoder.hpp"
+#include <vector>
+#include <cstdint>
+
+/*!
+ * Delimit packets in a continuous stream of data symbols.
+ * In the streaming mode the encoded packets follow each other
+ * after a single preamble, and the explicit header of each packet
+ * gives the number of symbols up to the next header.
+ * The transmitter fills the gaps between packets with idle blocks,
+ * empty packets of a single header block, which are skipped here.
+ * When a header fails its checksum, the framer slips one symbol
+ * at a time to hunt for the next valid header.
+ *
+ * The 5-bit header checksum passes one random header in 32,
+ * and a false header swallows the packets that follow it.
+ * So the symbols of a packet are kept until the header after it decodes,
+ * and its crc, when present, is checked as it completes:
+ * when either fails, the packet is still output for the decoder,
+ * but the hunt starts again from the symbol after its header
+ * rather than after the symbols that the header claimed.
+ * While hunting, a header is only accepted once the header
+ * at the end of its packet also decodes.
+ */
+class LoRaStreamFramer
+{
+public:
+    LoRaStreamFramer(void):
+        _idleBlocks(0),
+        _slips(0),
+        _huntSymbols(0)
+    {
+        _header.crcc = true;
+        this->reset();
+    }
+
+    //! The spread factor and symbol set size (PPM <= SF) used to read the headers
+    void setSpreadFactor(const size_t sf)
+    {
+        _header.sf = sf;
+    }
+
+    void setSymbolSize(const size_t ppm)
+    {
+        _header.ppm = ppm;
+    }
+
+    //! Forget the symbols of the stream in progress
+    void reset(void)
+    {
+        _symbols.clear();
+        _alternates.clear();
+        _margins.clear();
+        _packetSymbols = 0;
+        _prevSymbols = 0;
+        _ready = false;
+        _idle = false;
+        _suspect = false;
+        _hunting = false;
+        _huntSymbols = 0;
+    }
+
+    /*!
+     * Append the next data symbol of the stream.
+     * The packet from the previous push(), if any, is discarded.
+     * \param sym the demodulated symbol
+     * \param alt the runner-up bin of the symbol
+     * \param margin the peak over runner-up power in dB
+     */
+    void push(const uint16_t sym, const uint16_t alt = 0, const float margin = 0.0f)
+    {
+        if (_ready and _suspect) this->slip();
+        else if (_ready) this->release();
+        _ready = false;
+        _symbols.push_back(sym);
+        _alternates.push_back(alt);
+        _margins.push_back(margin);
+        this->frame();
+    }
+
+    //! True when the last push() completed a packet
+    bool packetReady(void) const
+    {
+        return _ready;
+    }
+
+    //! The symbols of the completed packet, including the header block
+    const uint16_t *symbols(void) const
+    {
+        return _symbols.data();
+    }
+
+    const uint16_t *alternates(void) const
+    {
+        return _alternates.data();
+    }
+
+    const float *margins(void) const
+    {
+        return _margins.data();
+    }
+
+    //! The number of symbols in the completed packet
+    size_t numSymbols(void) const
+    {
+        return _ready ? _packetSymbols : 0;
+    }
+
+    //! The number of idle blocks skipped so far
+    unsigned long long idleBlocks(void) const
+    {
+        return _idleBlocks;
+    }
+
+    //! The number of symbols slipped so far while hunting for a header
+    unsigned long long slips(void) const
+    {
+        return _slips;
+    }
+
+    //! The number of symbols slipped since the last accepted header
+    size_t huntSymbols(void) const
+    {
+        return _huntSymbols;
+    }
+
+private:
+    void frame(void)
+    {
+        while (true)
+        {
+            //parse the next header, after the previous packet, once its block is available
+            if (_packetSymbols == 0)
+            {
+                if (_symbols.size() < _prevSymbols + N_HEADER_SYMBOLS) return;
+                size_t packetSymbols = 0;
+                bool idle = false;
+                if (not this->readHeader(_prevSymbols, packetSymbols, idle))
+                {
+                    this->slip();
+                    continue;
+                }
+
+                //a header found by the hunt must be followed by another
+                if (_hunting)
+                {
+                    if (_symbols.size() < packetSymbols + N_HEADER_SYMBOLS) return;
+                    size_t nextSymbols = 0;
+                    bool nextIdle = false;
+                    if (not this->readHeader(packetSymbols, nextSymbols, nextIdle))
+                    {
+                        this->slip();
+                        continue;
+                    }
+                    _hunting = false;
+                }
+
+                //the header confirms the previous packet, whose symbols can go
+                this->pop(_prevSymbols);
+                _prevSymbols = 0;
+                _packetSymbols = packetSymbols;
+                _idle = idle;
+                _huntSymbols = 0;
+            }
+
+            if (_symbols.size() < _packetSymbols) return;
+            if (not _idle)
+            {
+                _ready = true;
+                _suspect = (_header.decode(_symbols.data(), _packetSymbols) != LoRaPacketDecoder::DECODE_OK);
+                return;
+            }
+            this->release();
+            _idleBlocks++;
+        }
+    }
+
+    //! Decode the header at the given offset, return false when it fails its checksum
+    bool readHeader(const size_t offset, size_t &packetSymbols, bool &idle)
+    {
+        if (_header.decodeHeader(_symbols.data() + offset, _symbols.size() - offset) != LoRaPacketDecoder::DECODE_OK) return false;
+        packetSymbols = _header.packetSymbols();
+        idle = (_header.length() == 0);
+        return true;
+    }
+
+    //! Keep the symbols of the completed block until the header after it decodes
+    void release(void)
+    {
+        _prevSymbols = _packetSymbols;
+        _packetSymbols = 0;
+    }
+
+    //! Hunt from the symbol after the first header in the buffer
+    void slip(void)
+    {
+        this->pop(1);
+        _packetSymbols = 0;
+        _prevSymbols = 0;
+        _hunting = true;
+        _huntSymbols++;
+        _slips++;
+    }
+
+    //! Remove symbols from the front of the stream
+    void pop(const size_t num)
+    {
+        _symbols.erase(_symbols.begin(), _symbols.begin() + num);
+        _alternates.erase(_alternates.begin(), _alternates.begin() + num);
+        _margins.erase(_margins.begin(), _margins.begin() + num);
+    }
+
+    LoRaPacketDecoder _header;
+    std::vector<uint16_t> _symbols;
+    std::vector<uint16_t> _alternates;
+    std::vector<float> _margins;
+    size_t _packetSymbols;
+    size_t _prevSymbols;
+    bool _ready;
+    bool _idle;
+    bool _suspect;
+    bool _hunting;
+    unsigned long long _idleBlocks;
+    unsigned long long _slips;
+    size_t _huntSymbols;
+};
@@ -0,0 +1,281 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Framework.hpp>
+#include "LoRaPacketEncoder.hpp"
+#include "LoRaModulator.hpp"
+#include "LoRaMetadata.hpp"
+#include <iostream>
+#include <complex>
+#include <cmath>
+#include <algorithm>
+
+/***********************************************************************
+ * |PothosDoc LoRa TX
+ *
+ * Encode and modulate LoRa packets from bytes into a complex sample stream.
+ * This block combines the LoRa Encoder and LoRa Mod into a single block:
+ * the symbols are handed from the encoder to the modulator in-thread,
+ * without an intermediate symbol packet or message queue hop,
+ * and the burst is rendered directly into the output buffer.
+ *
+ * <h2>Input format</h2>
+ *
+ * A packet message with a payload containing bytes to transmit.
+ * The "sf", "cr", "sync", and "explicit" metadata keys override the
+ * spread factor, coding rate, sync word, and header mode for that packet.
+ *
+ * <h2>Output format</h2>
+ *
+ * The output port 0 produces a complex sample stream of modulated chirps
+ * to be transmitted at the specified bandwidth and carrier frequency.
+ * Each work() call renders as many chirps of the burst as the output
+ * buffer holds, which is the entire burst for short packets.
+ *
+ * |category /LoRa
+ * |keywords lora
+ *
+ * |param sf[Spread factor] The spreading factor controls the symbol spread.
+ * Each symbol will occupy 2^SF number of samples given the waveform BW.
+ * This is the default for packets without "sf" metadata.
+ * |default 10
+ *
+ * |param ppm[Symbol size] The size of the symbol set (_ppm &lt;= SF).
+ * Specify _ppm less than the spread factor to use a reduced symbol set.
+ * The special value of zero uses the full symbol set (PPM == SF).
+ * |default 0
+ * |option [Full set] 0
+ * |widget ComboBox(editable=true)
+ * |preview valid
+ *
+ * |param cr[Coding Rate] The number of error correction bits.
+ * |option [4/4] "4/4"
+ * |option [4/5] "4/5"
+ * |option [4/6] "4/6"
+ * |option [4/7] "4/7"
+ * |option [4/8] "4/8"
+ * |default "4/8"
+ *
+ * |param explicit Enable/disable explicit header mode.
+ * |option [On] true
+ * |option [Off] false
+ * |default true
+ *
+ * |param crc Enable/disable crc.
+ * |option [On] true
+ * |option [Off] false
+ * |default true
+ *
+ * |param whitening Enable/disable whitening of the input message.
+ * |option [On] true
+ * |option [Off] false
+ * |default true
+ *
+ * |param sync[Sync word] The sync word is a 2-nibble, 2-symbol sync value.
+ * The sync word is encoded after the up-chirps and before the down-chirps.
+ * |default 0x12
+ *
+ * |param padding[Padding] Pad out the end of a packet with zeros.
+ * This is mostly useful for simulation purposes, though some padding
+ * may be desirable to flush samples through the radio transmitter.
+ * |units symbols
+ * |default 1
+ *
+ * |param ampl[Amplitude] The digital transmit amplitude.
+ * |default 0.3
+ *
+ * |param ovs[Oversampling ratio] The oversampling ratio (sample rate / bandwidth).
+ * Fractional ratios are supported to match the DAC rate without a resampler.
+ * |default 1
+ *
+ * |param maxSf[Max spread factor] The largest spread factor of the "sf" packet metadata.
+ * The output buffers are sized for the chirps of this spread factor,
+ * and packets with a larger spread factor are rejected.
+ * The special value of zero allows only the spread factor above,
+ * which keeps the buffers small on a fixed rate link at high oversampling.
+ * |default 0
+ * |option [Fixed] 0
+ * |option [SF12] 12
+ * |widget ComboBox(editable=true)
+ * |preview valid
+ *
+ * |factory /lora/lora_tx(sf)
+ * |initializer setOvs(ovs)
+ * |initializer setMaxSpreadFactor(maxSf)
+ * |setter setSymbolSize(ppm)
+ * |setter setCodingRate(cr)
+ * |setter enableExplicit(explicit)
+ * |setter enableCrc(crc)
+ * |setter enableWhitening(whitening)
+ * |setter setSync(sync)
+ * |setter setPadding(padding)
+ * |setter setAmplitude(ampl)
+ **********************************************************************/
+class LoRaTx : public Pothos::Block
+{
+public:
+    LoRaTx(const size_t sf):
+        _sf(sf),
+        _maxSf(sf),
+        _rdd(4),
+        _explicit(true),
+        _sync(0x12),
+        _mod(sf)
+    {
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaTx, setSymbolSize));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaTx, setCodingRate));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaTx, enableExplicit));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaTx, enableCrc));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaTx, enableWhitening));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaTx, setSync));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaTx, setPadding));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaTx, setAmplitude));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaTx, setOvs));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaTx, setMaxSpreadFactor));
+        this->setupInput(0);
+        this->setupOutput(0, typeid(std::complex<float>));
+    }
+
+    static Block *make(const size_t sf)
+    {
+        return new LoRaTx(sf);
+    }
+
+    void setSymbolSize(const size_t ppm)
+    {
+        _encoder.ppm = ppm;
+    }
+
+    void setCodingRate(const std::string &cr)
+    {
+        if (not parseCodingRate(cr, _rdd)) throw Pothos::InvalidArgumentException("LoRaTx::setCodingRate(" + cr + ")", "unknown coding rate");
+    }
+
+    void enableExplicit(const bool __explicit)
+    {
+        _explicit = __explicit;
+    }
+
+    void enableCrc(const bool crc)
+    {
+        _encoder.crc = crc;
+    }
+
+    void enableWhitening(const bool whitening)
+    {
+        _encoder.whitening = whitening;
+    }
+
+    void setSync(const unsigned char sync)
+    {
+        _sync = sync;
+    }
+
+    void setPadding(const size_t padding)
+    {
+        _mod.setPadding(padding);
+    }
+
+    void setAmplitude(const float ampl)
+    {
+        _mod.setAmplitude(ampl);
+    }
+
+    void setOvs(const double ovs)
+    {
+        if (!(ovs >= 1 && ovs <= 256)) {
+            throw Pothos::InvalidArgumentException("LoRaTx::setOvs(" + std::to_string(ovs) + ")", "invalid oversampling ratio");
+        }
+        _mod.setOvs(ovs);
+    }
+
+    void setMaxSpreadFactor(const size_t maxSf)
+    {
+        if (maxSf != 0 and (maxSf < _sf or maxSf > LORA_MAX_SF))
+        {
+            throw Pothos::InvalidArgumentException("LoRaTx::setMaxSpreadFactor(" + std::to_string(maxSf) + ")", "failed check: SF <= max SF <= 12");
+        }
+        _maxSf = (maxSf == 0) ? _sf : maxSf;
+    }
+
+    void activate(void)
+    {
+        _mod.reset();
+    }
+
+    void work(void)
+    {
+        auto inPort = this->input(0);
+        auto outPort = this->output(0);
+
+        //encode the next packet directly into the modulator's symbols
+        if (not _mod.active())
+        {
+            if (not inPort->hasMessage()) return;
+            auto msg = inPort->popMessage();
+            auto pkt = msg.extract<Pothos::Packet>();
+
+            //apply the per-packet settings over the block defaults
+            _encoder.sf = getPacketSpreadFactor(pkt, _sf, _maxSf);
+            _encoder.rdd = getPacketCodingRate(pkt, _rdd);
+            _encoder.explicitHeader = getPacketSetting<bool>(pkt, "explicit", _explicit);
+            if (_encoder.symbolSize() > _encoder.sf) throw Pothos::Exception("LoRaTx::work()", "failed check: PPM <= SF");
+            _mod.setSpreadFactor(_encoder.sf);
+            _mod.setSync(getPacketSetting<unsigned char>(pkt, "sync", _sync));
+            _encoder.encode(pkt.payload.as<const uint8_t *>(), pkt.payload.length, _symbols);
+            _mod.start(_symbols.data(), _symbols.size());
+        }
+
+        //render as much of the burst as the output buffer can hold
+        auto samps = outPort->buffer().as<std::complex<float> *>();
+        const size_t available = outPort->elements();
+        const size_t maxStep = _mod.maxStepSamples();
+        size_t total = 0;
+        while (_mod.active() and total + maxStep <= available)
+        {
+            bool txEnd = false;
+            const size_t i = _mod.step(samps + total, _id, txEnd);
+            if (txEnd)
+            {
+                outPort->postLabel(Pothos::Label("txEnd", Pothos::Object(), total + _mod.chirpSize()-1));
+            }
+            if (not _id.empty())
+            {
+                outPort->postLabel(Pothos::Label(_id, Pothos::Object(), total));
+            }
+            total += i;
+        }
+        outPort->produce(total);
+    }
+
+    //! Custom output buffer manager with slabs large enough for a burst of chirps
+    Pothos::BufferManager::Sptr getOutputBufferManager(const std::string &name, const std::string &domain)
+    {
+        if (name == "0")
+        {
+            const size_t maxNN = _mod.maxStepSamples(_maxSf);
+            this->output(name)->setReserve(maxNN);
+            Pothos::BufferManagerArgs args;
+            args.bufferSize = std::max(maxNN, _mod.maxStepSamples(_sf) * BURST_CHIRPS) * sizeof(std::complex<float>);
+            return Pothos::BufferManager::make("generic", args);
+        }
+        return Pothos::Block::getOutputBufferManager(name, domain);
+    }
+
+private:
+    //! Chirps per output buffer: the preamble and header plus a short payload
+    static const size_t BURST_CHIRPS = 32;
+
+    const size_t _sf;
+    size_t _maxSf;
+    size_t _rdd;
+    bool _explicit;
+    unsigned char _sync;
+    LoRaPacketEncoder _encoder;
+    LoRaModulator _mod;
+    std::vector<uint16_t> _symbols;
+    std::string _id;
+};
+
+static Pothos::BlockRegistry registerLoRaTx(
+    "/lora/lora_tx", &LoRaTx::make);
@@ -0,0 +1,310 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Framework.hpp>
+#include "LoRaAesCmac.hpp"
+#include <map>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+
+/***********************************************************************
+ * |PothosDoc LoRaWAN Frame
+ *
+ * Authenticate LoRaWAN uplink data frames from the LoRa Decoder
+ * and forward only the frames of known sessions with a valid MIC.
+ *
+ * The MAC header and frame header are parsed in place from the
+ * decoded bytes. A frame is dropped when it is not an uplink data frame,
+ * when its device address has no session (a foreign frame),
+ * when its frame counter does not advance by 1 to MAX_FCNT_GAP (16384)
+ * frames (a duplicate, a replay, or a counter out of step),
+ * or when its AES-CMAC message integrity code does not match.
+ * The MICs of the waiting frames are verified together in batches,
+ * using AES-NI when the CPU supports it.
+ *
+ * <h2>Input format</h2>
+ *
+ * A packet message with a payload of bytes: the LoRaWAN PHYPayload.
+ *
+ * <h2>Output format</h2>
+ *
+ * The authenticated input packet with the metadata keys
+ * "devAddr" (hex string), "fCnt" (the 32-bit frame counter),
+ * "confirmed", and "fPort" (when the frame has a port).
+ *
+ * |category /LoRa
+ * |keywords lora lorawan mic cmac aes authenticate
+ *
+ * |param sessions[Sessions] A list of sessions as "DevAddr:NwkSKey" hex strings.
+ * Example: ["26011BDA:2B7E151628AED2A6ABF7158809CF4F3C"]
+ * |default []
+ *
+ * |param batch[Batch size] The maximum number of frames verified together.
+ * |default 16
+ *
+ * |factory /lora/lorawan_frame()
+ * |setter setSessions(sessions)
+ * |setter setBatchSize(batch)
+ **********************************************************************/
+class LoRaWanFrame : public Pothos::Block
+{
+public:
+    LoRaWanFrame(void):
+        _batchSize(16),
+        _aesNi(LoRaAesCmac::hasAesNi())
+    {
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaWanFrame, setSessions));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaWanFrame, addSession));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaWanFrame, removeSession));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaWanFrame, setBatchSize));
+        this->registerCall(this, POTHOS_FCN_TUPLE(LoRaWanFrame, getStats));
+        this->registerSignal("dropped");
+        this->setupInput("0");
+        this->setupOutput("0");
+        this->resetStats();
+    }
+
+    static Block *make(void)
+    {
+        return new LoRaWanFrame();
+    }
+
+    void setSessions(const std::vector<std::string> &sessions)
+    {
+        _sessions.clear();
+        for (const auto &session : sessions)
+        {
+            const auto colon = session.find(':');
+            if (colon == std::string::npos) throw Pothos::InvalidArgumentException("LoRaWanFrame::setSessions("+session+")", "expected DevAddr:NwkSKey");
+            this->addSession(session.substr(0, colon), session.substr(colon+1));
+        }
+    }
+
+    //! Add or replace the session of a device, the frame counter restarts
+    void addSession(const std::string &devAddr, const std::string &nwkSKey)
+    {
+        uint8_t addr[4], key[16];
+        if (not parseHex(devAddr, addr, sizeof(addr))) throw Pothos::InvalidArgumentException("LoRaWanFrame::addSession("+devAddr+")", "DevAddr must be 8 hex digits");
+        if (not parseHex(nwkSKey, key, sizeof(key))) throw Pothos::InvalidArgumentException("LoRaWanFrame::addSession("+nwkSKey+")", "NwkSKey must be 32 hex digits");
+        Session &session = _sessions[readBE32(addr)];
+        session.cmac = LoRaAesCmac(key);
+        session.fCnt = 0;
+        session.seen = false;
+    }
+
+    void removeSession(const std::string &devAddr)
+    {
+        uint8_t addr[4];
+        if (not parseHex(devAddr, addr, sizeof(addr))) throw Pothos::InvalidArgumentException("LoRaWanFrame::removeSession("+devAddr+")", "DevAddr must be 8 hex digits");
+        _sessions.erase(readBE32(addr));
+    }
+
+    void setBatchSize(const size_t batch)
+    {
+        if (batch == 0) throw Pothos::InvalidArgumentException("LoRaWanFrame::setBatchSize(0)", "batch size must be positive");
+        _batchSize = batch;
+    }
+
+    //! Counters of forwarded frames and of dropped frames by cause
+    Pothos::ObjectKwargs getStats(void) const
+    {
+        Pothos::ObjectKwargs stats;
+        stats["forwarded"] = Pothos::Object(_forwarded);
+        stats["malformed"] = Pothos::Object(_malformed);
+        stats["foreign"] = Pothos::Object(_foreign);
+        stats["replayed"] = Pothos::Object(_replayed);
+        stats["failedMic"] = Pothos::Object(_failedMic);
+        stats["aesNi"] = Pothos::Object(_aesNi);
+        return stats;
+    }
+
+    void activate(void)
+    {
+        this->resetStats();
+        this->emitSignal("dropped", this->dropped());
+    }
+
+    void work(void)
+    {
+        auto inPort = this->input(0);
+        auto outPort = this->output(0);
+        if (not inPort->hasMessage()) return;
+
+        //parse the waiting frames and queue the MIC of each candidate
+        const auto droppedBefore = this->dropped();
+        _frames.clear();
+        while (inPort->hasMessage() and _frames.size() < _batchSize)
+        {
+            auto msg = inPort->popMessage();
+            Frame frame;
+            frame.pkt = msg.extract<Pothos::Packet>();
+            if (this->parse(frame)) _frames.push_back(std::move(frame));
+        }
+
+        _jobs.resize(_frames.size());
+        for (size_t i = 0; i < _frames.size(); i++)
+        {
+            auto &frame = _frames[i];
+            _jobs[i].key = &frame.session->cmac;
+            _jobs[i].msg = frame.block.data();
+            _jobs[i].len = frame.block.size();
+        }
+        LoRaAesCmac::computeBatch(_jobs.data(), _jobs.size(), _aesNi);
+
+        //forward in order, the counter check repeats for frames of one device in the batch
+        for (size_t i = 0; i < _frames.size(); i++)
+        {
+            auto &frame = _frames[i];
+            const auto bytes = frame.pkt.payload.as<const uint8_t *>();
+            if (std::memcmp(_jobs[i].mac, bytes + frame.pkt.payload.length - 4, 4) != 0)
+            {
+                _failedMic++;
+                continue;
+            }
+            if (frame.session->seen and frame.fCnt <= frame.session->fCnt)
+            {
+                _replayed++;
+                continue;
+            }
+            frame.session->fCnt = frame.fCnt;
+            frame.session->seen = true;
+
+            frame.pkt.metadata["devAddr"] = Pothos::Object(toHex(frame.devAddr));
+            frame.pkt.metadata["fCnt"] = Pothos::Object(frame.fCnt);
+            frame.pkt.metadata["confirmed"] = Pothos::Object(frame.confirmed);
+            if (frame.fPort >= 0) frame.pkt.metadata["fPort"] = Pothos::Object(frame.fPort);
+            outPort->postMessage(frame.pkt);
+            _forwarded++;
+        }
+
+        if (this->dropped() != droppedBefore) this->emitSignal("dropped", this->dropped());
+        if (inPort->hasMessage()) this->yield();
+    }
+
+private:
+    //! The most frames that a device may advance its counter by between frames
+    enum {MAX_FCNT_GAP = 16384};
+
+    struct Session
+    {
+        LoRaAesCmac cmac;
+        unsigned long long fCnt;
+        bool seen;
+    };
+
+    struct Frame
+    {
+        Pothos::Packet pkt;
+        Session *session;
+        uint32_t devAddr;
+        unsigned long long fCnt;
+        bool confirmed;
+        int fPort;
+        std::vector<uint8_t> block; //!< the B0 block followed by the frame sans MIC
+    };
+
+    //! Check the frame header and build the MIC input, false when dropped
+    bool parse(Frame &frame)
+    {
+        //MHDR(1) DevAddr(4) FCtrl(1) FCnt(2) FOpts(0-15) [FPort(1) FRMPayload] MIC(4)
+        const auto bytes = frame.pkt.payload.as<const uint8_t *>();
+        const size_t len = frame.pkt.payload.length;
+        if (len < 12) return this->drop(_malformed);
+
+        //unconfirmed (2) or confirmed (4) data up, LoRaWAN R1
+        const uint8_t mType = bytes[0] >> 5;
+        if ((mType != 2 and mType != 4) or (bytes[0] & 0x3) != 0) return this->drop(_malformed);
+        const size_t fOptsLen = bytes[5] & 0xf;
+        if (len < 12 + fOptsLen) return this->drop(_malformed);
+
+        frame.devAddr = readLE32(bytes + 1);
+        const auto it = _sessions.find(frame.devAddr);
+        if (it == _sessions.end()) return this->drop(_foreign);
+        frame.session = &it->second;
+        frame.confirmed = (mType == 4);
+        frame.fPort = (len > 12 + fOptsLen) ? bytes[8 + fOptsLen] : -1;
+
+        //the upper 16 bits of the counter follow the session: the lower 16 bits
+        //advance within MAX_FCNT_GAP, so an older counter is not taken for a roll over
+        const unsigned long long fCnt16 = bytes[6] | (bytes[7] << 8);
+        const unsigned long long last = frame.session->fCnt;
+        const unsigned long long gap = (fCnt16 - last) & 0xffff;
+        if (frame.session->seen and (gap == 0 or gap > MAX_FCNT_GAP)) return this->drop(_replayed);
+        frame.fCnt = frame.session->seen ? last + gap : fCnt16;
+
+        //B0 = 0x49 | 0x00 * 4 | Dir (0 up) | DevAddr | FCnt | 0x00 | len(msg)
+        const size_t msgLen = len - 4;
+        frame.block.assign(16 + msgLen, 0);
+        frame.block[0] = 0x49;
+        std::memcpy(frame.block.data() + 6, bytes + 1, 4);
+        for (size_t i = 0; i < 4; i++) frame.block[10+i] = uint8_t(frame.fCnt >> (8*i));
+        frame.block[15] = uint8_t(msgLen);
+        std::memcpy(frame.block.data() + 16, bytes, msgLen);
+        return true;
+    }
+
+    bool drop(unsigned long long &counter)
+    {
+        counter++;
+        return false;
+    }
+
+    unsigned long long dropped(void) const
+    {
+        return _malformed + _foreign + _replayed + _failedMic;
+    }
+
+    void resetStats(void)
+    {
+        _forwarded = 0;
+        _malformed = 0;
+        _foreign = 0;
+        _replayed = 0;
+        _failedMic = 0;
+    }
+
+    static bool parseHex(const std::string &hex, uint8_t *out, const size_t num)
+    {
+        if (hex.size() != 2*num) return false;
+        for (size_t i = 0; i < num; i++)
+        {
+            const auto byte = hex.substr(2*i, 2);
+            if (byte.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) return false;
+            out[i] = uint8_t(std::stoul(byte, nullptr, 16));
+        }
+        return true;
+    }
+
+    static std::string toHex(const uint32_t value)
+    {
+        char buff[9];
+        std::snprintf(buff, sizeof(buff), "%08X", unsigned(value));
+        return buff;
+    }
+
+    static uint32_t readBE32(const uint8_t *p)
+    {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+
+    static uint32_t readLE32(const uint8_t *p)
+    {
+        return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+    }
+
+    size_t _batchSize;
+    bool _aesNi;
+    std::map<uint32_t, Session> _sessions;
+    std::vector<Frame> _frames;
+    std::vector<LoRaAesCmac::Job> _jobs;
+    unsigned long long _forwarded;
+    unsigned long long _malformed;
+    unsigned long long _foreign;
+    unsigned long long _replayed;
+    unsigned long long _failedMic;
+};
+
+static Pothos::BlockRegistry registerLoRaWanFrame(
+    "/lora/lorawan_frame", &LoRaWanFrame::make);
@@ -0,0 +1,93 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Testing.hpp>
+#include "LoRaAsync.hpp"
+#include <iostream>
+#include <random>
+#include <thread>
+
+namespace
+{
+    //! A coroutine that starts eagerly and is not awaited
+    struct Detached
+    {
+        struct promise_type
+        {
+            Detached get_return_object(void) {return {};}
+            std::suspend_never initial_suspend(void) {return {};}
+            std::suspend_never final_suspend(void) noexcept {return {};}
+            void return_void(void) {}
+            void unhandled_exception(void) {std::terminate();}
+        };
+    };
+
+    Detached sendAll(LoRaAsyncTx &tx, const std::vector<std::vector<uint8_t>> &payloads, size_t &numSent)
+    {
+        for (const auto &payload : payloads) tx.send(payload);
+        while (numSent < payloads.size()) numSent += co_await tx.sent();
+    }
+
+    Detached receiveAll(LoRaAsyncRx &rx, std::vector<std::vector<uint8_t>> &received, bool &done)
+    {
+        while (auto packet = co_await rx.next()) received.push_back(packet->payload);
+        done = true;
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_async_loopback)
+{
+    const size_t SF = 8;
+    std::mt19937 rng(0);
+    std::normal_distribution<float> noise(0.0f, 0.1f);
+
+    std::vector<std::vector<uint8_t>> payloads(3);
+    for (auto &payload : payloads)
+    {
+        payload.resize(8 + rng() % 16);
+        for (auto &b : payload) b = rng();
+    }
+
+    //the coroutine awaits completion while the radio side pulls in odd sized buffers
+    LoRaAsyncTx tx(SF);
+    tx.modulator().setPadding(4);
+    size_t numSent = 0;
+    sendAll(tx, payloads, numSent);
+    std::vector<std::complex<float>> samps(1000);
+    std::vector<std::complex<float>> buff(333);
+    while (numSent < payloads.size())
+    {
+        const size_t n = tx.pull(buff);
+        POTHOS_TEST_TRUE(n != 0);
+        samps.insert(samps.end(), buff.begin(), buff.begin() + n);
+    }
+    POTHOS_TEST_EQUAL(numSent, payloads.size());
+    POTHOS_TEST_EQUAL(tx.pull(buff), size_t(0));
+    samps.resize(samps.size() + 1000);
+    for (auto &s : samps) s += std::complex<float>(noise(rng), noise(rng));
+
+    //push from another thread, the coroutine resumes inline on the pushing thread
+    LoRaAsyncRx rx(SF);
+    rx.demodulator().setThreshold(-5.0);
+    rx.demodulator().setMTU(64);
+    std::vector<std::vector<uint8_t>> received;
+    bool done = false;
+    receiveAll(rx, received, done);
+    std::thread producer([&]
+    {
+        for (size_t i = 0; i < samps.size(); i += 777)
+        {
+            rx.push(std::span<const std::complex<float>>(samps.data() + i, std::min<size_t>(777, samps.size() - i)));
+        }
+        rx.close();
+    });
+    producer.join();
+
+    POTHOS_TEST_TRUE(done);
+    POTHOS_TEST_EQUAL(rx.dropped(), 0ull);
+    POTHOS_TEST_EQUAL(received.size(), payloads.size());
+    for (size_t i = 0; i < received.size(); i++)
+    {
+        POTHOS_TEST_TRUE(received[i] == payloads[i]);
+    }
+}
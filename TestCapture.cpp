@@ -0,0 +1,179 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Testing.hpp>
+#include <Pothos/Framework.hpp>
+#include <Pothos/Proxy.hpp>
+#include <Poco/TemporaryFile.h>
+#include "LoRaBfpCodec.hpp"
+#include "LoRaPacketEncoder.hpp"
+#include "LoRaPacketDecoder.hpp"
+#include "LoRaModulator.hpp"
+#include "LoRaDemodulator.hpp"
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <chrono>
+
+POTHOS_TEST_BLOCK("/lora/tests", test_bfp_codec)
+{
+    const size_t SF = 8;
+    const size_t N = 1 << SF;
+    std::mt19937 rng(0);
+    std::normal_distribution<float> noise(0.0f, 0.5f);
+
+    //a frame in noise, well below full scale
+    LoRaPacketEncoder encoder;
+    encoder.sf = SF;
+    std::vector<uint8_t> payload(32);
+    for (auto &b : payload) b = std::rand();
+    std::vector<uint16_t> symbols;
+    encoder.encode(payload.data(), payload.size(), symbols);
+    LoRaModulator mod(SF);
+    mod.setPadding(2);
+    std::vector<std::complex<float>> samps(4*N);
+    mod.modulateFrame(symbols.data(), symbols.size(), samps);
+    for (auto &s : samps) s = (s + std::complex<float>(noise(rng), noise(rng)))*1e-3f;
+
+    for (const size_t bits : {6, 8})
+    {
+        LoRaBfpCodec codec(bits, 32);
+        const size_t numBlocks = samps.size()/codec.blockSize();
+        std::vector<uint8_t> bytes(numBlocks*codec.blockBytes());
+        std::vector<std::complex<float>> replay(numBlocks*codec.blockSize());
+
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < numBlocks; i++) codec.encode(samps.data() + i*codec.blockSize(), bytes.data() + i*codec.blockBytes());
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < numBlocks; i++) codec.decode(bytes.data() + i*codec.blockBytes(), replay.data() + i*codec.blockSize());
+        const auto t2 = std::chrono::high_resolution_clock::now();
+
+        double signal = 0.0, error = 0.0;
+        for (size_t i = 0; i < replay.size(); i++)
+        {
+            signal += std::norm(samps[i]);
+            error += std::norm(samps[i] - replay[i]);
+        }
+        const double sqnr = 10*std::log10(signal/error);
+        std::cout << bits << " bits: ratio " << double(replay.size()*sizeof(std::complex<float>))/bytes.size()
+            << ", SQNR " << sqnr << " dB, encode " << replay.size()/std::chrono::duration<double>(t1-t0).count()/1e6
+            << " MS/s, decode " << replay.size()/std::chrono::duration<double>(t2-t1).count()/1e6 << " MS/s" << std::endl;
+        POTHOS_TEST_TRUE(sqnr > ((bits == 8) ? 35.0 : 24.0));
+
+        //the replay still demodulates
+        LoRaDemodulator demod(SF);
+        demod.setMTU(symbols.size());
+        size_t consumed = 0, numPackets = 0;
+        while (consumed + demod.required() <= replay.size())
+        {
+            consumed += demod.step(replay.data() + consumed);
+            if (not demod.packetReady()) continue;
+            LoRaPacketDecoder decoder;
+            decoder.sf = SF;
+            decoder.errorCheck = true;
+            POTHOS_TEST_EQUAL(decoder.decode(demod.symbols(), demod.numSymbols()), LoRaPacketDecoder::DECODE_OK);
+            POTHOS_TEST_EQUALA(decoder.payload(), payload.data(), payload.size());
+            numPackets++;
+        }
+        POTHOS_TEST_EQUAL(numPackets, size_t(1));
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_bfp_capture)
+{
+    auto env = Pothos::ProxyEnvironment::make("managed");
+    auto registry = env->findProxy("Pothos/BlockRegistry");
+    Poco::TemporaryFile tempFile;
+    const std::string path = tempFile.path();
+
+    //a length that ends in a partial block
+    const size_t num = 1000;
+    Pothos::BufferChunk samps(typeid(std::complex<float>), num);
+    auto p = samps.as<std::complex<float> *>();
+    for (size_t i = 0; i < num; i++) p[i] = std::polar(float(1 + i % 7), float(i));
+
+    //record the capture
+    {
+        auto feeder = registry.call("/blocks/feeder_source", "complex_float32");
+        auto sink = registry.call("/lora/bfp_capture_sink", path);
+        sink.call("setBlockSize", 16);
+        feeder.call("feedBuffer", samps);
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, sink, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.1, 0));
+    }
+
+    //replay from a start index inside a block
+    for (const size_t start : {0, 100})
+    {
+        auto source = registry.call("/lora/bfp_capture_source", path);
+        auto collector = registry.call("/blocks/collector_sink", "complex_float32");
+        source.call("setStartIndex", start);
+        {
+            Pothos::Topology topology;
+            topology.connect(source, 0, collector, 0);
+            topology.commit();
+            POTHOS_TEST_TRUE(topology.waitInactive(0.1, 0));
+        }
+        POTHOS_TEST_EQUAL(source.call<unsigned long long>("getNumSamples"), num);
+
+        auto buff = collector.call<Pothos::BufferChunk>("getBuffer");
+        POTHOS_TEST_EQUAL(buff.elements(), num - start);
+        auto q = buff.as<const std::complex<float> *>();
+        for (size_t i = 0; i < buff.elements(); i++)
+        {
+            POTHOS_TEST_TRUE(std::abs(q[i] - p[start + i]) < 0.05f);
+        }
+    }
+
+    //a repeated replay restarts from the start index
+    {
+        const size_t start = 100;
+        auto source = registry.call("/lora/bfp_capture_source", path);
+        auto collector = registry.call("/blocks/collector_sink", "complex_float32");
+        source.call("setStartIndex", start);
+        source.call("enableRepeat", true);
+        {
+            Pothos::Topology topology;
+            topology.connect(source, 0, collector, 0);
+            topology.commit();
+            topology.waitInactive(0.1, 0.5);
+        }
+        auto buff = collector.call<Pothos::BufferChunk>("getBuffer");
+        POTHOS_TEST_TRUE(buff.elements() > 2*(num - start));
+        auto q = buff.as<const std::complex<float> *>();
+        for (size_t i = 0; i < 2*(num - start); i++)
+        {
+            POTHOS_TEST_TRUE(std::abs(q[i] - p[start + i % (num - start)]) < 0.05f);
+        }
+    }
+
+    //a capture cut short in a block ends after the last whole block
+    {
+        Poco::TemporaryFile shortFile;
+        const LoRaBfpCodec codec(8, 16);
+        const size_t numBlocks = 20;
+        std::ifstream in(path, std::ios::binary);
+        std::vector<char> bytes(LoRaBfpCodec::HEADER_SIZE + numBlocks*codec.blockBytes() + codec.blockBytes()/2);
+        POTHOS_TEST_TRUE(bool(in.read(bytes.data(), bytes.size())));
+        std::ofstream(shortFile.path(), std::ios::binary).write(bytes.data(), bytes.size());
+
+        auto source = registry.call("/lora/bfp_capture_source", shortFile.path());
+        auto collector = registry.call("/blocks/collector_sink", "complex_float32");
+        {
+            Pothos::Topology topology;
+            topology.connect(source, 0, collector, 0);
+            topology.commit();
+            POTHOS_TEST_TRUE(topology.waitInactive(0.1, 0));
+        }
+        POTHOS_TEST_EQUAL(source.call<unsigned long long>("getNumSamples"), numBlocks*codec.blockSize());
+        auto buff = collector.call<Pothos::BufferChunk>("getBuffer");
+        POTHOS_TEST_EQUAL(buff.elements(), numBlocks*codec.blockSize());
+        auto q = buff.as<const std::complex<float> *>();
+        for (size_t i = 0; i < buff.elements(); i++)
+        {
+            POTHOS_TEST_TRUE(std::abs(q[i] - p[i]) < 0.05f);
+        }
+    }
+}
@@ -0,0 +1,146 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Testing.hpp>
+#include "FastSinCos.hpp"
+#include "ChirpGenerator.hpp"
+#include "kissfft.hh"
+#include <iostream>
+#include <vector>
+#include <chrono>
+
+POTHOS_TEST_BLOCK("/lora/tests", test_fast_sin_cos)
+{
+    //check the documented max error over the chirp phase range
+    const size_t n = 1 << 20;
+    const double limit = 1 << 13;
+    std::vector<float> phase(n), s(n), c(n);
+    for (size_t i = 0; i < n; i++) phase[i] = float(-limit + (2*limit*i)/n);
+    fastSinCos(phase.data(), s.data(), c.data(), n);
+
+    double maxErr = 0.0;
+    for (size_t i = 0; i < n; i++)
+    {
+        maxErr = std::max(maxErr, std::abs(s[i] - std::sin(double(phase[i]))));
+        maxErr = std::max(maxErr, std::abs(c[i] - std::cos(double(phase[i]))));
+    }
+    std::cout << "max error " << maxErr << std::endl;
+    POTHOS_TEST_TRUE(maxErr < 1e-7);
+
+    //the generated chirp should match std::polar
+    const size_t N = 1 << 12;
+    std::vector<std::complex<float>> chirp(N);
+    float phaseAccum = 0.0f;
+    genChirp(chirp.data(), N, 1, N, 0.0f, false, 1.0f, phaseAccum);
+    float phaseRef = 0.0f;
+    float f = -M_PI;
+    for (size_t i = 0; i < N; i++)
+    {
+        f += (2 * M_PI) / N;
+        if (f > M_PI) f -= 2 * M_PI;
+        phaseRef += f;
+        POTHOS_TEST_TRUE(std::abs(chirp[i] - std::polar(1.0f, phaseRef)) < 1e-6);
+    }
+}
+
+namespace
+{
+    //! The power outside of the LoRa bandwidth relative to the power inside, in dB
+    double outOfBandPower(const std::complex<float> *samps, const double ovs)
+    {
+        const size_t M = 1 << 12;
+        kissfft<float> fft(M, false);
+        std::vector<std::complex<float>> windowed(M), spectrum(M);
+        for (size_t k = 0; k < M; k++) windowed[k] = samps[k]*float(0.5-0.5*std::cos((2*M_PI*k)/M));
+        fft.transform(windowed.data(), spectrum.data());
+        double inBand = 0.0, outBand = 0.0;
+        for (size_t k = 0; k < M; k++)
+        {
+            const double w = (2*M_PI*(k < M/2 ? double(k) : double(k)-M))/M;
+            if (std::abs(w) <= 1.05*M_PI/ovs) inBand += std::norm(spectrum[k]);
+            else outBand += std::norm(spectrum[k]);
+        }
+        return 10*std::log10(outBand/inBand);
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_frac_chirp)
+{
+    const size_t N = 1 << 8;
+    const size_t numSyms = 32;
+    const double ovsList[] = {2.0, 2.5, 3.2, 5.0/3.0};
+
+    //the out of band power of the integer path for reference
+    double oobRef = 0.0;
+    {
+        const int ovs = 2;
+        std::vector<std::complex<float>> samps(numSyms*N*ovs);
+        float phaseAccum = 0.0f;
+        for (size_t s = 0; s < numSyms; s++)
+        {
+            const float f0 = (2*M_PI*((s*37) % N))/(N*ovs);
+            genChirp(samps.data()+s*N*ovs, N, ovs, N*ovs, f0, false, 1.0f, phaseAccum);
+        }
+        oobRef = outOfBandPower(samps.data(), ovs);
+        std::cout << "integer path out of band power " << oobRef << " dB" << std::endl;
+    }
+
+    for (const double ovs : ovsList)
+    {
+        std::cout << "testing fractional chirp with ovs " << ovs << std::endl;
+        std::vector<std::complex<float>> samps(size_t(numSyms*N*ovs) + numSyms);
+        std::vector<size_t> syms(numSyms);
+        std::vector<double> offsets(numSyms);
+        float phaseAccum = 0.0f;
+        double timeOffset = 0.0;
+        size_t total = 0;
+        for (size_t s = 0; s < numSyms; s++)
+        {
+            syms[s] = (s*37) % N;
+            offsets[s] = timeOffset;
+            const float f0 = (2*M_PI*syms[s])/(N*ovs);
+            total += genChirpFrac(samps.data()+total, N, ovs, N, f0, false, 1.0f, phaseAccum, timeOffset);
+        }
+
+        //the symbol timing never drifts from the ideal N*ovs grid
+        POTHOS_TEST_TRUE(std::abs(double(total) - timeOffset - numSyms*N*ovs) < 1e-6);
+
+        //spectral purity: the instantaneous frequency follows the ideal chirp
+        double maxFreqErr = 0.0;
+        size_t i = 0;
+        for (size_t s = 0; s < numSyms; s++)
+        {
+            const double fSpan = (2*M_PI)/ovs;
+            const double fStep = (2*M_PI)/(N*ovs*ovs);
+            for (size_t j = 0; offsets[s] + j < N*ovs; j++, i++)
+            {
+                if (i == 0) continue;
+                const float f0 = (2*M_PI*syms[s])/(N*ovs);
+                double f = f0 + fStep*(offsets[s] + j + 1);
+                f -= std::floor(f/fSpan)*fSpan;
+                f -= M_PI/ovs;
+                const double meas = std::arg(samps[i]*std::conj(samps[i-1]));
+                maxFreqErr = std::max(maxFreqErr, std::abs(std::remainder(meas - f, 2*M_PI)));
+            }
+        }
+        std::cout << "  max frequency error " << maxFreqErr << " rad/sample" << std::endl;
+        POTHOS_TEST_TRUE(maxFreqErr < 2e-5);
+
+        //spectral purity: the energy stays within the LoRa bandwidth as well as the integer path
+        const double oob = outOfBandPower(samps.data(), ovs);
+        std::cout << "  out of band power " << oob << " dB" << std::endl;
+        POTHOS_TEST_TRUE(std::abs(oob - oobRef) < 1.0);
+
+        //throughput of the fractional generator
+        const size_t numTimed = 1 << 20;
+        std::vector<std::complex<float>> block(size_t(std::ceil(N*ovs)));
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        for (size_t n = 0; n < numTimed;)
+        {
+            n += genChirpFrac(block.data(), N, ovs, N, 0.0f, false, 1.0f, phaseAccum, timeOffset);
+        }
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        const double secs = std::chrono::duration<double>(t1-t0).count();
+        std::cout << "  throughput " << (numTimed/secs)/1e6 << " MS/s" << std::endl;
+    }
+}
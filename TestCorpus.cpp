@@ -0,0 +1,185 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Testing.hpp>
+#include <Pothos/Framework.hpp>
+#include <Pothos/Proxy.hpp>
+#include "LoRaBfpCodec.hpp"
+#include "LoRaPacketDecoder.hpp"
+#include "LoRaDemodulator.hpp"
+#include "LoRaCodes.hpp"
+#include <json.hpp>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+
+using json = nlohmann::json;
+
+/***********************************************************************
+ * Replay of the golden corpus in corpus/, see tools/LoRaCorpusGen.cpp.
+ * Every frame of every capture must decode to the exact payload,
+ * both through the blocks and through the cores, and the speed
+ * of the cores prints per capture to track optimisations.
+ **********************************************************************/
+
+namespace
+{
+    std::string corpusDir(void)
+    {
+        const char *dir = std::getenv("LORA_CORPUS_DIR");
+        if (dir != nullptr) return dir;
+        #ifdef LORA_CORPUS_DIR
+        return LORA_CORPUS_DIR;
+        #else
+        return "corpus";
+        #endif
+    }
+
+    std::vector<std::complex<float>> readCapture(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        uint8_t hdr[LoRaBfpCodec::HEADER_SIZE];
+        LoRaBfpCodec codec;
+        unsigned long long numSamps = 0;
+        if (not file.read(reinterpret_cast<char *>(hdr), sizeof(hdr)) or not codec.decodeHeader(hdr, numSamps)) return {};
+
+        std::vector<uint8_t> bytes(codec.blockBytes());
+        std::vector<std::complex<float>> samps((numSamps + codec.blockSize() - 1)/codec.blockSize()*codec.blockSize());
+        for (size_t i = 0; i < samps.size()/codec.blockSize(); i++)
+        {
+            if (not file.read(reinterpret_cast<char *>(bytes.data()), bytes.size())) return {};
+            codec.decode(bytes.data(), samps.data() + i*codec.blockSize());
+        }
+        samps.resize(numSamps);
+        return samps;
+    }
+
+    std::string toHex(const uint8_t *bytes, const size_t length)
+    {
+        std::string hex;
+        char buff[3];
+        for (size_t i = 0; i < length; i++)
+        {
+            std::snprintf(buff, sizeof(buff), "%02x", bytes[i]);
+            hex += buff;
+        }
+        return hex;
+    }
+
+    void configureCores(const json &capture, LoRaDemodulator &demod, LoRaPacketDecoder &decoder)
+    {
+        size_t rdd = 0;
+        parseCodingRate(capture["cr"].get<std::string>(), rdd);
+        demod.setSync(capture["sync"].get<unsigned>());
+        demod.setThreshold(-10.0);
+        demod.setSymbolSize(capture["ppm"].get<size_t>());
+        decoder.sf = capture["sf"].get<size_t>();
+        decoder.ppm = capture["ppm"].get<size_t>();
+        decoder.rdd = rdd;
+        decoder.explicitHeader = capture["explicit"].get<bool>();
+        decoder.dataLength = capture["dataLength"].get<size_t>();
+        decoder.crcc = capture["crc"].get<bool>();
+        decoder.errorCheck = true;
+    }
+
+    //! Decode a capture with the cores, the payloads in hex
+    std::vector<std::string> replayCores(const json &capture, const std::vector<std::complex<float>> &samps)
+    {
+        LoRaDemodulator demod(capture["sf"].get<size_t>());
+        LoRaPacketDecoder decoder;
+        configureCores(capture, demod, decoder);
+        std::vector<std::string> payloads;
+        size_t consumed = 0;
+        while (consumed + demod.required() <= samps.size())
+        {
+            consumed += demod.step(samps.data() + consumed);
+            if (not demod.packetReady()) continue;
+            if (decoder.decode(demod.symbols(), demod.numSymbols()) != LoRaPacketDecoder::DECODE_OK) continue;
+            payloads.push_back(toHex(decoder.payload(), decoder.length()));
+        }
+        return payloads;
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_golden_corpus)
+{
+    const auto dir = corpusDir();
+    std::ifstream manifestFile(dir + "/manifest.json");
+    POTHOS_TEST_TRUE(manifestFile.good());
+    const auto manifest = json::parse(manifestFile);
+
+    auto env = Pothos::ProxyEnvironment::make("managed");
+    auto registry = env->findProxy("Pothos/BlockRegistry");
+
+    size_t totalFrames = 0, totalDecoded = 0;
+    double totalSamps = 0.0, totalTime = 0.0;
+    std::cout << std::left << std::setw(22) << "capture" << std::right
+        << std::setw(8) << "frames" << std::setw(10) << "blocks" << std::setw(10) << "cores"
+        << std::setw(12) << "MS/s" << std::setw(12) << "x 125 kHz" << std::endl;
+    for (const auto &capture : manifest["captures"])
+    {
+        const auto path = dir + "/" + capture["file"].get<std::string>();
+        const auto expected = capture["payloads"].get<std::vector<std::string>>();
+        const auto samps = readCapture(path);
+        POTHOS_TEST_TRUE(not samps.empty());
+
+        //replay through the blocks as a receive topology would
+        const auto sf = capture["sf"].get<size_t>();
+        auto source = registry.call("/lora/bfp_capture_source", path);
+        auto demod = registry.call("/lora/lora_demod", sf);
+        auto decoder = registry.call("/lora/lora_decoder");
+        auto collector = registry.call("/blocks/collector_sink", "uint8");
+        demod.call("setSync", capture["sync"].get<unsigned char>());
+        demod.call("setThreshold", -10.0);
+        demod.call("setSymbolSize", capture["ppm"].get<size_t>());
+        decoder.call("setSpreadFactor", sf);
+        decoder.call("setSymbolSize", capture["ppm"].get<size_t>());
+        decoder.call("setCodingRate", capture["cr"].get<std::string>());
+        decoder.call("enableExplicit", capture["explicit"].get<bool>());
+        decoder.call("setDataLength", capture["dataLength"].get<size_t>());
+        decoder.call("enableCrcc", capture["crc"].get<bool>());
+        decoder.call("enableErrorCheck", true);
+        {
+            Pothos::Topology topology;
+            topology.connect(source, 0, demod, 0);
+            topology.connect(demod, 0, decoder, 0);
+            topology.connect(decoder, 0, collector, 0);
+            topology.commit();
+            POTHOS_TEST_TRUE(topology.waitInactive(0.1, 0));
+        }
+        std::vector<std::string> blockPayloads;
+        for (const auto &pkt : collector.call<std::vector<Pothos::Packet>>("getPackets"))
+        {
+            blockPayloads.push_back(toHex(pkt.payload.as<const uint8_t *>(), pkt.payload.length));
+        }
+
+        //time repeated passes of the cores over the capture
+        std::vector<std::string> corePayloads;
+        size_t passes = 0;
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        double elapsed = 0.0;
+        while (passes < 3 or elapsed < 0.2)
+        {
+            corePayloads = replayCores(capture, samps);
+            passes++;
+            elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+        }
+        const double rate = passes*samps.size()/elapsed;
+
+        std::cout << std::left << std::setw(22) << capture["file"].get<std::string>() << std::right
+            << std::setw(8) << expected.size() << std::setw(10) << blockPayloads.size() << std::setw(10) << corePayloads.size()
+            << std::fixed << std::setprecision(2) << std::setw(12) << rate/1e6
+            << std::setprecision(0) << std::setw(12) << rate/125e3 << std::endl;
+        POTHOS_TEST_TRUE(blockPayloads == expected);
+        POTHOS_TEST_TRUE(corePayloads == expected);
+        totalFrames += expected.size();
+        totalDecoded += corePayloads.size();
+        totalSamps += passes*samps.size();
+        totalTime += elapsed;
+    }
+    std::cout << "decoded " << totalDecoded << "/" << totalFrames << " frames, cores "
+        << std::setprecision(2) << totalSamps/totalTime/1e6 << " MS/s overall" << std::endl;
+}
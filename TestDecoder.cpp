@@ -0,0 +1,58 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Testing.hpp>
+#include "LoRaPacketEncoder.hpp"
+#include "LoRaPacketDecoder.hpp"
+#include <iostream>
+#include <cstdlib>
+
+POTHOS_TEST_BLOCK("/lora/tests", test_decoder_retries)
+{
+    for (size_t SF = 7; SF <= 12; SF++)
+    {
+        const size_t N = 1 << SF;
+        for (size_t rdd = 0; rdd <= 4; rdd++)
+        {
+            std::cout << "Testing SF " << SF << " RDD " << rdd << std::endl;
+            LoRaPacketEncoder encoder;
+            encoder.sf = SF;
+            encoder.rdd = rdd;
+            encoder.crc = true;
+
+            std::vector<uint8_t> payload(16);
+            for (auto &b : payload) b = std::rand();
+            std::vector<uint16_t> symbols;
+            encoder.encode(payload.data(), payload.size(), symbols);
+
+            //the runner-up of every symbol is noise, except for the corrupted symbol
+            std::vector<uint16_t> alternates(symbols.size());
+            std::vector<float> margins(symbols.size());
+            for (size_t i = 0; i < symbols.size(); i++)
+            {
+                alternates[i] = (symbols[i] + N/2) % N;
+                margins[i] = 10.0f + i;
+            }
+            const size_t bad = N_HEADER_SYMBOLS;
+            alternates[bad] = symbols[bad];
+            margins[bad] = 1.0f;
+            symbols[bad] = (symbols[bad] + N/4) % N;
+
+            LoRaPacketDecoder decoder;
+            decoder.sf = SF;
+            decoder.rdd = rdd;
+            decoder.errorCheck = true;
+            decoder.crcc = true;
+
+            //without retries the corruption is detected and the packet is lost
+            POTHOS_TEST_TRUE(decoder.decode(symbols.data(), symbols.size(), alternates.data(), margins.data()) != LoRaPacketDecoder::DECODE_OK);
+
+            //the least reliable symbol is retried first
+            decoder.retries = 4;
+            POTHOS_TEST_EQUAL(decoder.decode(symbols.data(), symbols.size(), alternates.data(), margins.data()), LoRaPacketDecoder::DECODE_OK);
+            POTHOS_TEST_EQUAL(decoder.attempts(), size_t(1));
+            POTHOS_TEST_EQUAL(decoder.length(), payload.size());
+            POTHOS_TEST_EQUALA(decoder.payload(), payload.data(), payload.size());
+        }
+    }
+}
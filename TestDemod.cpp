@@ -0,0 +1,532 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Testing.hpp>
+#include "LoRaPacketEncoder.hpp"
+#include "LoRaPacketDecoder.hpp"
+#include "LoRaModulator.hpp"
+#include "LoRaDemodulator.hpp"
+#include <iostream>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+
+POTHOS_TEST_BLOCK("/lora/tests", test_streaming_demod)
+{
+    const size_t SF = 9;
+    const size_t N = 1 << SF;
+    std::mt19937 rng(0);
+    std::normal_distribution<float> noise(0.0f, 0.3f);
+
+    //encode packets of various lengths and an idle block
+    LoRaPacketEncoder encoder;
+    encoder.sf = SF;
+    std::vector<std::vector<uint8_t>> payloads(10);
+    std::vector<std::vector<uint16_t>> packets(payloads.size());
+    for (size_t i = 0; i < payloads.size(); i++)
+    {
+        payloads[i].resize(1 + std::rand() % 32);
+        for (auto &b : payloads[i]) b = std::rand();
+        encoder.encode(payloads[i].data(), payloads[i].size(), packets[i]);
+    }
+    encoder.crc = false;
+    std::vector<uint16_t> idle;
+    encoder.encode(payloads[0].data(), 0, idle);
+
+    //one stream with an idle block after every other packet
+    LoRaModulator mod(SF);
+    mod.setAmplitude(1.0f);
+    mod.setPadding(4);
+    mod.enableStreaming(true);
+    mod.setPilotInterval(8);
+    std::vector<std::complex<float>> samps(4*N);
+    mod.start(packets[0].data(), packets[0].size());
+    size_t next = 1, numIdle = 0;
+    std::string id;
+    bool txEnd = false;
+    while (mod.active())
+    {
+        if (mod.streamWaiting())
+        {
+            if (next == packets.size()) mod.endStream();
+            else if (next % 2 == 0 and numIdle < next/2)
+            {
+                mod.stream(idle.data(), idle.size());
+                numIdle++;
+            }
+            else
+            {
+                mod.stream(packets[next].data(), packets[next].size());
+                next++;
+            }
+        }
+        const size_t offset = samps.size();
+        samps.resize(offset + 2*N);
+        samps.resize(offset + mod.step(samps.data() + offset, id, txEnd));
+    }
+    for (auto &s : samps) s += std::complex<float>(noise(rng), noise(rng));
+
+    LoRaDemodulator demod(SF);
+    demod.setThreshold(-10.0);
+    demod.enableStreaming(true);
+    demod.setPilotInterval(8);
+    LoRaPacketDecoder decoder;
+    decoder.sf = SF;
+    decoder.errorCheck = true;
+    decoder.crcc = true;
+
+    //every packet comes out of the stream in order
+    size_t numPackets = 0, consumed = 0;
+    while (consumed + demod.required() <= samps.size())
+    {
+        consumed += demod.step(samps.data() + consumed);
+        if (not demod.packetReady()) continue;
+        POTHOS_TEST_TRUE(numPackets < payloads.size());
+        POTHOS_TEST_EQUAL(demod.numSymbols(), packets[numPackets].size());
+        POTHOS_TEST_EQUAL(decoder.decode(demod.symbols(), demod.numSymbols()), LoRaPacketDecoder::DECODE_OK);
+        POTHOS_TEST_EQUAL(decoder.length(), payloads[numPackets].size());
+        POTHOS_TEST_EQUALA(decoder.payload(), payloads[numPackets].data(), payloads[numPackets].size());
+        numPackets++;
+    }
+    POTHOS_TEST_EQUAL(numPackets, payloads.size());
+    POTHOS_TEST_EQUAL(demod.stats().frames, 1ull);
+    POTHOS_TEST_EQUAL(demod.stats().idleBlocks, numIdle);
+    POTHOS_TEST_EQUAL(demod.stats().framingSlips, 0ull);
+    POTHOS_TEST_TRUE(demod.stats().pilotSymbols > 0);
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_drift_tracking)
+{
+    //a long SF12 packet with the reduced symbol set of the low data rate mode
+    const size_t SF = 12;
+    const size_t N = 1 << SF;
+    std::mt19937 rng(0);
+    std::normal_distribution<float> noise(0.0f, 0.1f);
+
+    LoRaPacketEncoder encoder;
+    encoder.sf = SF;
+    encoder.ppm = SF-2;
+    encoder.rdd = 4;
+    encoder.crc = true;
+    std::vector<uint8_t> payload(250);
+    for (auto &b : payload) b = std::rand();
+    std::vector<uint16_t> symbols;
+    encoder.encode(payload.data(), payload.size(), symbols);
+
+    for (const double ppm : {10.0, -10.0})
+    {
+        //an oversampling ratio just over one renders the frame with a sample clock that is ppm fast
+        LoRaModulator mod(SF);
+        mod.setAmplitude(1.0f);
+        mod.setOvs(1.0 + ppm*1e-6);
+        std::vector<std::complex<float>> samps(4*N);
+        mod.modulateFrame(symbols.data(), symbols.size(), samps);
+        samps.resize(samps.size() + 2*N);
+        for (auto &s : samps) s += std::complex<float>(noise(rng), noise(rng));
+
+        LoRaDemodulator demod(SF);
+        demod.setThreshold(-10.0);
+        demod.setMTU(symbols.size());
+        LoRaPacketDecoder decoder;
+        decoder.sf = SF;
+        decoder.ppm = SF-2;
+        decoder.rdd = 4;
+        decoder.errorCheck = true;
+        decoder.crcc = true;
+
+        //the frame drifts by 16 samples, the window follows it and the correction stays small
+        size_t numPackets = 0, consumed = 0;
+        while (consumed + demod.required() <= samps.size())
+        {
+            consumed += demod.step(samps.data() + consumed);
+            if (not demod.packetReady()) continue;
+            std::cout << ppm << " ppm: fineFreqError " << demod.fineFreqError() << ", drift " << demod.drift() << std::endl;
+            POTHOS_TEST_EQUAL(decoder.decode(demod.symbols(), demod.numSymbols()), LoRaPacketDecoder::DECODE_OK);
+            POTHOS_TEST_EQUALA(decoder.payload(), payload.data(), payload.size());
+            POTHOS_TEST_TRUE(std::abs(demod.fineFreqError()) < 2.0f);
+            POTHOS_TEST_CLOSE(std::abs(demod.drift()), float(std::abs(ppm)*1e-6*N), float(0.25*std::abs(ppm)*1e-6*N));
+            numPackets++;
+        }
+        POTHOS_TEST_EQUAL(numPackets, size_t(1));
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_drift_stream)
+{
+    //a long stream that drifts by many symbols over the packets
+    const size_t SF = 9;
+    const size_t N = 1 << SF;
+    std::mt19937 rng(0);
+    std::normal_distribution<float> noise(0.0f, 0.3f);
+
+    LoRaPacketEncoder encoder;
+    encoder.sf = SF;
+    std::vector<std::vector<uint8_t>> payloads(300);
+    std::vector<std::vector<uint16_t>> packets(payloads.size());
+    for (size_t i = 0; i < payloads.size(); i++)
+    {
+        payloads[i].resize(1 + rng() % 32);
+        for (auto &b : payloads[i]) b = uint8_t(rng());
+        encoder.encode(payloads[i].data(), payloads[i].size(), packets[i]);
+    }
+
+    for (const double ppm : {50.0, -20.0})
+    {
+        LoRaModulator mod(SF);
+        mod.setAmplitude(1.0f);
+        mod.setPadding(4);
+        mod.setOvs(1.0 + ppm*1e-6);
+        mod.enableStreaming(true);
+        mod.setPilotInterval(16);
+        std::vector<std::complex<float>> samps(4*N);
+        mod.start(packets[0].data(), packets[0].size());
+        size_t next = 1;
+        std::string id;
+        bool txEnd = false;
+        while (mod.active())
+        {
+            if (mod.streamWaiting())
+            {
+                if (next == packets.size()) mod.endStream();
+                else mod.stream(packets[next].data(), packets[next].size());
+                next++;
+            }
+            const size_t offset = samps.size();
+            samps.resize(offset + mod.maxStepSamples());
+            samps.resize(offset + mod.step(samps.data() + offset, id, txEnd));
+        }
+        for (auto &s : samps) s += std::complex<float>(noise(rng), noise(rng));
+
+        LoRaDemodulator demod(SF);
+        demod.setThreshold(-10.0);
+        demod.enableStreaming(true);
+        demod.setPilotInterval(16);
+        LoRaPacketDecoder decoder;
+        decoder.sf = SF;
+        decoder.errorCheck = true;
+        decoder.crcc = true;
+
+        size_t numPackets = 0, consumed = 0;
+        float maxFreqError = 0.0f;
+        while (consumed + demod.required() <= samps.size())
+        {
+            consumed += demod.step(samps.data() + consumed);
+            if (not demod.packetReady()) continue;
+            POTHOS_TEST_TRUE(numPackets < payloads.size());
+            POTHOS_TEST_EQUAL(decoder.decode(demod.symbols(), demod.numSymbols()), LoRaPacketDecoder::DECODE_OK);
+            POTHOS_TEST_EQUAL(decoder.length(), payloads[numPackets].size());
+            POTHOS_TEST_EQUALA(decoder.payload(), payloads[numPackets].data(), payloads[numPackets].size());
+            maxFreqError = std::max(maxFreqError, std::abs(demod.fineFreqError()));
+            numPackets++;
+        }
+        std::cout << ppm << " ppm: " << numPackets << " packets, max fineFreqError " << maxFreqError << std::endl;
+        POTHOS_TEST_EQUAL(numPackets, payloads.size());
+        POTHOS_TEST_EQUAL(demod.stats().frames, 1ull);
+        POTHOS_TEST_EQUAL(demod.stats().framingSlips, 0ull);
+        POTHOS_TEST_TRUE(maxFreqError < 2.0f);
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_incremental_demod)
+{
+    //samples arrive in random chunks, the symbols must match a batch demodulator
+    std::mt19937 rng(0);
+    std::normal_distribution<float> noise(0.0f, 0.1f);
+    for (const size_t SF : {7, 9, 12})
+    {
+        const size_t N = 1 << SF;
+        LoRaPacketEncoder encoder;
+        encoder.sf = SF;
+        encoder.rdd = 4;
+        encoder.crc = true;
+        std::vector<uint8_t> payload(24);
+        for (auto &b : payload) b = uint8_t(rng());
+        std::vector<uint16_t> symbols;
+        encoder.encode(payload.data(), payload.size(), symbols);
+
+        //two frames, so the demodulator returns to frame sync in between
+        LoRaModulator mod(SF);
+        mod.setAmplitude(1.0f);
+        std::vector<std::complex<float>> frame;
+        mod.modulateFrame(symbols.data(), symbols.size(), frame);
+        std::vector<std::complex<float>> clean(3*N + N/3);
+        for (size_t f = 0; f < 2; f++)
+        {
+            clean.insert(clean.end(), frame.begin(), frame.end());
+            clean.resize(clean.size() + 5*N/2);
+        }
+
+        for (const double cfo : {0.0, 1.37})
+        {
+            std::cout << "testing incremental demod SF " << SF << ", cfo " << cfo << " bins" << std::endl;
+            auto samps = clean;
+            for (size_t i = 0; i < samps.size(); i++)
+            {
+                samps[i] = samps[i]*std::polar(1.0f, float(2*M_PI*cfo*i/N)) + std::complex<float>(noise(rng), noise(rng));
+            }
+
+            std::vector<std::vector<uint16_t>> batch, incremental;
+            LoRaDemodulator batchDemod(SF);
+            batchDemod.setThreshold(-10.0);
+            batchDemod.setMTU(symbols.size());
+            size_t consumed = 0;
+            while (consumed + batchDemod.required() <= samps.size())
+            {
+                consumed += batchDemod.step(samps.data() + consumed);
+                if (batchDemod.packetReady()) batch.emplace_back(batchDemod.symbols(), batchDemod.symbols() + batchDemod.numSymbols());
+            }
+
+            //feed every partial symbol that arrives, step once a symbol is complete
+            LoRaDemodulator demod(SF);
+            demod.setThreshold(-10.0);
+            demod.setMTU(symbols.size());
+            demod.enableIncremental(true);
+            std::uniform_int_distribution<size_t> chunkSize(1, 3*N/2);
+            size_t arrived = 0;
+            consumed = 0;
+            while (arrived < samps.size())
+            {
+                arrived = std::min(samps.size(), arrived + chunkSize(rng));
+                demod.feed(samps.data() + consumed, arrived - consumed);
+                while (consumed + demod.required() <= arrived)
+                {
+                    consumed += demod.step(samps.data() + consumed);
+                    if (demod.packetReady()) incremental.emplace_back(demod.symbols(), demod.symbols() + demod.numSymbols());
+                    demod.feed(samps.data() + consumed, arrived - consumed);
+                }
+            }
+
+            POTHOS_TEST_EQUAL(batch.size(), size_t(2));
+            POTHOS_TEST_EQUAL(incremental.size(), batch.size());
+            for (size_t i = 0; i < batch.size(); i++)
+            {
+                POTHOS_TEST_EQUAL(batch[i].size(), symbols.size());
+                POTHOS_TEST_EQUALV(incremental[i], batch[i]);
+                POTHOS_TEST_EQUALV(batch[i], symbols);
+            }
+        }
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_demod_stats)
+{
+    //each way a frame can fail or end shows in its own counter
+    const size_t SF = 8;
+    const size_t N = 1 << SF;
+    std::mt19937 rng(0);
+    std::normal_distribution<float> noise(0.0f, 0.1f);
+
+    LoRaPacketEncoder encoder;
+    encoder.sf = SF;
+    std::vector<uint8_t> payload(32);
+    for (auto &b : payload) b = uint8_t(rng());
+    std::vector<uint16_t> symbols;
+    encoder.encode(payload.data(), payload.size(), symbols);
+
+    //modulate the first numSymbols of the packet with the given sync word, then demodulate it
+    const auto run = [&](const unsigned char sync, const size_t numSymbols, const size_t mtu)
+    {
+        LoRaModulator mod(SF);
+        mod.setAmplitude(1.0f);
+        mod.setSync(sync);
+        std::vector<std::complex<float>> samps(4*N);
+        mod.modulateFrame(symbols.data(), numSymbols, samps);
+        samps.resize(samps.size() + 8*N);
+        for (auto &s : samps) s += std::complex<float>(noise(rng), noise(rng));
+
+        LoRaDemodulator demod(SF);
+        demod.setSync(0x12);
+        demod.setThreshold(-10.0);
+        demod.setMTU(mtu);
+        size_t consumed = 0;
+        while (consumed + demod.required() <= samps.size())
+        {
+            consumed += demod.step(samps.data() + consumed);
+        }
+        return demod.stats();
+    };
+
+    //the wrong sync word never makes a frame
+    const auto mismatch = run(0x34, symbols.size(), 256);
+    POTHOS_TEST_TRUE(mismatch.syncWordMismatches > 0);
+    POTHOS_TEST_EQUAL(mismatch.frames, 0ull);
+
+    //a full packet ends on the squelch
+    const auto squelch = run(0x12, symbols.size(), 256);
+    POTHOS_TEST_EQUAL(squelch.frames, 1ull);
+    POTHOS_TEST_EQUAL(squelch.squelchEnds, 1ull);
+    POTHOS_TEST_EQUAL(squelch.mtuEnds, 0ull);
+    POTHOS_TEST_EQUAL(squelch.falseAlarms, 0ull);
+
+    //a packet longer than the MTU ends on the MTU
+    const auto mtu = run(0x12, symbols.size(), symbols.size()/2);
+    POTHOS_TEST_EQUAL(mtu.frames, 1ull);
+    POTHOS_TEST_EQUAL(mtu.mtuEnds, 1ull);
+    POTHOS_TEST_EQUAL(mtu.squelchEnds, 0ull);
+
+    //a frame that squelches before a complete header block is a false alarm
+    const auto falseAlarm = run(0x12, 3, 256);
+    POTHOS_TEST_EQUAL(falseAlarm.frames, 1ull);
+    POTHOS_TEST_EQUAL(falseAlarm.squelchEnds, 1ull);
+    POTHOS_TEST_EQUAL(falseAlarm.falseAlarms, 1ull);
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_stream_false_header)
+{
+    //the header of a packet in the stream is replaced by the header block
+    //of a longer packet, as a corrupt header that passes its checksum
+    const size_t SF = 9;
+    LoRaPacketEncoder encoder;
+    encoder.sf = SF;
+    std::vector<std::vector<uint8_t>> payloads(12);
+    std::vector<uint16_t> stream;
+    std::vector<size_t> starts;
+    for (size_t i = 0; i < payloads.size(); i++)
+    {
+        payloads[i].resize(8);
+        for (auto &b : payloads[i]) b = std::rand();
+        std::vector<uint16_t> symbols;
+        encoder.encode(payloads[i].data(), payloads[i].size(), symbols);
+        starts.push_back(stream.size());
+        stream.insert(stream.end(), symbols.begin(), symbols.end());
+    }
+    std::vector<uint8_t> longPayload(48);
+    std::vector<uint16_t> longSymbols;
+    encoder.encode(longPayload.data(), longPayload.size(), longSymbols);
+    const size_t falsePacket = 2;
+    std::copy(longSymbols.begin(), longSymbols.begin() + N_HEADER_SYMBOLS, stream.begin() + starts[falsePacket]);
+
+    LoRaStreamFramer framer;
+    framer.setSpreadFactor(SF);
+    LoRaPacketDecoder decoder;
+    decoder.sf = SF;
+    decoder.errorCheck = true;
+    decoder.crcc = true;
+
+    //the false packet fails its crc, and the packets that it claimed are still found
+    std::vector<size_t> decoded;
+    for (const auto sym : stream)
+    {
+        framer.push(sym);
+        if (not framer.packetReady()) continue;
+        if (decoder.decode(framer.symbols(), framer.numSymbols()) != LoRaPacketDecoder::DECODE_OK) continue;
+        for (size_t i = 0; i < payloads.size(); i++)
+        {
+            if (decoder.length() == payloads[i].size() and std::equal(payloads[i].begin(), payloads[i].end(), decoder.payload())) decoded.push_back(i);
+        }
+    }
+    std::vector<size_t> expected;
+    for (size_t i = 0; i < payloads.size(); i++) if (i != falsePacket) expected.push_back(i);
+    POTHOS_TEST_EQUALV(decoded, expected);
+    POTHOS_TEST_TRUE(framer.slips() > 0);
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_stream_resync)
+{
+    //a stream with a preamble every few packets, received through fades and from a late start
+    const size_t SF = 9;
+    const size_t N = 1 << SF;
+    const size_t resync = 8;
+    std::mt19937 rng(0);
+    std::normal_distribution<float> noise(0.0f, 0.3f);
+
+    LoRaPacketEncoder encoder;
+    encoder.sf = SF;
+    std::vector<std::vector<uint8_t>> payloads(5*resync);
+    std::vector<std::vector<uint16_t>> packets(payloads.size());
+    for (size_t i = 0; i < payloads.size(); i++)
+    {
+        payloads[i].resize(1 + rng() % 32);
+        for (auto &b : payloads[i]) b = uint8_t(rng());
+        encoder.encode(payloads[i].data(), payloads[i].size(), packets[i]);
+    }
+
+    LoRaModulator mod(SF);
+    mod.setAmplitude(1.0f);
+    mod.setPadding(4);
+    mod.enableStreaming(true);
+    mod.setPilotInterval(16);
+    mod.setResyncInterval(resync);
+    std::vector<std::complex<float>> samps(4*N);
+    std::vector<size_t> starts(1, samps.size());
+    mod.start(packets[0].data(), packets[0].size());
+    std::string id;
+    bool txEnd = false;
+    while (mod.active())
+    {
+        if (mod.streamWaiting())
+        {
+            if (starts.size() == packets.size()) mod.endStream();
+            else
+            {
+                mod.stream(packets[starts.size()].data(), packets[starts.size()].size());
+                starts.push_back(samps.size());
+            }
+        }
+        const size_t offset = samps.size();
+        samps.resize(offset + mod.maxStepSamples());
+        samps.resize(offset + mod.step(samps.data() + offset, id, txEnd));
+    }
+
+    //fades of a few symbols in the middle of some packets
+    const std::vector<size_t> faded = {5, 13, 20};
+    for (const auto i : faded)
+    {
+        std::fill(samps.begin() + starts[i] + 12*N, samps.begin() + starts[i] + 14*N, std::complex<float>());
+    }
+    for (auto &s : samps) s += std::complex<float>(noise(rng), noise(rng));
+
+    //receive from the given sample, return the indexes of the decoded packets
+    const auto receive = [&](const size_t begin, LoRaDemodStats &stats)
+    {
+        LoRaDemodulator demod(SF);
+        demod.setThreshold(-10.0);
+        demod.enableStreaming(true);
+        demod.setPilotInterval(16);
+        demod.setResyncInterval(resync);
+        LoRaPacketDecoder decoder;
+        decoder.sf = SF;
+        decoder.errorCheck = true;
+        decoder.crcc = true;
+
+        std::vector<size_t> decoded;
+        size_t consumed = begin;
+        while (consumed + demod.required() <= samps.size())
+        {
+            consumed += demod.step(samps.data() + consumed);
+            if (not demod.packetReady()) continue;
+            if (decoder.decode(demod.symbols(), demod.numSymbols()) != LoRaPacketDecoder::DECODE_OK) continue;
+            for (size_t i = 0; i < payloads.size(); i++)
+            {
+                if (decoder.length() == payloads[i].size() and std::equal(payloads[i].begin(), payloads[i].end(), decoder.payload())) decoded.push_back(i);
+            }
+        }
+        stats = demod.stats();
+        return decoded;
+    };
+
+    //the fades cost at most the faded packets, and the stream runs through them
+    LoRaDemodStats stats;
+    const auto decoded = receive(0, stats);
+    std::cout << "through fades: " << decoded.size() << "/" << payloads.size() << " packets" << std::endl;
+    size_t next = 0;
+    for (const auto i : decoded)
+    {
+        for (; next < i; next++) POTHOS_TEST_TRUE(std::find(faded.begin(), faded.end(), next) != faded.end());
+        POTHOS_TEST_EQUAL(i, next++);
+    }
+    POTHOS_TEST_EQUAL(next, payloads.size());
+    POTHOS_TEST_EQUAL(stats.frames, 5ull);
+    POTHOS_TEST_EQUAL(stats.resyncs, 5ull);
+    POTHOS_TEST_EQUAL(stats.squelchEnds, 0ull);
+
+    //a receiver that starts in the middle of the first packets acquires the next preamble
+    const auto late = receive(starts[3] + N/3, stats);
+    std::cout << "late start: " << late.size() << "/" << payloads.size() << " packets" << std::endl;
+    std::vector<size_t> expected;
+    for (size_t i = resync; i < payloads.size(); i++)
+    {
+        if (std::find(faded.begin(), faded.end(), i) == faded.end()) expected.push_back(i);
+    }
+    POTHOS_TEST_EQUALV(late, expected);
+}
@@ -3,8 +3,10 @@
 
 #include <Pothos/Testing.hpp>
 #include "LoRaDetector.hpp"
+#include "LoRaNoiseFloor.hpp"
 #include "ChirpGenerator.hpp"
 #include <iostream>
+#include <random>
 
 POTHOS_TEST_BLOCK("/lora/tests", test_detector)
 {
@@ -33,3 +35,124 @@ POTHOS_TEST_BLOCK("/lora/tests", test_detector)
         POTHOS_TEST_TRUE(power > -10.0);
     }
 }
+
+POTHOS_TEST_BLOCK("/lora/tests", test_pair_detector)
+{
+    std::mt19937 rng(0);
+    std::normal_distribution<float> dist;
+    for (size_t SF = 7; SF <= 12; SF++)
+    {
+        const size_t N = 1 << SF;
+        std::cout << "testing pair detector N = " << N << std::endl;
+
+        //the incremental detector transforms each channel separately
+        LoRaDetector<float> pair(N, 2);
+        LoRaDetector<float> separate(N, 2);
+        separate.enableIncremental(true);
+
+        //the same tone on both channels with independent fades and noise
+        for (size_t sym = 0; sym < N; sym += N/8 + 1)
+        {
+            const float fade0 = 0.2f + (sym % 3)*0.4f, fade1 = 1.2f - fade0;
+            for (size_t i = 0; i < N; i++)
+            {
+                const auto tone = std::polar(1.0f, float(2*M_PI*(sym+0.3)*i/N));
+                const auto samp0 = fade0*tone + 0.3f*std::complex<float>(dist(rng), dist(rng));
+                const auto samp1 = fade1*tone*std::polar(1.0f, 1.1f) + 0.3f*std::complex<float>(dist(rng), dist(rng));
+                pair.feed(i, samp0, 0);
+                pair.feed(i, samp1, 1);
+                separate.feed(i, samp0, 0);
+                separate.feed(i, samp1, 1);
+            }
+            std::vector<std::complex<float>> fft0(N), fft1(N);
+            float power0, powerAvg0, fIndex0;
+            float power1, powerAvg1, fIndex1;
+            const size_t index0 = pair.detect(power0, powerAvg0, fIndex0, fft0.data());
+            const size_t index1 = separate.detect(power1, powerAvg1, fIndex1, fft1.data());
+            POTHOS_TEST_EQUAL(index0, sym);
+            POTHOS_TEST_EQUAL(index1, sym);
+            POTHOS_TEST_CLOSE(power0, power1, 1e-3);
+            POTHOS_TEST_CLOSE(powerAvg0, powerAvg1, 1e-3);
+            POTHOS_TEST_CLOSE(fIndex0, fIndex1, 1e-3);
+            for (size_t i = 0; i < N; i++) POTHOS_TEST_CLOSE(std::abs(fft0[i] - fft1[i]), 0.0f, 1e-2);
+        }
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_noise_floor)
+{
+    const size_t N = 1 << 8;
+    const double pfa = 1e-2;
+    LoRaDetector<float> detector(N);
+    LoRaNoiseFloor noiseFloor;
+    std::mt19937 rng(0);
+    std::normal_distribution<float> dist;
+
+    //the threshold should rise with the interference level and hold the false alarm rate
+    float lastThreshold = -100.0f;
+    for (const float tone : {0.0f, 0.03f})
+    {
+        noiseFloor.reset();
+        size_t symbols = 0, alarms = 0;
+        for (size_t sym = 0; sym < 20000; sym++)
+        {
+            for (size_t i = 0; i < N; i++)
+            {
+                const auto interferer = std::polar(tone*std::sqrt(float(N)), float(0.3*i + sym));
+                detector.feed(i, std::complex<float>(dist(rng), dist(rng)) + interferer);
+            }
+            float power, powerAvg, fIndex;
+            detector.detect(power, powerAvg, fIndex);
+            const float snr = power-powerAvg;
+            if (sym >= 2000)
+            {
+                symbols++;
+                if (snr > noiseFloor.threshold(pfa)) alarms++;
+            }
+            noiseFloor.update(snr);
+        }
+        const double rate = double(alarms)/symbols;
+        std::cout << "tone " << tone << " floor " << noiseFloor.floor() << " dB, threshold "
+            << noiseFloor.threshold(pfa) << " dB, false alarm rate " << rate << std::endl;
+        POTHOS_TEST_TRUE(noiseFloor.ready());
+        POTHOS_TEST_TRUE(noiseFloor.threshold(pfa) > lastThreshold + 3.0f);
+        POTHOS_TEST_TRUE(rate < pfa*3);
+        if (tone == 0.0f) POTHOS_TEST_TRUE(rate > pfa/3);
+        lastThreshold = noiseFloor.threshold(pfa);
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_incremental_detector)
+{
+    std::mt19937 rng(0);
+    std::normal_distribution<float> dist;
+    for (size_t SF = 7; SF <= 12; SF++)
+    {
+        const size_t N = 1 << SF;
+        std::cout << "testing incremental detector N = " << N << std::endl;
+        LoRaDetector<float> detector(N);
+        LoRaDetector<float> incremental(N);
+        incremental.enableIncremental(true);
+
+        //tone plus noise, both detectors see the same input in order
+        for (size_t sym = 0; sym < N; sym += N/8 + 1)
+        {
+            for (size_t i = 0; i < N; i++)
+            {
+                const auto samp = std::polar(1.0f, float(2*M_PI*(sym+0.3)*i/N)) + 0.1f*std::complex<float>(dist(rng), dist(rng));
+                detector.feed(i, samp);
+                incremental.feed(i, samp);
+            }
+            std::vector<std::complex<float>> fft0(N), fft1(N);
+            float power0, powerAvg0, fIndex0;
+            float power1, powerAvg1, fIndex1;
+            const size_t index0 = detector.detect(power0, powerAvg0, fIndex0, fft0.data());
+            const size_t index1 = incremental.detect(power1, powerAvg1, fIndex1, fft1.data());
+            POTHOS_TEST_EQUAL(index0, sym);
+            POTHOS_TEST_EQUAL(index1, sym);
+            POTHOS_TEST_CLOSE(power0, power1, 1e-3);
+            POTHOS_TEST_CLOSE(fIndex0, fIndex1, 1e-3);
+            for (size_t i = 0; i < N; i++) POTHOS_TEST_CLOSE(std::abs(fft0[i] - fft1[i]), 0.0f, 1e-2);
+        }
+    }
+}
@@ -0,0 +1,93 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Testing.hpp>
+#include "tools/LoRaDesign.hpp"
+#include <json.hpp>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+
+using json = nlohmann::json;
+
+/***********************************************************************
+ * Conversion of the simulation example for the headless runner,
+ * with block descriptions that stand in for the plugin registry.
+ **********************************************************************/
+
+namespace
+{
+    std::string examplesDir(void)
+    {
+        #ifdef LORA_EXAMPLES_DIR
+        return LORA_EXAMPLES_DIR;
+        #else
+        return "examples";
+        #endif
+    }
+
+    //! The demod takes the spread factor and a default threshold, other blocks take nothing
+    json describeStub(const std::string &path)
+    {
+        if (path == "/lora/lora_demod") return json::parse(R"({
+            "params": [{"key": "sf"}, {"key": "sync"}, {"key": "far", "default": "0.0"}],
+            "args": ["sf"],
+            "calls": [{"name": "setSync", "args": ["sync"]}, {"name": "setFalseAlarmRate", "args": ["far"]}]})");
+        return json::parse(R"({"params": [], "args": [], "calls": []})");
+    }
+
+    bool hasConnection(const json &topology, const std::vector<std::string> &edge)
+    {
+        for (const auto &c : topology["connections"])
+        {
+            if (c.get<std::vector<std::string>>() == edge) return true;
+        }
+        return false;
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_headless_convert)
+{
+    std::ifstream file(examplesDir() + "/lora_simulation.pth");
+    POTHOS_TEST_TRUE(file.good());
+    const auto design = json::parse(file);
+
+    DesignOptions options;
+    options.globals["SF"] = "12";
+    std::stringstream log;
+    const auto topology = convertDesign(design, options, &describeStub, log);
+    std::cout << log.str();
+
+    //the plotters and widgets are stripped, the frequency demods only fed plotters,
+    //the disabled blocks are left out, and the decoder stays as a LoRa block
+    std::vector<std::string> ids;
+    for (const auto &block : topology["blocks"]) ids.push_back(block["id"].get<std::string>());
+    std::sort(ids.begin(), ids.end());
+    const std::vector<std::string> expected = {
+        "Arithmetic0", "Evaluator0", "LoRaDecoder0", "LoRaDemod0", "LoRaEncoder0",
+        "LoRaMod0", "LoRaTestGen0", "NoiseSource1", "Pacer0", "Rotate0"};
+    POTHOS_TEST_TRUE(ids == expected);
+    POTHOS_TEST_TRUE(log.str().find("prune FreqDemod0") != std::string::npos);
+    POTHOS_TEST_TRUE(log.str().find("prune FreqDemod1") != std::string::npos);
+
+    //the breakers are joined into the connections they stand for
+    POTHOS_TEST_EQUAL(topology["connections"].size(), size_t(9));
+    POTHOS_TEST_TRUE(hasConnection(topology, {"LoRaMod0", "0", "Arithmetic0", "1"}));
+    POTHOS_TEST_TRUE(hasConnection(topology, {"Rotate0", "0", "LoRaDemod0", "0"}));
+    POTHOS_TEST_TRUE(hasConnection(topology, {"LoRaDemod0", "0", "LoRaDecoder0", "0"}));
+    POTHOS_TEST_TRUE(hasConnection(topology, {"Evaluator0", "triggered", "NoiseSource1", "setAmplitude"}));
+    POTHOS_TEST_TRUE(not hasConnection(topology, {"LoRaDemod0", "raw", "FreqDemod0", "0"}));
+
+    //the arguments and calls are the property expressions, or the defaults
+    for (const auto &block : topology["blocks"])
+    {
+        if (block["id"] != "LoRaDemod0") continue;
+        POTHOS_TEST_TRUE(block["args"] == json::array({"SF"}));
+        POTHOS_TEST_TRUE(block["calls"] == json::parse(R"([["setSync", "SYNC"], ["setFalseAlarmRate", "0.0"]])"));
+    }
+
+    //the global override replaces the value in place
+    POTHOS_TEST_EQUAL(topology["globals"].size(), size_t(4));
+    POTHOS_TEST_TRUE(topology["globals"][0] == json::parse(R"({"name": "SF", "value": "12"})"));
+}
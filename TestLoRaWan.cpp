@@ -0,0 +1,150 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Testing.hpp>
+#include <Pothos/Framework.hpp>
+#include <Pothos/Proxy.hpp>
+#include "LoRaAesCmac.hpp"
+#include <iostream>
+#include <chrono>
+#include <cstring>
+
+POTHOS_TEST_BLOCK("/lora/tests", test_aes_cmac)
+{
+    //the RFC 4493 test vectors
+    const uint8_t key[16] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+    const uint8_t msg[64] = {
+        0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+        0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+        0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+        0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10};
+    const size_t lengths[4] = {0, 16, 40, 64};
+    const uint8_t macs[4][16] = {
+        {0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28, 0x7f, 0xa3, 0x7d, 0x12, 0x9b, 0x75, 0x67, 0x46},
+        {0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44, 0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c},
+        {0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30, 0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27},
+        {0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92, 0xfc, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3c, 0xfe}};
+
+    const LoRaAesCmac cmac(key);
+    std::cout << "AES-NI " << (LoRaAesCmac::hasAesNi() ? "available" : "not available") << std::endl;
+    for (const bool aesNi : {false, LoRaAesCmac::hasAesNi()})
+    {
+        //a batch that mixes lengths, with a partial group of lanes
+        std::vector<LoRaAesCmac::Job> jobs(7);
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            jobs[i].key = &cmac;
+            jobs[i].msg = msg;
+            jobs[i].len = lengths[i % 4];
+        }
+        LoRaAesCmac::computeBatch(jobs.data(), jobs.size(), aesNi);
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            POTHOS_TEST_EQUALA(jobs[i].mac, macs[i % 4], 16);
+        }
+
+        //the rate for uplink sized messages
+        jobs.resize(1 << 16);
+        for (auto &job : jobs) job = {&cmac, msg, 16 + 27, {}};
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        LoRaAesCmac::computeBatch(jobs.data(), jobs.size(), aesNi);
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        std::cout << (aesNi ? "AES-NI" : "portable") << " MIC rate "
+            << jobs.size()/std::chrono::duration<double>(t1-t0).count()/1e6 << " M/s" << std::endl;
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_lorawan_frame)
+{
+    auto env = Pothos::ProxyEnvironment::make("managed");
+    auto registry = env->findProxy("Pothos/BlockRegistry");
+
+    const uint8_t key[16] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+    const LoRaAesCmac cmac(key);
+
+    //an unconfirmed data up frame from device 26011BDA with a MIC over B0 and the frame
+    auto makeFrame = [&](const uint32_t devAddr, const uint32_t fCnt, const bool corrupt)
+    {
+        const uint8_t frame[] = {0x40,
+            uint8_t(devAddr), uint8_t(devAddr >> 8), uint8_t(devAddr >> 16), uint8_t(devAddr >> 24),
+            0x00, uint8_t(fCnt), uint8_t(fCnt >> 8), 0x01, 'h', 'e', 'l', 'l', 'o'};
+        std::vector<uint8_t> block(16 + sizeof(frame));
+        block[0] = 0x49;
+        std::memcpy(block.data() + 6, frame + 1, 4);
+        for (size_t i = 0; i < 4; i++) block[10+i] = uint8_t(fCnt >> (8*i));
+        block[15] = sizeof(frame);
+        std::memcpy(block.data() + 16, frame, sizeof(frame));
+        uint8_t mac[16];
+        cmac.compute(block.data(), block.size(), mac);
+        if (corrupt) mac[0] ^= 1;
+
+        Pothos::Packet pkt;
+        pkt.payload = Pothos::BufferChunk(typeid(uint8_t), sizeof(frame) + 4);
+        std::memcpy(pkt.payload.as<void *>(), frame, sizeof(frame));
+        std::memcpy(pkt.payload.as<uint8_t *>() + sizeof(frame), mac, 4);
+        return pkt;
+    };
+
+    auto feeder = registry.call("/blocks/feeder_source", "uint8");
+    auto frame = registry.call("/lora/lorawan_frame");
+    auto collector = registry.call("/blocks/collector_sink", "uint8");
+    frame.call("setSessions", std::vector<std::string>(1, "26011BDA:2B7E151628AED2A6ABF7158809CF4F3C"));
+
+    feeder.call("feedPacket", makeFrame(0x26011BDA, 1, false));
+    feeder.call("feedPacket", makeFrame(0x26011BDA, 2, true)); //bad MIC
+    feeder.call("feedPacket", makeFrame(0x26011BDB, 2, false)); //foreign
+    feeder.call("feedPacket", makeFrame(0x26011BDA, 1, false)); //replay
+    feeder.call("feedPacket", makeFrame(0x26011BDA, 3, false));
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, frame, 0);
+        topology.connect(frame, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.1, 0));
+    }
+
+    const auto packets = collector.call<std::vector<Pothos::Packet>>("getPackets");
+    POTHOS_TEST_EQUAL(packets.size(), size_t(2));
+    POTHOS_TEST_EQUAL(packets[0].metadata.at("devAddr").convert<std::string>(), "26011BDA");
+    POTHOS_TEST_EQUAL(packets[0].metadata.at("fCnt").convert<unsigned long long>(), 1ull);
+    POTHOS_TEST_EQUAL(packets[1].metadata.at("fCnt").convert<unsigned long long>(), 3ull);
+    POTHOS_TEST_EQUAL(packets[1].metadata.at("fPort").convert<int>(), 1);
+
+    const auto stats = frame.call<Pothos::ObjectKwargs>("getStats");
+    POTHOS_TEST_EQUAL(stats.at("forwarded").convert<unsigned long long>(), 2ull);
+    POTHOS_TEST_EQUAL(stats.at("failedMic").convert<unsigned long long>(), 1ull);
+    POTHOS_TEST_EQUAL(stats.at("foreign").convert<unsigned long long>(), 1ull);
+    POTHOS_TEST_EQUAL(stats.at("replayed").convert<unsigned long long>(), 1ull);
+
+    //the counter rolls over the 16 bits in the frame, an older counter is a replay
+    //rather than a roll over, and so is a jump beyond MAX_FCNT_GAP
+    frame.call("setSessions", std::vector<std::string>(1, "26011BDA:2B7E151628AED2A6ABF7158809CF4F3C"));
+    const std::vector<std::vector<uint32_t>> runs = {{0xfff0}, {0x10005, 0xfff8, 0x10006 + 20000, 0x10006 + 16000}};
+    std::vector<unsigned long long> forwarded;
+    unsigned long long replayed = 0, failedMic = 0;
+    for (const auto &run : runs)
+    {
+        for (const auto fCnt : run) feeder.call("feedPacket", makeFrame(0x26011BDA, fCnt, false));
+        auto runCollector = registry.call("/blocks/collector_sink", "uint8");
+        {
+            Pothos::Topology topology;
+            topology.connect(feeder, 0, frame, 0);
+            topology.connect(frame, 0, runCollector, 0);
+            topology.commit();
+            POTHOS_TEST_TRUE(topology.waitInactive(0.1, 0));
+        }
+        for (const auto &pkt : runCollector.call<std::vector<Pothos::Packet>>("getPackets"))
+        {
+            forwarded.push_back(pkt.metadata.at("fCnt").convert<unsigned long long>());
+        }
+        const auto runStats = frame.call<Pothos::ObjectKwargs>("getStats");
+        replayed += runStats.at("replayed").convert<unsigned long long>();
+        failedMic += runStats.at("failedMic").convert<unsigned long long>();
+    }
+    const std::vector<unsigned long long> expected = {0xfff0, 0x10005, 0x10006 + 16000};
+    POTHOS_TEST_TRUE(forwarded == expected);
+    POTHOS_TEST_EQUAL(replayed, 2ull);
+    POTHOS_TEST_EQUAL(failedMic, 0ull);
+}
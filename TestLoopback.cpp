@@ -6,11 +6,91 @@
 #include <Pothos/Proxy.hpp>
 #include <Pothos/Remote.hpp>
 #include <iostream>
+#include <functional>
+#include <random>
+#include <algorithm>
 #include "LoRaCodes.hpp"
 #include <json.hpp>
 
 using json = nlohmann::json;
 
+namespace
+{
+    Pothos::Proxy getBlockRegistry(void)
+    {
+        return Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    }
+
+    /*!
+     * Run the packets of the feeder through a loopback topology:
+     * the blocks of the tx chain and then the rx chain connect in series,
+     * with Gaussian noise of the given amplitude added to the signal
+     * on the way to each of the first numInputs inputs of the rx chain.
+     * The transmitter runs at unit amplitude with padding between packets,
+     * and the receiver with a symbol MTU long enough for any test packet.
+     * The optional connectExtra adds connections such as signal collectors.
+     * \return the collector of the packets out of the rx chain
+     */
+    Pothos::Proxy runLoopback(const Pothos::Proxy &feeder,
+        const std::vector<Pothos::Proxy> &tx, const std::vector<Pothos::Proxy> &rx,
+        const double noiseAmplitude, const size_t numInputs = 1,
+        const std::function<void(Pothos::Topology &)> &connectExtra = nullptr)
+    {
+        auto registry = getBlockRegistry();
+        auto collector = registry.call("/blocks/collector_sink", "uint8");
+        tx.back().call("setAmplitude", 1.0);
+        tx.back().call("setPadding", 512);
+        rx.front().call("setMTU", 512);
+
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, tx.front(), 0);
+        for (size_t i = 1; i < tx.size(); i++) topology.connect(tx[i-1], 0, tx[i], 0);
+        for (size_t i = 0; i < numInputs; i++)
+        {
+            auto adder = registry.call("/comms/arithmetic", "complex_float32", "ADD");
+            auto noise = registry.call("/comms/noise_source", "complex_float32");
+            noise.call("setAmplitude", noiseAmplitude);
+            noise.call("setWaveform", "NORMAL");
+            topology.connect(tx.back(), 0, adder, 0);
+            topology.connect(noise, 0, adder, 1);
+            topology.connect(adder, 0, rx.front(), i);
+        }
+        for (size_t i = 1; i < rx.size(); i++) topology.connect(rx[i-1], 0, rx[i], 0);
+        topology.connect(rx.back(), 0, collector, 0);
+        if (connectExtra) connectExtra(topology);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive(0.1, 0));
+        return collector;
+    }
+
+    //! The dictionary argument of a signal message from a collector
+    Pothos::ObjectKwargs signalArgs(const Pothos::Object &msg)
+    {
+        return msg.extract<Pothos::ObjectVector>().at(0).extract<Pothos::ObjectKwargs>();
+    }
+
+    //! Run a test plan of random packets through a loopback and verify every packet
+    void verifyLoopback(const std::vector<Pothos::Proxy> &tx, const std::vector<Pothos::Proxy> &rx,
+        const double noiseAmplitude, const size_t numInputs = 1)
+    {
+        auto feeder = getBlockRegistry().call("/blocks/feeder_source", "uint8");
+        json testPlan;
+        testPlan["enablePackets"] = true;
+        testPlan["minValue"] = 0;
+        testPlan["maxValue"] = 255;
+        testPlan["minBuffers"] = 5;
+        testPlan["maxBuffers"] = 5;
+        testPlan["minBufferSize"] = 8;
+        testPlan["maxBufferSize"] = 128;
+        auto expected = feeder.call("feedTestPlan", testPlan.dump());
+
+        auto collector = runLoopback(feeder, tx, rx, noiseAmplitude, numInputs);
+        std::cout << "rx dropped " << rx.back().call<unsigned long long>("getDropped") << std::endl;
+        std::cout << "verifyTestPlan" << std::endl;
+        collector.call("verifyTestPlan", expected);
+    }
+}
+
 POTHOS_TEST_BLOCK("/lora/tests", test_encoder_to_decoder)
 {
     auto env = Pothos::ProxyEnvironment::make("managed");
@@ -65,18 +145,13 @@ POTHOS_TEST_BLOCK("/lora/tests", test_encoder_to_decoder)
 
 POTHOS_TEST_BLOCK("/lora/tests", test_loopback)
 {
-    auto env = Pothos::ProxyEnvironment::make("managed");
-    auto registry = env->findProxy("Pothos/BlockRegistry");
+    auto registry = getBlockRegistry();
 
     const size_t SF = 10;
-    auto feeder = registry.call("/blocks/feeder_source", "uint8");
     auto encoder = registry.call("/lora/lora_encoder");
     auto mod = registry.call("/lora/lora_mod", SF);
-    auto adder = registry.call("/comms/arithmetic", "complex_float32", "ADD");
-    auto noise = registry.call("/comms/noise_source", "complex_float32");
     auto demod = registry.call("/lora/lora_demod", SF);
     auto decoder = registry.call("/lora/lora_decoder");
-    auto collector = registry.call("/blocks/collector_sink", "uint8");
 
     std::vector<std::string> testCodingRates;
     //these first few dont have error correction
@@ -94,40 +169,348 @@ POTHOS_TEST_BLOCK("/lora/tests", test_loopback)
         decoder.call("setSpreadFactor", SF);
         encoder.call("setCodingRate", CR);
         decoder.call("setCodingRate", CR);
-        mod.call("setAmplitude", 1.0);
-        noise.call("setAmplitude", 4.0);
-        noise.call("setWaveform", "NORMAL");
-        mod.call("setPadding", 512);
-        demod.call("setMTU", 512);
+        verifyLoopback({encoder, mod}, {demod, decoder}, 4.0);
+    }
+}
 
-        //create a test plan
-        json testPlan;
-        testPlan["enablePackets"] = true;
-        testPlan["minValue"] = 0;
-        testPlan["maxValue"] = 255;
-        testPlan["minBuffers"] = 5;
-        testPlan["maxBuffers"] = 5;
-        testPlan["minBufferSize"] = 8;
-        testPlan["maxBufferSize"] = 128;
-        auto expected = feeder.call("feedTestPlan", testPlan.dump());
+POTHOS_TEST_BLOCK("/lora/tests", test_high_rate_demod)
+{
+    auto registry = getBlockRegistry();
+    std::mt19937 rng(0);
+    std::normal_distribution<float> noise(0.0f, 0.1f);
 
-        //create tester topology
+    //the high rate work() steps through whole buffers, with partial symbols
+    //at the ends of the buffers, and must match one symbol per call exactly
+    for (size_t SF = 5; SF <= 12; SF++)
+    {
+        std::cout << "Testing SF " << SF << std::endl;
+        auto encoder = registry.call("/lora/lora_encoder");
+        auto mod = registry.call("/lora/lora_mod", SF);
+        encoder.call("setSpreadFactor", SF);
+        mod.call("setAmplitude", 1.0);
+        mod.call("setPadding", 16);
+
+        //modulate a few frames once, both modes see the same samples
+        auto feeder = registry.call("/blocks/feeder_source", "uint8");
+        std::vector<std::vector<uint8_t>> expected;
+        for (size_t i = 0; i < 3; i++)
+        {
+            Pothos::Packet pkt;
+            pkt.payload = Pothos::BufferChunk(typeid(uint8_t), 8 + 12*i);
+            for (size_t j = 0; j < pkt.payload.length; j++) pkt.payload.as<uint8_t *>()[j] = uint8_t(rng());
+            expected.emplace_back(pkt.payload.as<const uint8_t *>(), pkt.payload.as<const uint8_t *>() + pkt.payload.length);
+            feeder.call("feedPacket", pkt);
+        }
+        auto modCollector = registry.call("/blocks/collector_sink", "complex_float32");
         {
             Pothos::Topology topology;
             topology.connect(feeder, 0, encoder, 0);
             topology.connect(encoder, 0, mod, 0);
-            topology.connect(mod, 0, adder, 0);
-            topology.connect(noise, 0, adder, 1);
-            topology.connect(adder, 0, demod, 0);
-            topology.connect(demod, 0, decoder, 0);
-            topology.connect(decoder, 0, collector, 0);
+            topology.connect(mod, 0, modCollector, 0);
             topology.commit();
             POTHOS_TEST_TRUE(topology.waitInactive(0.1, 0));
-            //std::cout << topology.queryJSONStats() << std::endl;
+        }
+        auto samps = modCollector.call<Pothos::BufferChunk>("getBuffer");
+        for (size_t i = 0; i < samps.elements(); i++)
+        {
+            samps.as<std::complex<float> *>()[i] += std::complex<float>(noise(rng), noise(rng));
         }
 
-        std::cout << "decoder dropped " << decoder.call<unsigned long long>("getDropped") << std::endl;
-        std::cout << "verifyTestPlan" << std::endl;
-        collector.call("verifyTestPlan", expected);
+        std::vector<std::vector<unsigned long long>> frameIndexes;
+        for (const bool highRate : {false, true})
+        {
+            auto source = registry.call("/blocks/feeder_source", "complex_float32");
+            auto demod = registry.call("/lora/lora_demod", SF);
+            auto decoder = registry.call("/lora/lora_decoder");
+            auto collector = registry.call("/blocks/collector_sink", "uint8");
+            auto frames = registry.call("/blocks/collector_sink", "uint8");
+            demod.call("setThreshold", -5.0);
+            demod.call("enableHighRate", highRate);
+            decoder.call("setSpreadFactor", SF);
+            source.call("feedBuffer", samps);
+            {
+                Pothos::Topology topology;
+                topology.connect(source, 0, demod, 0);
+                topology.connect(demod, 0, decoder, 0);
+                topology.connect(decoder, 0, collector, 0);
+                topology.connect(demod, "frameDetected", frames, 0);
+                topology.commit();
+                POTHOS_TEST_TRUE(topology.waitInactive(0.1, 0));
+            }
+
+            const auto packets = collector.call<std::vector<Pothos::Packet>>("getPackets");
+            POTHOS_TEST_EQUAL(packets.size(), expected.size());
+            for (size_t i = 0; i < packets.size(); i++)
+            {
+                POTHOS_TEST_EQUAL(packets[i].payload.length, expected[i].size());
+                POTHOS_TEST_EQUALA(packets[i].payload.as<const uint8_t *>(), expected[i].data(), expected[i].size());
+            }
+
+            frameIndexes.emplace_back();
+            for (const auto &msg : frames.call<std::vector<Pothos::Object>>("getMessages"))
+            {
+                frameIndexes.back().push_back(signalArgs(msg)["index"].convert<unsigned long long>());
+            }
+        }
+        POTHOS_TEST_EQUAL(frameIndexes[0].size(), expected.size());
+        POTHOS_TEST_EQUALV(frameIndexes[1], frameIndexes[0]);
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_low_sf_loopback)
+{
+    auto registry = getBlockRegistry();
+
+    //the SF5 and SF6 symbols of the wide bandwidth radios through the "sf" packet metadata
+    for (size_t SF = 5; SF <= 6; SF++)
+    {
+        for (const bool highRate : {false, true})
+        {
+            std::cout << "Testing SF " << SF << (highRate?" high rate":"") << std::endl;
+            auto encoder = registry.call("/lora/lora_encoder");
+            auto mod = registry.call("/lora/lora_mod", SF);
+            auto demod = registry.call("/lora/lora_demod", SF);
+            auto decoder = registry.call("/lora/lora_decoder");
+
+            encoder.call("setSpreadFactor", SF);
+            decoder.call("setSpreadFactor", SF);
+            encoder.call("setCodingRate", "4/8");
+            decoder.call("setCodingRate", "4/8");
+
+            //with so few bins, noise often looks like a preamble under the default threshold
+            demod.call("setThreshold", -5.0);
+            demod.call("enableHighRate", highRate);
+            verifyLoopback({encoder, mod}, {demod, decoder}, 0.35);
+        }
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_stream_loopback)
+{
+    auto registry = getBlockRegistry();
+
+    const size_t SF = 10;
+    auto encoder = registry.call("/lora/lora_encoder");
+    auto mod = registry.call("/lora/lora_mod", SF);
+    auto demod = registry.call("/lora/lora_demod", SF);
+    auto decoder = registry.call("/lora/lora_decoder");
+
+    encoder.call("setSpreadFactor", SF);
+    decoder.call("setSpreadFactor", SF);
+    encoder.call("setCodingRate", "4/8");
+    decoder.call("setCodingRate", "4/8");
+
+    //the packets share a preamble every other block, with pilots for tracking
+    mod.call("enableStreaming", true);
+    mod.call("setPilotInterval", 16);
+    mod.call("setResyncInterval", 2);
+    demod.call("enableStreaming", true);
+    demod.call("setPilotInterval", 16);
+    demod.call("setResyncInterval", 2);
+    verifyLoopback({encoder, mod}, {demod, decoder}, 4.0);
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_diversity_loopback)
+{
+    auto registry = getBlockRegistry();
+
+    const size_t SF = 10;
+    auto encoder = registry.call("/lora/lora_encoder");
+    auto mod = registry.call("/lora/lora_mod", SF);
+    auto demod = registry.call("/lora/lora_diversity_demod", SF);
+    auto decoder = registry.call("/lora/lora_decoder");
+
+    encoder.call("setSpreadFactor", SF);
+    decoder.call("setSpreadFactor", SF);
+    encoder.call("setCodingRate", "4/8");
+    decoder.call("setCodingRate", "4/8");
+
+    //each channel sees the same signal with independent noise
+    verifyLoopback({encoder, mod}, {demod, decoder}, 4.0, 2);
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_diversity_gain)
+{
+    auto registry = getBlockRegistry();
+
+    //at this noise one channel loses most packets, two channels lose none
+    const size_t SF = 10;
+    const size_t numPackets = 20;
+    const double noise = 5.25;
+    std::mt19937 rng(SF);
+    std::vector<Pothos::Packet> sent;
+    for (size_t i = 0; i < numPackets; i++)
+    {
+        Pothos::Packet pkt;
+        pkt.payload = Pothos::BufferChunk(typeid(uint8_t), 32);
+        for (size_t j = 0; j < pkt.payload.length; j++) pkt.payload.as<uint8_t *>()[j] = uint8_t(rng());
+        sent.push_back(pkt);
+    }
+
+    auto countDecoded = [&](const Pothos::Proxy &demod, const size_t numInputs)
+    {
+        auto feeder = registry.call("/blocks/feeder_source", "uint8");
+        auto encoder = registry.call("/lora/lora_encoder");
+        auto mod = registry.call("/lora/lora_mod", SF);
+        auto decoder = registry.call("/lora/lora_decoder");
+        encoder.call("setSpreadFactor", SF);
+        decoder.call("setSpreadFactor", SF);
+        encoder.call("setCodingRate", "4/8");
+        decoder.call("setCodingRate", "4/8");
+        decoder.call("enableErrorCheck", true);
+        for (const auto &pkt : sent) feeder.call("feedPacket", pkt);
+
+        auto collector = runLoopback(feeder, {encoder, mod}, {demod, decoder}, noise, numInputs);
+        size_t decoded = 0;
+        for (const auto &pkt : collector.call<std::vector<Pothos::Packet>>("getPackets"))
+        {
+            for (const auto &ref : sent)
+            {
+                if (pkt.payload.length != ref.payload.length) continue;
+                if (not std::equal(ref.payload.as<const uint8_t *>(), ref.payload.as<const uint8_t *>() + ref.payload.length,
+                    pkt.payload.as<const uint8_t *>())) continue;
+                decoded++;
+                break;
+            }
+        }
+        return decoded;
+    };
+
+    const auto single = countDecoded(registry.call("/lora/lora_demod", SF), 1);
+    const auto diversity = countDecoded(registry.call("/lora/lora_diversity_demod", SF), 2);
+    std::cout << "single channel " << single << "/" << numPackets
+        << ", diversity " << diversity << "/" << numPackets << std::endl;
+    POTHOS_TEST_TRUE(single <= numPackets/2);
+    POTHOS_TEST_TRUE(diversity >= numPackets - 1);
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_tx_loopback)
+{
+    auto registry = getBlockRegistry();
+
+    const size_t SF = 10;
+    auto tx = registry.call("/lora/lora_tx", SF);
+    auto demod = registry.call("/lora/lora_demod", SF);
+    auto decoder = registry.call("/lora/lora_decoder");
+
+    tx.call("setCodingRate", "4/8");
+    decoder.call("setSpreadFactor", SF);
+    decoder.call("setCodingRate", "4/8");
+    verifyLoopback({tx}, {demod, decoder}, 4.0);
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_rx_loopback)
+{
+    auto registry = getBlockRegistry();
+
+    const size_t SF = 10;
+    auto tx = registry.call("/lora/lora_tx", SF);
+    auto rx = registry.call("/lora/lora_rx", SF);
+
+    tx.call("setCodingRate", "4/8");
+    rx.call("setCodingRate", "4/8");
+    verifyLoopback({tx}, {rx}, 4.0);
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_per_packet_settings)
+{
+    auto registry = getBlockRegistry();
+
+    //one encoder, modulator, and decoder with default settings,
+    //the spread factor and coding rate come from the packet metadata
+    auto feeder = registry.call("/blocks/feeder_source", "uint8");
+    auto encoder = registry.call("/lora/lora_encoder");
+    auto mod = registry.call("/lora/lora_mod", 10);
+    auto decoder = registry.call("/lora/lora_decoder");
+    mod.call("setMaxSpreadFactor", 12);
+
+    const std::vector<std::pair<size_t, std::string>> settings = {{8, "4/5"}, {11, "4/7"}};
+    for (const auto &setting : settings)
+    {
+        const size_t SF = setting.first;
+        std::cout << "Testing SF " << SF << " with CR " << setting.second << std::endl;
+        auto demod = registry.call("/lora/lora_demod", SF);
+
+        Pothos::Packet pkt;
+        pkt.payload = Pothos::BufferChunk(typeid(uint8_t), 32);
+        for (size_t i = 0; i < pkt.payload.length; i++) pkt.payload.as<uint8_t *>()[i] = uint8_t(i*SF);
+        pkt.metadata["sf"] = Pothos::Object(SF);
+        pkt.metadata["cr"] = Pothos::Object(setting.second);
+        feeder.call("feedPacket", pkt);
+
+        auto collector = runLoopback(feeder, {encoder, mod}, {demod, decoder}, 1.0);
+        auto packets = collector.call<std::vector<Pothos::Packet>>("getPackets");
+        POTHOS_TEST_EQUAL(packets.size(), 1);
+        POTHOS_TEST_EQUALA(packets[0].payload.as<const uint8_t *>(), pkt.payload.as<const uint8_t *>(), pkt.payload.length);
+    }
+}
+
+POTHOS_TEST_BLOCK("/lora/tests", test_frame_events)
+{
+    auto registry = getBlockRegistry();
+
+    const size_t SF = 9;
+    const size_t N = 1 << SF;
+    auto feeder = registry.call("/blocks/feeder_source", "uint8");
+    auto encoder = registry.call("/lora/lora_encoder");
+    auto mod = registry.call("/lora/lora_mod", SF);
+    auto demod = registry.call("/lora/lora_demod", SF);
+    auto decoder = registry.call("/lora/lora_decoder");
+    encoder.call("setSpreadFactor", SF);
+    decoder.call("setSpreadFactor", SF);
+    encoder.call("enableCrc", false);
+    decoder.call("setDataLength", 16);
+
+    for (const bool explicitHeader : {true, false})
+    {
+        std::cout << "Testing " << (explicitHeader ? "explicit" : "implicit") << " header" << std::endl;
+        encoder.call("enableExplicit", explicitHeader);
+        demod.call("enableExplicit", explicitHeader);
+        decoder.call("enableExplicit", explicitHeader);
+
+        const size_t numFrames = 3;
+        for (size_t i = 0; i < numFrames; i++)
+        {
+            Pothos::Packet pkt;
+            pkt.payload = Pothos::BufferChunk(typeid(uint8_t), 16);
+            for (size_t j = 0; j < pkt.payload.length; j++) pkt.payload.as<uint8_t *>()[j] = uint8_t(i*31 + j);
+            feeder.call("feedPacket", pkt);
+        }
+
+        auto frames = registry.call("/blocks/collector_sink", "uint8");
+        auto headers = registry.call("/blocks/collector_sink", "uint8");
+        auto collector = runLoopback(feeder, {encoder, mod}, {demod, decoder}, 1.0, 1, [&](Pothos::Topology &topology)
+        {
+            topology.connect(demod, "frameDetected", frames, 0);
+            topology.connect(demod, "headerDecoded", headers, 0);
+        });
+        const auto packets = collector.call<std::vector<Pothos::Packet>>("getPackets");
+        const auto frameEvents = frames.call<std::vector<Pothos::Object>>("getMessages");
+        const auto headerEvents = headers.call<std::vector<Pothos::Object>>("getMessages");
+        POTHOS_TEST_EQUAL(packets.size(), numFrames);
+        POTHOS_TEST_EQUAL(frameEvents.size(), numFrames);
+
+        //an implicit header link has no header to report
+        POTHOS_TEST_EQUAL(headerEvents.size(), explicitHeader ? numFrames : 0);
+
+        //each frame is detected, then its header decodes, then its packet completes before the next frame
+        for (size_t i = 0; i < numFrames; i++)
+        {
+            auto frame = signalArgs(frameEvents[i]);
+            const auto frameIndex = frame["index"].convert<unsigned long long>();
+            POTHOS_TEST_EQUAL(frame["sf"].convert<size_t>(), SF);
+            if (not explicitHeader) continue;
+
+            auto header = signalArgs(headerEvents[i]);
+            const auto headerIndex = header["index"].convert<unsigned long long>();
+            const auto endIndex = header["endIndex"].convert<unsigned long long>();
+            POTHOS_TEST_TRUE(frameIndex < headerIndex);
+            POTHOS_TEST_TRUE(headerIndex + 2 >= frameIndex + 8*N and headerIndex <= frameIndex + 8*N + 2);
+            POTHOS_TEST_TRUE(headerIndex < endIndex);
+            if (i+1 < numFrames) POTHOS_TEST_TRUE(endIndex < signalArgs(frameEvents[i+1])["index"].convert<unsigned long long>());
+            POTHOS_TEST_EQUAL(header["length"].convert<size_t>(), packets[i].payload.length);
+            POTHOS_TEST_EQUAL(header["crc"].convert<bool>(), false);
+            POTHOS_TEST_EQUAL(header["cr"].convert<std::string>(), "4/8");
+        }
     }
 }
@@ -0,0 +1,81 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+
+/***********************************************************************
+ * Command line options of the benchmarks.
+ *
+ * Each benchmark lists its --name=value options in one table
+ * with the setter of each option into its config,
+ * and the same table prints the usage.
+ **********************************************************************/
+
+//! One --name=value option, the value in the usage is the default
+struct BenchOption
+{
+    std::string name;
+    std::string value;
+    std::string help;
+    std::function<void(const std::string &)> set;
+};
+
+//! Parse a comma separated list of numbers
+template <typename T>
+std::vector<T> parseList(const std::string &s)
+{
+    std::vector<T> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) out.push_back(T(std::stod(item)));
+    return out;
+}
+
+//! Apply the arguments to the options, false on an unknown option or a bad value
+inline bool parseOptions(int argc, char **argv, const std::vector<BenchOption> &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        const auto eq = arg.find('=');
+        const auto key = arg.substr(0, eq);
+        const auto value = (eq == std::string::npos) ? std::string() : arg.substr(eq+1);
+        const auto it = std::find_if(options.begin(), options.end(),
+            [&key](const BenchOption &opt){return key == "--" + opt.name;});
+        if (it == options.end()) return false;
+        try
+        {
+            it->set(value);
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//! Print the summary line and the options in aligned columns
+inline void printUsage(const std::string &summary, const std::vector<BenchOption> &options)
+{
+    std::vector<std::string> args;
+    size_t width = 0;
+    for (const auto &opt : options)
+    {
+        args.push_back("--" + opt.name + (opt.value.empty() ? "" : "=" + opt.value));
+        width = std::max(width, args.back().size());
+    }
+    std::cerr << summary << std::endl;
+    for (size_t i = 0; i < options.size(); i++)
+    {
+        std::cerr << "  " << std::left << std::setw(int(width + 3)) << args[i] << options[i].help << std::endl;
+    }
+}
@@ -0,0 +1,312 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include "LoRaPacketEncoder.hpp"
+#include "LoRaPacketDecoder.hpp"
+#include "LoRaModulator.hpp"
+#include "LoRaDemodulator.hpp"
+#include "LoRaCodes.hpp"
+#include "BenchArgs.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <map>
+#include <ctime>
+#include <cmath>
+#include <cstdlib>
+
+/***********************************************************************
+ * Gateway capacity benchmark: decoded packets per second
+ * versus the offered ALOHA load.
+ *
+ * Each channel carries Poisson arrivals of packets on random spread factors
+ * at random SNRs, summed over unit power noise at one sample per chip.
+ * One demodulator and decoder per channel and spread factor receive
+ * every channel, as the LoRa Demod and LoRa Decoder blocks of a
+ * multi-channel RX topology would, spread over a pool of threads.
+ * The load is the offered airtime per channel in Erlangs.
+ *
+ * Every transmitted packet is either decoded, or lost to a collision
+ * with a packet of the same spread factor, to a missed sync,
+ * or to a decode error after sync. The results print as CSV.
+ **********************************************************************/
+
+struct BenchConfig
+{
+    size_t channels = 1;
+    std::vector<size_t> sfs = {7, 8, 9, 10, 11, 12};
+    std::vector<double> loads = {0.1, 0.2, 0.5, 1.0, 2.0};
+    double duration = 60.0;
+    double bw = 125e3;
+    double snrMin = -10.0;
+    double snrMax = 10.0;
+    std::string cr = "4/5";
+    size_t length = 16;
+    double threshold = -30.0;
+    double far = 1e-3;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    unsigned seed = 1;
+};
+
+struct TxPacket
+{
+    size_t channel;
+    size_t sf;
+    size_t start;
+    size_t dataStart;
+    size_t end;
+    bool collided;
+    std::vector<uint8_t> payload;
+};
+
+struct RxPacket
+{
+    unsigned long long index;
+    bool decoded;
+    std::vector<uint8_t> payload;
+};
+
+struct RxJob
+{
+    size_t channel;
+    size_t sf;
+    std::vector<RxPacket> packets;
+    double cpuTime;
+};
+
+static double threadCpuTime(void)
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+//! The options of the benchmark, which set the fields of the config
+static std::vector<BenchOption> benchOptions(BenchConfig &cfg)
+{
+    return {
+        {"channels", "1", "number of channels", [&cfg](const std::string &v){cfg.channels = std::stoul(v);}},
+        {"sfs", "7,8,9,10,11,12", "spread factors on every channel", [&cfg](const std::string &v){cfg.sfs = parseList<size_t>(v);}},
+        {"loads", "0.1,0.2,0.5,1,2", "offered load per channel in Erlangs", [&cfg](const std::string &v){cfg.loads = parseList<double>(v);}},
+        {"duration", "60", "seconds of air per load", [&cfg](const std::string &v){cfg.duration = std::stod(v);}},
+        {"bw", "125000", "channel bandwidth in Hz", [&cfg](const std::string &v){cfg.bw = std::stod(v);}},
+        {"snr", "-10:10", "uniform SNR range in dB", [&cfg](const std::string &v)
+        {
+            const auto colon = v.find(':');
+            cfg.snrMin = std::stod(v.substr(0, colon));
+            cfg.snrMax = (colon == std::string::npos) ? cfg.snrMin : std::stod(v.substr(colon+1));
+        }},
+        {"cr", "4/5", "coding rate", [&cfg](const std::string &v){cfg.cr = v;}},
+        {"length", "16", "payload bytes", [&cfg](const std::string &v){cfg.length = std::stoul(v);}},
+        {"threshold", "-30", "demodulator threshold in dB", [&cfg](const std::string &v){cfg.threshold = std::stod(v);}},
+        {"far", "0.001", "demodulator false alarm rate", [&cfg](const std::string &v){cfg.far = std::stod(v);}},
+        {"threads", "N", "receive threads, default all cores", [&cfg](const std::string &v){cfg.threads = std::max<size_t>(1, std::stoul(v));}},
+        {"seed", "1", "traffic seed", [&cfg](const std::string &v){cfg.seed = unsigned(std::stoul(v));}},
+    };
+}
+
+static bool parseArgs(int argc, char **argv, BenchConfig &cfg)
+{
+    if (not parseOptions(argc, argv, benchOptions(cfg))) return false;
+    size_t rdd = 0;
+    if (not parseCodingRate(cfg.cr, rdd)) return false;
+    for (const auto sf : cfg.sfs) if (sf < 5 or sf > 12) return false;
+    return cfg.channels != 0 and not cfg.sfs.empty() and cfg.length >= 4;
+}
+
+static void usage(void)
+{
+    BenchConfig cfg;
+    printUsage("LoRaCapacityBench [options], prints CSV to stdout", benchOptions(cfg));
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig cfg;
+    if (not parseArgs(argc, argv, cfg))
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+    size_t rdd = 0;
+    parseCodingRate(cfg.cr, rdd);
+    const size_t numSamps = size_t(cfg.duration*cfg.bw);
+
+    //the symbols and samples of one packet for each spread factor
+    std::map<size_t, size_t> packetSymbols, packetSamples;
+    double meanAirtime = 0.0;
+    for (const auto sf : cfg.sfs)
+    {
+        LoRaPacketEncoder encoder;
+        encoder.sf = sf;
+        encoder.rdd = rdd;
+        std::vector<uint8_t> payload(cfg.length);
+        std::vector<uint16_t> symbols;
+        encoder.encode(payload.data(), payload.size(), symbols);
+        packetSymbols[sf] = symbols.size();
+        packetSamples[sf] = size_t((LoRaModulator::syncSymbols() + symbols.size())*(1 << sf));
+        meanAirtime += packetSamples[sf]/cfg.bw/cfg.sfs.size();
+    }
+
+    std::cout << "load,channels,sfs,duration_s,offered,decoded,decoded_per_s,delivery_ratio,"
+        "lost_collision,lost_no_sync,lost_decode,spurious,wall_s,cpu_s,cpu_per_core_pct,cores_needed,realtime_factor" << std::endl;
+
+    for (const auto load : cfg.loads)
+    {
+        std::mt19937 rng(cfg.seed);
+        std::normal_distribution<float> noise(0.0f, std::sqrt(0.5f));
+        std::uniform_real_distribution<double> snrDist(cfg.snrMin, cfg.snrMax);
+        std::uniform_int_distribution<size_t> sfDist(0, cfg.sfs.size()-1);
+        std::exponential_distribution<double> arrivals(load/meanAirtime);
+
+        //render the traffic of every channel
+        std::vector<std::vector<std::complex<float>>> channels(cfg.channels);
+        std::vector<TxPacket> txPackets;
+        uint32_t nextId = 0;
+        for (size_t ch = 0; ch < cfg.channels; ch++)
+        {
+            auto &samps = channels[ch];
+            samps.resize(numSamps);
+            for (auto &s : samps) s = std::complex<float>(noise(rng), noise(rng));
+
+            std::vector<std::complex<float>> frame;
+            for (double t = arrivals(rng); t < cfg.duration; t += arrivals(rng))
+            {
+                TxPacket pkt;
+                pkt.channel = ch;
+                pkt.sf = cfg.sfs[sfDist(rng)];
+                pkt.start = size_t(t*cfg.bw);
+                pkt.collided = false;
+                const size_t N = size_t(1) << pkt.sf;
+                if (pkt.start + packetSamples[pkt.sf] + N > numSamps) continue;
+
+                //a unique id leads the payload
+                pkt.payload.resize(cfg.length);
+                for (auto &b : pkt.payload) b = uint8_t(rng());
+                for (size_t i = 0; i < 4; i++) pkt.payload[i] = uint8_t(nextId >> (8*i));
+                nextId++;
+
+                LoRaPacketEncoder encoder;
+                encoder.sf = pkt.sf;
+                encoder.rdd = rdd;
+                std::vector<uint16_t> symbols;
+                encoder.encode(pkt.payload.data(), pkt.payload.size(), symbols);
+                LoRaModulator mod(pkt.sf);
+                mod.setAmplitude(std::pow(10.0f, float(snrDist(rng))/20));
+                mod.setPadding(1);
+                frame.clear();
+                mod.modulateFrame(symbols.data(), symbols.size(), frame);
+                frame.resize(std::min(frame.size(), numSamps - pkt.start));
+                for (size_t i = 0; i < frame.size(); i++) samps[pkt.start + i] += frame[i];
+                pkt.dataStart = pkt.start + size_t(LoRaModulator::syncSymbols()*N);
+                pkt.end = pkt.start + packetSamples[pkt.sf];
+                txPackets.push_back(std::move(pkt));
+            }
+        }
+
+        //mark the packets that overlap a packet of the same spread factor and channel
+        for (size_t i = 0; i < txPackets.size(); i++)
+        {
+            for (size_t j = i+1; j < txPackets.size(); j++)
+            {
+                auto &a = txPackets[i], &b = txPackets[j];
+                if (a.channel != b.channel or a.sf != b.sf) continue;
+                if (a.start < b.end and b.start < a.end) a.collided = b.collided = true;
+            }
+        }
+
+        //receive every channel and spread factor on the thread pool
+        std::vector<RxJob> jobs;
+        for (size_t ch = 0; ch < cfg.channels; ch++)
+        {
+            for (const auto sf : cfg.sfs) jobs.push_back(RxJob{ch, sf, {}, 0.0});
+        }
+        std::atomic<size_t> nextJob(0);
+        auto worker = [&](void)
+        {
+            for (size_t j = nextJob++; j < jobs.size(); j = nextJob++)
+            {
+                auto &job = jobs[j];
+                const double cpu0 = threadCpuTime();
+                LoRaDemodulator demod(job.sf);
+                demod.setThreshold(cfg.threshold);
+                demod.setFalseAlarmRate(cfg.far);
+                demod.setMTU(packetSymbols[job.sf]);
+                LoRaPacketDecoder decoder;
+                decoder.sf = job.sf;
+                decoder.rdd = rdd;
+                decoder.errorCheck = true;
+                decoder.crcc = true;
+
+                const auto &samps = channels[job.channel];
+                unsigned long long index = 0, syncIndex = 0;
+                while (index + demod.required() <= samps.size())
+                {
+                    index += demod.step(samps.data() + index);
+                    if (demod.syncFound()) syncIndex = index + demod.dataSymbolsDelay();
+                    if (not demod.packetReady()) continue;
+                    RxPacket pkt;
+                    pkt.index = syncIndex;
+                    pkt.decoded = decoder.decode(demod.symbols(), demod.numSymbols()) == LoRaPacketDecoder::DECODE_OK;
+                    if (pkt.decoded) pkt.payload.assign(decoder.payload(), decoder.payload() + decoder.length());
+                    job.packets.push_back(std::move(pkt));
+                }
+                job.cpuTime = threadCpuTime() - cpu0;
+            }
+        };
+        const size_t numThreads = std::min(cfg.threads, jobs.size());
+        const auto t0 = std::chrono::steady_clock::now();
+        std::vector<std::thread> pool;
+        for (size_t i = 0; i < numThreads; i++) pool.emplace_back(worker);
+        for (auto &t : pool) t.join();
+        const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        //match the received packets to the transmitted packets by the payload id
+        std::vector<bool> decoded(txPackets.size(), false), synced(txPackets.size(), false);
+        size_t spurious = 0;
+        double cpu = 0.0;
+        for (const auto &job : jobs)
+        {
+            cpu += job.cpuTime;
+            for (const auto &rx : job.packets)
+            {
+                bool matched = false;
+                for (size_t i = 0; i < txPackets.size(); i++)
+                {
+                    const auto &tx = txPackets[i];
+                    if (tx.channel != job.channel or tx.sf != job.sf) continue;
+                    const size_t N = size_t(1) << tx.sf;
+                    if (rx.decoded and rx.payload == tx.payload) decoded[i] = matched = true;
+                    else if (rx.index + N > tx.dataStart and rx.index < tx.dataStart + N) synced[i] = matched = true;
+                }
+                if (not matched) spurious++;
+            }
+        }
+
+        size_t numDecoded = 0, lostCollision = 0, lostNoSync = 0, lostDecode = 0;
+        for (size_t i = 0; i < txPackets.size(); i++)
+        {
+            if (decoded[i]) numDecoded++;
+            else if (txPackets[i].collided) lostCollision++;
+            else if (synced[i]) lostDecode++;
+            else lostNoSync++;
+        }
+
+        std::stringstream sfs;
+        for (size_t i = 0; i < cfg.sfs.size(); i++) sfs << (i?"/":"") << cfg.sfs[i];
+        std::cout << load << ',' << cfg.channels << ',' << sfs.str() << ',' << cfg.duration << ','
+            << txPackets.size() << ',' << numDecoded << ',' << numDecoded/cfg.duration << ','
+            << (txPackets.empty() ? 0.0 : double(numDecoded)/txPackets.size()) << ','
+            << lostCollision << ',' << lostNoSync << ',' << lostDecode << ',' << spurious << ','
+            << wall << ',' << cpu << ',' << 100*cpu/(wall*numThreads) << ',' << cpu/cfg.duration << ','
+            << cfg.duration/wall << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,307 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Framework.hpp>
+#include <Pothos/Proxy.hpp>
+#include <Pothos/Init.hpp>
+#include "LoRaPacketEncoder.hpp"
+#include "LoRaPacketDecoder.hpp"
+#include "LoRaModulator.hpp"
+#include "LoRaDemodulator.hpp"
+#include "BenchArgs.hpp"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+#include <malloc.h>
+
+/***********************************************************************
+ * Startup time and memory footprint report for the LoRa blocks.
+ *
+ * Each block is made through the block registry at every spread factor
+ * (and every oversampling ratio for the modulators), then activated
+ * in a topology between feeder and collector blocks, which allocates
+ * the buffers of its ports. The time of each phase is the median over
+ * the repeats, the bytes are the growth of the heap in use while the
+ * block lives: malloc and new, including the large mmap allocations.
+ * The activation bytes exclude the cost of an empty feeder to collector
+ * topology, so they are the buffers and state of the block itself.
+ *
+ * A second table lists the cores that the blocks hold: the demodulator
+ * total, then its detector FFT state, noise floor and stream framer,
+ * the modulator, and the packet encoder and decoder. The rest of the
+ * demodulator total is its chirp and fine tune tables and symbol buffers.
+ **********************************************************************/
+
+struct BenchConfig
+{
+    std::vector<size_t> sfs = {7, 8, 9, 10, 11, 12};
+    std::vector<double> ovs = {1, 2, 4, 8};
+    size_t repeat = 5;
+    bool csv = false;
+};
+
+//! A block to measure: the factory path, its arguments, and the port types around it
+struct BlockSpec
+{
+    std::string path;
+    bool sfArg;
+    bool ovsArg;
+    size_t numInputs;
+    std::string inType;
+    bool hasOutput;
+    std::string outType;
+};
+
+//! One row of the report
+struct Footprint
+{
+    std::string name;
+    size_t sf;
+    double ovs;
+    double constructMs;
+    long long constructBytes;
+    double activateMs;
+    long long activateBytes;
+};
+
+//! The options of the benchmark, which set the fields of the config
+static std::vector<BenchOption> benchOptions(BenchConfig &cfg)
+{
+    return {
+        {"sfs", "7,8,9,10,11,12", "spread factors of the blocks", [&cfg](const std::string &v){cfg.sfs = parseList<size_t>(v);}},
+        {"ovs", "1,2,4,8", "oversampling ratios of the modulators", [&cfg](const std::string &v){cfg.ovs = parseList<double>(v);}},
+        {"repeat", "5", "constructions per measurement, the median time is kept", [&cfg](const std::string &v){cfg.repeat = std::stoul(v);}},
+        {"csv", "", "print CSV rather than aligned tables", [&cfg](const std::string &){cfg.csv = true;}},
+    };
+}
+
+static bool parseArgs(int argc, char **argv, BenchConfig &cfg)
+{
+    if (not parseOptions(argc, argv, benchOptions(cfg))) return false;
+    for (const auto sf : cfg.sfs) if (sf < 5 or sf > 12) return false;
+    for (const auto ovs : cfg.ovs) if (not (ovs >= 1 and ovs <= 256)) return false;
+    return not cfg.sfs.empty() and not cfg.ovs.empty() and cfg.repeat != 0;
+}
+
+static void usage(void)
+{
+    BenchConfig cfg;
+    printUsage("LoRaFootprintBench [options], prints the tables to stdout", benchOptions(cfg));
+}
+
+//! Bytes of heap in use by the process, small blocks and mmapped chunks
+static long long heapInUse(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    const auto info = mallinfo2();
+#else
+    const auto info = mallinfo();
+#endif
+    return (long long)(info.uordblks) + (long long)(info.hblkhd);
+}
+
+static double elapsedMs(const std::chrono::steady_clock::time_point &t0)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static double median(std::vector<double> v)
+{
+    std::sort(v.begin(), v.end());
+    return v[v.size()/2];
+}
+
+/*!
+ * Make a block, then activate it in a topology, repeat times.
+ * The bytes of both phases are those of the last repeat.
+ */
+static Footprint measureBlock(const Pothos::Proxy &registry, const BlockSpec &spec,
+    const size_t sf, const double ovs, const size_t repeat, const long long topologyBytes)
+{
+    Footprint fp;
+    fp.name = spec.path.substr(spec.path.rfind('/')+1);
+    fp.sf = spec.sfArg ? sf : 0;
+    fp.ovs = spec.ovsArg ? ovs : 0;
+
+    //the surrounding blocks exist before the measurement starts
+    std::vector<Pothos::Proxy> feeders;
+    for (size_t i = 0; i < spec.numInputs; i++) feeders.push_back(registry.call("/blocks/feeder_source", spec.inType));
+    const auto collector = registry.call("/blocks/collector_sink", spec.outType);
+
+    std::vector<double> constructMs, activateMs;
+    for (size_t r = 0; r < repeat; r++)
+    {
+        auto bytes = heapInUse();
+        auto t0 = std::chrono::steady_clock::now();
+        Pothos::Proxy block;
+        if (spec.sfArg) block = registry.call(spec.path, sf);
+        else block = registry.call(spec.path);
+        if (spec.ovsArg) block.call("setOvs", ovs);
+        constructMs.push_back(elapsedMs(t0));
+        fp.constructBytes = heapInUse() - bytes;
+
+        bytes = heapInUse();
+        t0 = std::chrono::steady_clock::now();
+        {
+            Pothos::Topology topology;
+            for (size_t i = 0; i < feeders.size(); i++) topology.connect(feeders[i], 0, block, i);
+            if (spec.hasOutput) topology.connect(block, 0, collector, 0);
+            topology.commit();
+            activateMs.push_back(elapsedMs(t0));
+            fp.activateBytes = heapInUse() - bytes - topologyBytes;
+        }
+    }
+    fp.constructMs = median(constructMs);
+    fp.activateMs = median(activateMs);
+    return fp;
+}
+
+//! The heap growth of an active topology of a feeder and a collector alone
+static long long measureTopology(const Pothos::Proxy &registry)
+{
+    const auto feeder = registry.call("/blocks/feeder_source", "uint8");
+    const auto collector = registry.call("/blocks/collector_sink", "uint8");
+    const auto bytes = heapInUse();
+    Pothos::Topology topology;
+    topology.connect(feeder, 0, collector, 0);
+    topology.commit();
+    return heapInUse() - bytes;
+}
+
+//! Construct a core on the heap and report the heap growth while it lives
+template <typename T>
+static Footprint measureCore(const std::string &name, const size_t sf, const double ovs,
+    const size_t repeat, const std::function<T *(void)> &make)
+{
+    Footprint fp;
+    fp.name = name;
+    fp.sf = sf;
+    fp.ovs = ovs;
+    fp.activateMs = 0.0;
+    fp.activateBytes = 0;
+    std::vector<double> constructMs;
+    for (size_t r = 0; r < repeat; r++)
+    {
+        const auto bytes = heapInUse();
+        const auto t0 = std::chrono::steady_clock::now();
+        std::unique_ptr<T> core(make());
+        constructMs.push_back(elapsedMs(t0));
+        fp.constructBytes = heapInUse() - bytes;
+    }
+    fp.constructMs = median(constructMs);
+    return fp;
+}
+
+//! The oversampling ratio as given, so 2.5 is not shown as 2
+static std::string formatOvs(const double ovs)
+{
+    std::ostringstream ss;
+    ss << ovs;
+    return ss.str();
+}
+
+static void printTable(const std::string &title, const std::vector<Footprint> &rows, const bool activation, const bool csv)
+{
+    const double KiB = 1024.0;
+    if (csv)
+    {
+        std::cout << "component,sf,ovs,construct_ms,construct_kib";
+        if (activation) std::cout << ",activate_ms,activate_kib,total_kib";
+        std::cout << std::endl;
+        for (const auto &row : rows)
+        {
+            std::cout << row.name << ',' << row.sf << ',' << row.ovs << ','
+                << row.constructMs << ',' << row.constructBytes/KiB;
+            if (activation) std::cout << ',' << row.activateMs << ',' << row.activateBytes/KiB
+                << ',' << (row.constructBytes + row.activateBytes)/KiB;
+            std::cout << std::endl;
+        }
+        std::cout << std::endl;
+        return;
+    }
+
+    std::cout << title << std::endl << std::left << std::setw(22) << "component" << std::right
+        << std::setw(4) << "sf" << std::setw(6) << "ovs"
+        << std::setw(14) << "construct ms" << std::setw(15) << "construct KiB";
+    if (activation) std::cout << std::setw(13) << "activate ms" << std::setw(14) << "activate KiB" << std::setw(11) << "total KiB";
+    std::cout << std::endl << std::fixed;
+    for (const auto &row : rows)
+    {
+        std::cout << std::left << std::setw(22) << row.name << std::right
+            << std::setw(4) << (row.sf ? std::to_string(row.sf) : "-")
+            << std::setw(6) << (row.ovs ? formatOvs(row.ovs) : "-")
+            << std::setprecision(3) << std::setw(14) << row.constructMs
+            << std::setprecision(1) << std::setw(15) << row.constructBytes/KiB;
+        if (activation) std::cout << std::setprecision(3) << std::setw(13) << row.activateMs
+            << std::setprecision(1) << std::setw(14) << row.activateBytes/KiB
+            << std::setw(11) << (row.constructBytes + row.activateBytes)/KiB;
+        std::cout << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig cfg;
+    if (not parseArgs(argc, argv, cfg))
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    Pothos::ScopedInit init;
+    auto env = Pothos::ProxyEnvironment::make("managed");
+    auto registry = env->findProxy("Pothos/BlockRegistry");
+
+    //the capture blocks open files and are left out
+    const std::vector<BlockSpec> specs = {
+        {"/lora/lora_demod", true, false, 1, "complex_float32", true, "uint8"},
+        {"/lora/lora_diversity_demod", true, false, 2, "complex_float32", true, "uint8"},
+        {"/lora/lora_rx", true, false, 1, "complex_float32", true, "uint8"},
+        {"/lora/lora_mod", true, true, 1, "uint8", true, "complex_float32"},
+        {"/lora/lora_tx", true, true, 1, "uint8", true, "complex_float32"},
+        {"/lora/lora_decoder", false, false, 1, "uint8", true, "uint8"},
+        {"/lora/lora_encoder", false, false, 1, "uint8", true, "uint8"},
+        {"/lora/lorawan_frame", false, false, 1, "uint8", true, "uint8"},
+        {"/lora/block_gen", false, false, 0, "uint8", true, "uint8"},
+    };
+
+    //load the modules and warm up the allocator before measuring
+    const auto topologyBytes = measureTopology(registry);
+    for (const auto &spec : specs) measureBlock(registry, spec, cfg.sfs.front(), cfg.ovs.front(), 1, topologyBytes);
+
+    std::vector<Footprint> blocks;
+    for (const auto &spec : specs)
+    {
+        const auto sfs = spec.sfArg ? cfg.sfs : std::vector<size_t>(1, 0);
+        const auto ovss = spec.ovsArg ? cfg.ovs : std::vector<double>(1, 0);
+        for (const auto sf : sfs) for (const auto ovs : ovss)
+        {
+            blocks.push_back(measureBlock(registry, spec, sf, ovs, cfg.repeat, topologyBytes));
+        }
+    }
+    printTable("Blocks: construction, then activation in a topology", blocks, true, cfg.csv);
+
+    std::vector<Footprint> cores;
+    for (const auto sf : cfg.sfs)
+    {
+        const size_t N = size_t(1) << sf;
+        cores.push_back(measureCore<LoRaDemodulator>("LoRaDemodulator", sf, 0, cfg.repeat, [sf]{return new LoRaDemodulator(sf);}));
+        cores.push_back(measureCore<LoRaDetector<float>>("  LoRaDetector", sf, 0, cfg.repeat, [N]{return new LoRaDetector<float>(N);}));
+        cores.push_back(measureCore<LoRaNoiseFloor>("  LoRaNoiseFloor", sf, 0, cfg.repeat, []{return new LoRaNoiseFloor();}));
+        cores.push_back(measureCore<LoRaStreamFramer>("  LoRaStreamFramer", sf, 0, cfg.repeat, []{return new LoRaStreamFramer();}));
+        cores.push_back(measureCore<LoRaModulator>("LoRaModulator", sf, 0, cfg.repeat, [sf]{return new LoRaModulator(sf);}));
+    }
+    cores.push_back(measureCore<LoRaPacketEncoder>("LoRaPacketEncoder", 0, 0, cfg.repeat, []{return new LoRaPacketEncoder();}));
+    cores.push_back(measureCore<LoRaPacketDecoder>("LoRaPacketDecoder", 0, 0, cfg.repeat, []{return new LoRaPacketDecoder();}));
+    printTable("Cores: the demodulator total, then its parts", cores, false, cfg.csv);
+
+    return EXIT_SUCCESS;
+}
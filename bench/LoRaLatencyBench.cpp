@@ -0,0 +1,251 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include "LoRaPacketEncoder.hpp"
+#include "LoRaPacketDecoder.hpp"
+#include "LoRaModulator.hpp"
+#include "LoRaDemodulator.hpp"
+#include "LoRaCodes.hpp"
+#include "BenchArgs.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+/***********************************************************************
+ * Receive latency benchmark: from the last sample of a frame
+ * to the decoded packet out of the decoder.
+ *
+ * The samples of a stream of frames arrive in buffers at the sample rate,
+ * as from a radio, and a receiver steps the demodulator and decoder
+ * over each buffer like the LoRa Demod and LoRa Decoder blocks.
+ * The clock is virtual so that hours of air run in seconds:
+ * a buffer arrives when its last sample is captured, its processing
+ * starts when it arrives or when the last buffer is done, and it takes
+ * the measured processing time. The latency includes the buffering,
+ * the symbols the demodulator waits for to end the packet,
+ * the queueing behind slow buffers, and the processing.
+ * It leaves out the block scheduling of a topology and the message hop
+ * from the LoRa Demod to the LoRa Decoder block, which add to the latency.
+ *
+ * The idle condition runs the receiver alone, the loaded condition
+ * runs it alongside a demodulator on every core.
+ * The percentiles print as CSV, one row per spread factor and condition.
+ **********************************************************************/
+
+struct BenchConfig
+{
+    std::vector<size_t> sfs = {7, 8, 9, 10, 11, 12};
+    size_t frames = 1000;
+    size_t buffer = 1024;
+    double bw = 125e3;
+    double snr = 0.0;
+    std::string cr = "4/5";
+    size_t length = 16;
+    size_t mtu = 256;
+    size_t loadThreads = std::max(1u, std::thread::hardware_concurrency());
+    unsigned seed = 1;
+};
+
+//! A frame in noise with the gap that follows it
+struct Segment
+{
+    std::vector<std::complex<float>> samps;
+    size_t dataStart;
+    size_t end;
+};
+
+//! The options of the benchmark, which set the fields of the config
+static std::vector<BenchOption> benchOptions(BenchConfig &cfg)
+{
+    return {
+        {"sfs", "7,8,9,10,11,12", "spread factors to measure", [&cfg](const std::string &v){cfg.sfs = parseList<size_t>(v);}},
+        {"frames", "1000", "frames per spread factor and condition", [&cfg](const std::string &v){cfg.frames = std::stoul(v);}},
+        {"buffer", "1024", "samples per radio buffer", [&cfg](const std::string &v){cfg.buffer = std::stoul(v);}},
+        {"bw", "125000", "channel bandwidth in Hz", [&cfg](const std::string &v){cfg.bw = std::stod(v);}},
+        {"snr", "0", "frame SNR in dB", [&cfg](const std::string &v){cfg.snr = std::stod(v);}},
+        {"cr", "4/5", "coding rate", [&cfg](const std::string &v){cfg.cr = v;}},
+        {"length", "16", "payload bytes", [&cfg](const std::string &v){cfg.length = std::stoul(v);}},
+        {"mtu", "256", "demodulator MTU, packets end on the squelch", [&cfg](const std::string &v){cfg.mtu = std::stoul(v);}},
+        {"load-threads", "N", "background demodulators when loaded, default all cores", [&cfg](const std::string &v){cfg.loadThreads = std::stoul(v);}},
+        {"seed", "1", "noise seed", [&cfg](const std::string &v){cfg.seed = unsigned(std::stoul(v));}},
+    };
+}
+
+static bool parseArgs(int argc, char **argv, BenchConfig &cfg)
+{
+    if (not parseOptions(argc, argv, benchOptions(cfg))) return false;
+    size_t rdd = 0;
+    if (not parseCodingRate(cfg.cr, rdd)) return false;
+    for (const auto sf : cfg.sfs) if (sf < 5 or sf > 12) return false;
+    return not cfg.sfs.empty() and cfg.frames != 0 and cfg.buffer != 0;
+}
+
+static void usage(void)
+{
+    BenchConfig cfg;
+    printUsage("LoRaLatencyBench [options], prints CSV to stdout", benchOptions(cfg));
+}
+
+static double percentile(std::vector<double> &v, const double p)
+{
+    if (v.empty()) return 0.0;
+    const size_t i = std::min(v.size()-1, size_t(std::ceil(p*v.size())) - (p > 0 ? 1 : 0));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+//! Keep a core busy with a demodulator on noise until stopped
+static void backgroundLoad(const size_t sf, const std::atomic<bool> &stop)
+{
+    std::mt19937 rng(0);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    std::vector<std::complex<float>> samps(1 << 18);
+    for (auto &s : samps) s = std::complex<float>(noise(rng), noise(rng));
+    LoRaDemodulator demod(sf);
+    demod.setFalseAlarmRate(1e-3);
+    while (not stop)
+    {
+        size_t consumed = 0;
+        while (consumed + demod.required() <= samps.size()) consumed += demod.step(samps.data() + consumed);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig cfg;
+    if (not parseArgs(argc, argv, cfg))
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+    size_t rdd = 0;
+    parseCodingRate(cfg.cr, rdd);
+
+    std::cout << "sf,condition,frames,decoded,buffer,p50_ms,p99_ms,p99.9_ms,max_ms,processing_p99_ms" << std::endl;
+
+    for (const auto sf : cfg.sfs)
+    {
+        const size_t N = size_t(1) << sf;
+        std::mt19937 rng(cfg.seed);
+        std::normal_distribution<float> noise(0.0f, std::sqrt(0.5f));
+        std::uniform_int_distribution<size_t> gapDist(4*N, 16*N);
+
+        //a few distinct frames in noise, cycled to make the stream
+        LoRaPacketEncoder encoder;
+        encoder.sf = sf;
+        encoder.rdd = rdd;
+        std::vector<Segment> segments(16);
+        for (auto &seg : segments)
+        {
+            std::vector<uint8_t> payload(cfg.length);
+            for (auto &b : payload) b = uint8_t(rng());
+            std::vector<uint16_t> symbols;
+            encoder.encode(payload.data(), payload.size(), symbols);
+            LoRaModulator mod(sf);
+            mod.setAmplitude(std::pow(10.0f, float(cfg.snr)/20));
+            mod.setPadding(1);
+            mod.modulateFrame(symbols.data(), symbols.size(), seg.samps);
+            seg.dataStart = size_t(LoRaModulator::syncSymbols()*N);
+            seg.end = seg.dataStart + symbols.size()*N;
+            seg.samps.resize(seg.end + gapDist(rng));
+            for (auto &s : seg.samps) s += std::complex<float>(noise(rng), noise(rng));
+        }
+
+        //noise ahead of the frames trains the adaptive threshold of the squelch
+        std::vector<std::complex<float>> leadIn(512*N);
+        for (auto &s : leadIn) s = std::complex<float>(noise(rng), noise(rng));
+
+        for (const bool loaded : {false, true})
+        {
+            std::atomic<bool> stop(false);
+            std::vector<std::thread> load;
+            if (loaded) for (size_t i = 0; i < cfg.loadThreads; i++) load.emplace_back(backgroundLoad, sf, std::cref(stop));
+
+            LoRaDemodulator demod(sf);
+            demod.setThreshold(-30.0);
+            demod.setFalseAlarmRate(1e-3);
+            demod.setMTU(cfg.mtu);
+            LoRaPacketDecoder decoder;
+            decoder.sf = sf;
+            decoder.rdd = rdd;
+            decoder.errorCheck = true;
+            decoder.crcc = true;
+
+            //the absolute sample index of the data start and end of each frame
+            std::vector<unsigned long long> frameStarts, frameEnds;
+            unsigned long long total = leadIn.size();
+            for (size_t f = 0; f < cfg.frames; f++)
+            {
+                const auto &seg = segments[f % segments.size()];
+                frameStarts.push_back(total + seg.dataStart);
+                frameEnds.push_back(total + seg.end);
+                total += seg.samps.size();
+            }
+
+            std::vector<double> latencies, processing;
+            std::vector<std::complex<float>> window;
+            unsigned long long windowIndex = 0, syncIndex = 0, arrived = 0;
+            size_t segIndex = 0, segOffset = 0, numDecoded = 0, nextFrame = 0;
+            double busyUntil = 0.0;
+            while (arrived < total)
+            {
+                //the next radio buffer from the cycled segments
+                const size_t num = size_t(std::min<unsigned long long>(cfg.buffer, total - arrived));
+                for (size_t i = 0; i < num; i++)
+                {
+                    if (arrived + i < leadIn.size())
+                    {
+                        window.push_back(leadIn[arrived + i]);
+                        continue;
+                    }
+                    const auto &seg = segments[segIndex % segments.size()];
+                    window.push_back(seg.samps[segOffset++]);
+                    if (segOffset == seg.samps.size()) segOffset = 0, segIndex++;
+                }
+                arrived += num;
+                const double arrival = arrived/cfg.bw;
+                const double start = std::max(arrival, busyUntil);
+
+                const auto t0 = std::chrono::high_resolution_clock::now();
+                size_t consumed = 0;
+                while (consumed + demod.required() <= window.size())
+                {
+                    consumed += demod.step(window.data() + consumed);
+                    if (demod.syncFound()) syncIndex = windowIndex + consumed + demod.dataSymbolsDelay();
+                    if (not demod.packetReady()) continue;
+                    if (decoder.decode(demod.symbols(), demod.numSymbols()) != LoRaPacketDecoder::DECODE_OK) continue;
+                    const double elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+
+                    //the frame that synced near the sync index
+                    while (nextFrame < cfg.frames and frameStarts[nextFrame] + N < syncIndex) nextFrame++;
+                    if (nextFrame == cfg.frames or frameStarts[nextFrame] > syncIndex + N) continue;
+                    latencies.push_back(start + elapsed - frameEnds[nextFrame]/cfg.bw);
+                    nextFrame++;
+                    numDecoded++;
+                }
+                window.erase(window.begin(), window.begin() + consumed);
+                windowIndex += consumed;
+                const double elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+                processing.push_back(elapsed);
+                busyUntil = start + elapsed;
+            }
+
+            stop = true;
+            for (auto &t : load) t.join();
+
+            std::cout << sf << ',' << (loaded ? "loaded" : "idle") << ',' << cfg.frames << ',' << numDecoded << ',' << cfg.buffer << ','
+                << 1e3*percentile(latencies, 0.5) << ',' << 1e3*percentile(latencies, 0.99) << ','
+                << 1e3*percentile(latencies, 0.999) << ',' << 1e3*percentile(latencies, 1.0) << ','
+                << 1e3*percentile(processing, 0.99) << std::endl;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,208 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Framework.hpp>
+#include <Pothos/Proxy.hpp>
+#include <Pothos/Init.hpp>
+#include "LoRaPacketEncoder.hpp"
+#include "LoRaPacketDecoder.hpp"
+#include "LoRaModulator.hpp"
+#include "LoRaDemodulator.hpp"
+#include "LoRaCodes.hpp"
+#include "BenchArgs.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
+/***********************************************************************
+ * Demodulator throughput benchmark for the wide bandwidth modes.
+ *
+ * A frame between stretches of noise is modulated once per spread factor.
+ * The demodulator and decoder cores step over it repeatedly on one thread,
+ * then copies of it flow through the LoRa Demod block in its high rate mode
+ * and the LoRa Decoder block, from a feeder to a collector.
+ * The block rate runs from the commit of the topology to the end of the
+ * data flow, so it includes the scheduling and the Demod to Decoder hop.
+ * The rates print as CSV, one row per spread factor, with the margin
+ * of the block rate over the target rate: the 1625 kHz bandwidth
+ * of SX128x-class radios at one sample per chip by default.
+ *
+ * The exit status is a failure when a spread factor misses the target,
+ * so the benchmark can gate a build on a quiet machine.
+ * This tool needs the installed blocks.
+ **********************************************************************/
+
+struct BenchConfig
+{
+    std::vector<size_t> sfs = {5, 6, 7, 8, 9, 10, 11, 12};
+    double target = 1.625e6;
+    double seconds = 0.5;
+    std::string cr = "4/8";
+    size_t length = 32;
+    unsigned seed = 1;
+};
+
+//! The options of the benchmark, which set the fields of the config
+static std::vector<BenchOption> benchOptions(BenchConfig &cfg)
+{
+    return {
+        {"sfs", "5,6,7,8,9,10,11,12", "spread factors to measure", [&cfg](const std::string &v){cfg.sfs = parseList<size_t>(v);}},
+        {"target", "1625000", "required samples per second", [&cfg](const std::string &v){cfg.target = std::stod(v);}},
+        {"seconds", "0.5", "time per spread factor", [&cfg](const std::string &v){cfg.seconds = std::stod(v);}},
+        {"cr", "4/8", "coding rate", [&cfg](const std::string &v){cfg.cr = v;}},
+        {"length", "32", "payload bytes", [&cfg](const std::string &v){cfg.length = std::stoul(v);}},
+        {"seed", "1", "payload and noise seed", [&cfg](const std::string &v){cfg.seed = unsigned(std::stoul(v));}},
+    };
+}
+
+static bool parseArgs(int argc, char **argv, BenchConfig &cfg)
+{
+    if (not parseOptions(argc, argv, benchOptions(cfg))) return false;
+    size_t rdd = 0;
+    if (not parseCodingRate(cfg.cr, rdd)) return false;
+    for (const auto sf : cfg.sfs) if (sf < 5 or sf > 12) return false;
+    return not cfg.sfs.empty() and cfg.seconds > 0.0 and cfg.length != 0;
+}
+
+static void usage(void)
+{
+    BenchConfig cfg;
+    printUsage("LoRaThroughputBench [options], prints CSV to stdout", benchOptions(cfg));
+}
+
+/*!
+ * Feed copies of the frame through the demod block in its high rate mode
+ * and the decoder block. Return the samples per second from the commit
+ * to the end of the data flow, and count the payloads decoded intact.
+ */
+static double measureBlock(const Pothos::Proxy &registry, const size_t sf, const BenchConfig &cfg,
+    const std::vector<std::complex<float>> &samps, const size_t copies, const size_t mtu,
+    const std::vector<uint8_t> &payload, size_t &decoded)
+{
+    auto source = registry.call("/blocks/feeder_source", "complex_float32");
+    auto demod = registry.call("/lora/lora_demod", sf);
+    auto decoder = registry.call("/lora/lora_decoder");
+    auto collector = registry.call("/blocks/collector_sink", "uint8");
+    demod.call("enableHighRate", true);
+    demod.call("setThreshold", -5.0);
+    demod.call("setMTU", mtu);
+    decoder.call("setSpreadFactor", sf);
+    decoder.call("setCodingRate", cfg.cr);
+    decoder.call("enableCrcc", true);
+    decoder.call("enableErrorCheck", true);
+
+    Pothos::BufferChunk buff(typeid(std::complex<float>), copies*samps.size());
+    for (size_t i = 0; i < copies; i++)
+    {
+        std::copy(samps.begin(), samps.end(), buff.as<std::complex<float> *>() + i*samps.size());
+    }
+    source.call("feedBuffer", buff);
+
+    //the data flow ends once the topology stays idle, which is not part of the time
+    const double idle = 0.01;
+    double elapsed = 0.0;
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, demod, 0);
+        topology.connect(demod, 0, decoder, 0);
+        topology.connect(decoder, 0, collector, 0);
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        topology.commit();
+        topology.waitInactive(idle, 0);
+        elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count() - idle;
+    }
+
+    decoded = 0;
+    for (const auto &pkt : collector.call<std::vector<Pothos::Packet>>("getPackets"))
+    {
+        const auto bytes = pkt.payload.as<const uint8_t *>();
+        if (pkt.payload.length == payload.size() and std::equal(payload.begin(), payload.end(), bytes)) decoded++;
+    }
+    return buff.elements()/elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig cfg;
+    if (not parseArgs(argc, argv, cfg))
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+    size_t rdd = 0;
+    parseCodingRate(cfg.cr, rdd);
+    std::mt19937 rng(cfg.seed);
+    std::normal_distribution<float> noise(0.0f, 0.1f);
+
+    Pothos::ScopedInit init;
+    auto env = Pothos::ProxyEnvironment::make("managed");
+    auto registry = env->findProxy("Pothos/BlockRegistry");
+
+    std::cout << "sf,passes,core_decoded,core_msps,copies,block_decoded,block_msps,x_target" << std::endl;
+
+    bool pass = true;
+    for (const auto sf : cfg.sfs)
+    {
+        const size_t N = size_t(1) << sf;
+        LoRaPacketEncoder encoder;
+        encoder.sf = sf;
+        encoder.rdd = rdd;
+        encoder.crc = true;
+        std::vector<uint8_t> payload(cfg.length);
+        for (auto &b : payload) b = uint8_t(rng());
+        std::vector<uint16_t> symbols;
+        encoder.encode(payload.data(), payload.size(), symbols);
+
+        LoRaModulator mod(sf);
+        mod.setAmplitude(1.0f);
+        mod.setPadding(4);
+        std::vector<std::complex<float>> samps(4*N + N/2);
+        mod.modulateFrame(symbols.data(), symbols.size(), samps);
+        for (auto &s : samps) s += std::complex<float>(noise(rng), noise(rng));
+
+        LoRaDemodulator demod(sf);
+        demod.setMTU(symbols.size());
+        demod.setThreshold(-5.0);
+        LoRaPacketDecoder decoder;
+        decoder.sf = sf;
+        decoder.rdd = rdd;
+        decoder.errorCheck = true;
+        decoder.crcc = true;
+
+        size_t passes = 0, decoded = 0;
+        double numSamps = 0.0, elapsed = 0.0;
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        while (elapsed < cfg.seconds)
+        {
+            demod.reset();
+            size_t consumed = 0;
+            while (consumed + demod.required() <= samps.size())
+            {
+                consumed += demod.step(samps.data() + consumed);
+                if (not demod.packetReady()) continue;
+                if (decoder.decode(demod.symbols(), demod.numSymbols()) != LoRaPacketDecoder::DECODE_OK) continue;
+                if (decoder.length() == payload.size() and std::equal(payload.begin(), payload.end(), decoder.payload())) decoded++;
+            }
+            numSamps += consumed;
+            passes++;
+            elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+        }
+
+        const double coreRate = numSamps/elapsed;
+
+        //as many copies through the blocks as the target rate covers in the time
+        const size_t copies = std::max<size_t>(1, size_t(cfg.target*cfg.seconds/samps.size()));
+        size_t blockDecoded = 0;
+        const double blockRate = measureBlock(registry, sf, cfg, samps, copies, symbols.size(), payload, blockDecoded);
+
+        std::cout << sf << ',' << passes << ',' << decoded << ',' << coreRate/1e6 << ','
+            << copies << ',' << blockDecoded << ',' << blockRate/1e6 << ',' << blockRate/cfg.target << std::endl;
+        if (decoded != passes or blockDecoded != copies or blockRate < cfg.target) pass = false;
+    }
+
+    return pass ? EXIT_SUCCESS : EXIT_FAILURE;
+}
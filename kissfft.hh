@@ -2,6 +2,7 @@
 #define KISSFFT_CLASS_HH
 #include <complex>
 #include <vector>
+#include "FastSinCos.hpp"
 
 #ifdef HAS_ALLOCA_H
 #include <alloca.h>
@@ -17,8 +18,10 @@ struct traits
     void fill_twiddles( std::complex<T_scalar> * dst ,int nfft,bool inverse)
     {
         T_scalar phinc =  (inverse?2:-2)* acos( (T_scalar) -1)  / nfft;
+        std::vector<T_scalar> phase(nfft);
         for (int i=0;i<nfft;++i)
-            dst[i] = exp( std::complex<T_scalar>(0,i*phinc) );
+            phase[i] = i*phinc;
+        fastPolar(&phase[0], dst, nfft);
     }
 
     void prepare(
@@ -305,4 +308,185 @@ class kissfft
         std::vector<int> _stageRemainder;
         traits_type _traits;
 };
+/*!
+ * Batched "vertical" FFT: Lanes independent transforms of the same size
+ * computed together, with each SIMD lane holding a different transform.
+ * Data is stored split real/imaginary and lane-interleaved, so that
+ * element k of lane l lives at index k*Lanes + l of each array.
+ * The inner loops run across lanes with contiguous loads and stores,
+ * which lets the compiler vectorise them regardless of the FFT size.
+ */
+template <typename T_Scalar, size_t Lanes>
+class kissfft_lanes
+{
+    public:
+        typedef T_Scalar scalar_type;
+        typedef std::complex<scalar_type> cpx_type;
+
+        kissfft_lanes(int nfft,bool inverse)
+            :_nfft(nfft),_inverse(inverse)
+        {
+            std::vector<cpx_type> twiddles;
+            kissfft_utils::traits<scalar_type> traits;
+            traits.prepare(twiddles, _nfft, _inverse, _stageRadix, _stageRemainder);
+            _twRe.resize(_nfft);
+            _twIm.resize(_nfft);
+            for (int i=0;i<_nfft;++i) {
+                _twRe[i] = twiddles[i].real();
+                _twIm[i] = twiddles[i].imag();
+            }
+            int maxRadix = 0;
+            for (size_t i=0;i<_stageRadix.size();++i)
+                if (_stageRadix[i] > maxRadix) maxRadix = _stageRadix[i];
+            _scratchRe.resize(maxRadix*Lanes);
+            _scratchIm.resize(maxRadix*Lanes);
+        }
+
+        //! transform nfft*Lanes lane-interleaved elements from src into dst
+        void transform(const scalar_type * srcRe, const scalar_type * srcIm, scalar_type * dstRe, scalar_type * dstIm)
+        {
+            kf_work(0, dstRe, dstIm, srcRe, srcIm, 1);
+        }
+
+    private:
+        void kf_work( int stage, scalar_type * FoutRe, scalar_type * FoutIm, const scalar_type * fRe, const scalar_type * fIm, size_t fstride)
+        {
+            const int p = _stageRadix[stage];
+            const int m = _stageRemainder[stage];
+
+            if (m==1) {
+                for (int q=0;q<p;++q) {
+                    const size_t in = q*fstride*Lanes;
+                    for (size_t l=0;l<Lanes;++l) {
+                        FoutRe[q*Lanes+l] = fRe[in+l];
+                        FoutIm[q*Lanes+l] = fIm[in+l];
+                    }
+                }
+            }else{
+                // p instances of smaller DFTs of size m,
+                // each one takes a decimated version of the input
+                for (int q=0;q<p;++q) {
+                    kf_work(stage+1, FoutRe+q*m*Lanes, FoutIm+q*m*Lanes,
+                        fRe+q*fstride*Lanes, fIm+q*fstride*Lanes, fstride*p);
+                }
+            }
+
+            // recombine the p smaller DFTs
+            switch (p) {
+                case 2: kf_bfly2(FoutRe,FoutIm,fstride,m); break;
+                case 4: kf_bfly4(FoutRe,FoutIm,fstride,m); break;
+                default: kf_bfly_generic(FoutRe,FoutIm,fstride,m,p); break;
+            }
+        }
+
+        void kf_bfly2( scalar_type * Re, scalar_type * Im, const size_t fstride, const int m)
+        {
+            for (int k=0;k<m;++k) {
+                const scalar_type wr = _twRe[k*fstride];
+                const scalar_type wi = _twIm[k*fstride];
+                scalar_type * aRe = Re + k*Lanes;
+                scalar_type * aIm = Im + k*Lanes;
+                scalar_type * bRe = Re + (m+k)*Lanes;
+                scalar_type * bIm = Im + (m+k)*Lanes;
+                for (size_t l=0;l<Lanes;++l) {
+                    const scalar_type tr = bRe[l]*wr - bIm[l]*wi;
+                    const scalar_type ti = bRe[l]*wi + bIm[l]*wr;
+                    bRe[l] = aRe[l] - tr;
+                    bIm[l] = aIm[l] - ti;
+                    aRe[l] += tr;
+                    aIm[l] += ti;
+                }
+            }
+        }
+
+        void kf_bfly4( scalar_type * Re, scalar_type * Im, const size_t fstride, const int m)
+        {
+            const scalar_type negative_if_inverse = _inverse * -2 +1;
+            for (int k=0;k<m;++k) {
+                const scalar_type w1r = _twRe[k*fstride], w1i = _twIm[k*fstride];
+                const scalar_type w2r = _twRe[k*fstride*2], w2i = _twIm[k*fstride*2];
+                const scalar_type w3r = _twRe[k*fstride*3], w3i = _twIm[k*fstride*3];
+                scalar_type * r0 = Re + k*Lanes;
+                scalar_type * i0 = Im + k*Lanes;
+                scalar_type * r1 = Re + (k+m)*Lanes;
+                scalar_type * i1 = Im + (k+m)*Lanes;
+                scalar_type * r2 = Re + (k+2*m)*Lanes;
+                scalar_type * i2 = Im + (k+2*m)*Lanes;
+                scalar_type * r3 = Re + (k+3*m)*Lanes;
+                scalar_type * i3 = Im + (k+3*m)*Lanes;
+                for (size_t l=0;l<Lanes;++l) {
+                    const scalar_type s0r = r1[l]*w1r - i1[l]*w1i;
+                    const scalar_type s0i = r1[l]*w1i + i1[l]*w1r;
+                    const scalar_type s1r = r2[l]*w2r - i2[l]*w2i;
+                    const scalar_type s1i = r2[l]*w2i + i2[l]*w2r;
+                    const scalar_type s2r = r3[l]*w3r - i3[l]*w3i;
+                    const scalar_type s2i = r3[l]*w3i + i3[l]*w3r;
+                    const scalar_type s5r = r0[l] - s1r;
+                    const scalar_type s5i = i0[l] - s1i;
+                    const scalar_type f0r = r0[l] + s1r;
+                    const scalar_type f0i = i0[l] + s1i;
+                    const scalar_type s3r = s0r + s2r;
+                    const scalar_type s3i = s0i + s2i;
+                    const scalar_type s4r = (s0i - s2i)*negative_if_inverse;
+                    const scalar_type s4i = -(s0r - s2r)*negative_if_inverse;
+                    r2[l] = f0r - s3r;
+                    i2[l] = f0i - s3i;
+                    r0[l] = f0r + s3r;
+                    i0[l] = f0i + s3i;
+                    r1[l] = s5r + s4r;
+                    i1[l] = s5i + s4i;
+                    r3[l] = s5r - s4r;
+                    i3[l] = s5i - s4i;
+                }
+            }
+        }
+
+        /* perform the butterfly for one stage of a mixed radix FFT */
+        void kf_bfly_generic( scalar_type * Re, scalar_type * Im, const size_t fstride, const int m, const int p)
+        {
+            scalar_type * sRe = &_scratchRe[0];
+            scalar_type * sIm = &_scratchIm[0];
+            for (int u=0;u<m;++u) {
+                int k=u;
+                for (int q1=0;q1<p;++q1) {
+                    for (size_t l=0;l<Lanes;++l) {
+                        sRe[q1*Lanes+l] = Re[k*Lanes+l];
+                        sIm[q1*Lanes+l] = Im[k*Lanes+l];
+                    }
+                    k += m;
+                }
+
+                k=u;
+                for (int q1=0;q1<p;++q1) {
+                    int twidx=0;
+                    scalar_type * oRe = Re + k*Lanes;
+                    scalar_type * oIm = Im + k*Lanes;
+                    for (size_t l=0;l<Lanes;++l) {
+                        oRe[l] = sRe[l];
+                        oIm[l] = sIm[l];
+                    }
+                    for (int q=1;q<p;++q) {
+                        twidx += fstride * k;
+                        if (twidx>=_nfft) twidx-=_nfft;
+                        const scalar_type wr = _twRe[twidx];
+                        const scalar_type wi = _twIm[twidx];
+                        for (size_t l=0;l<Lanes;++l) {
+                            oRe[l] += sRe[q*Lanes+l]*wr - sIm[q*Lanes+l]*wi;
+                            oIm[l] += sRe[q*Lanes+l]*wi + sIm[q*Lanes+l]*wr;
+                        }
+                    }
+                    k += m;
+                }
+            }
+        }
+
+        int _nfft;
+        bool _inverse;
+        std::vector<scalar_type> _twRe;
+        std::vector<scalar_type> _twIm;
+        std::vector<scalar_type> _scratchRe;
+        std::vector<scalar_type> _scratchIm;
+        std::vector<int> _stageRadix;
+        std::vector<int> _stageRemainder;
+};
 #endif
@@ -0,0 +1,319 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/complex.h>
+#include "LoRaPacketEncoder.hpp"
+#include "LoRaPacketDecoder.hpp"
+#include "LoRaModulator.hpp"
+#include "LoRaDemodulator.hpp"
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/***********************************************************************
+ * Python bindings for the LoRa PHY cores: the same encoder, decoder,
+ * modulator and demodulator used by the Pothos blocks, callable on
+ * numpy arrays without a running topology.
+ *
+ * Inputs of the expected dtype and layout are read in place,
+ * and outputs are handed to numpy without a copy.
+ * The processing runs without the GIL so that threads can share the work.
+ **********************************************************************/
+namespace py = pybind11;
+
+typedef std::complex<float> Sample;
+
+template <typename T>
+using InArray = py::array_t<T, py::array::c_style | py::array::forcecast>;
+
+//! Give the vector storage to a numpy array without a copy, the caller holds the GIL
+template <typename T>
+static py::array_t<T> toArray(std::vector<T> &&vec)
+{
+    auto owner = new std::vector<T>(std::move(vec));
+    py::capsule release(owner, [](void *p){delete reinterpret_cast<std::vector<T> *>(p);});
+    return py::array_t<T>(owner->size(), owner->data(), release);
+}
+
+//! Check the spread factor, raised as ValueError in python
+static size_t checkSpreadFactor(const size_t sf, const size_t ppm)
+{
+    if (sf < 5 or sf > 12) throw std::invalid_argument("sf="+std::to_string(sf)+" is not in 5 to 12");
+    if (ppm > sf) throw std::invalid_argument("failed check: PPM <= SF");
+    return sf;
+}
+
+/***********************************************************************
+ * Encode and decode
+ **********************************************************************/
+static py::array_t<uint16_t> encode(
+    InArray<uint8_t> payload, const size_t sf, const size_t rdd,
+    const bool crc, const bool explicitHeader, const size_t ppm)
+{
+    checkSpreadFactor(sf, ppm);
+    if (rdd > 4) throw std::invalid_argument("rdd="+std::to_string(rdd)+" is not in 0 to 4");
+
+    LoRaPacketEncoder encoder;
+    encoder.sf = sf;
+    encoder.ppm = ppm;
+    encoder.rdd = rdd;
+    encoder.crc = crc;
+    encoder.explicitHeader = explicitHeader;
+
+    const uint8_t *in = payload.data();
+    const size_t length = payload.size();
+    std::vector<uint16_t> symbols;
+    {
+        py::gil_scoped_release release;
+        encoder.encode(in, length, symbols);
+    }
+    return toArray(std::move(symbols));
+}
+
+/*!
+ * Decode a packet of symbols, return the payload or None when the decode fails.
+ * With retries, the alternates and margins from a demodulator with alternates
+ * enabled substitute the runner-up bins of the least reliable symbols.
+ */
+static py::object decode(
+    InArray<uint16_t> symbols, const size_t sf, const size_t rdd,
+    const bool crcCheck, const bool explicitHeader, const size_t length,
+    const size_t ppm, const size_t retries, py::object alternates, py::object margins)
+{
+    checkSpreadFactor(sf, ppm);
+    if (retries != 0 and (alternates.is_none() or margins.is_none()))
+    {
+        throw std::invalid_argument("retries need the alternates and margins of the symbols");
+    }
+    InArray<uint16_t> alts;
+    InArray<float> margs;
+    if (retries != 0)
+    {
+        alts = alternates.cast<InArray<uint16_t>>();
+        margs = margins.cast<InArray<float>>();
+        if (alts.size() != symbols.size() or margs.size() != symbols.size())
+        {
+            throw std::invalid_argument("alternates and margins must have one entry per symbol");
+        }
+    }
+
+    LoRaPacketDecoder decoder;
+    decoder.sf = sf;
+    decoder.ppm = ppm;
+    decoder.rdd = rdd;
+    decoder.crcc = crcCheck;
+    decoder.errorCheck = true;
+    decoder.explicitHeader = explicitHeader;
+    decoder.dataLength = length;
+    decoder.retries = retries;
+
+    const uint16_t *in = symbols.data();
+    const size_t numSyms = symbols.size();
+    const uint16_t *alt = (retries != 0) ? alts.data() : nullptr;
+    const float *marg = (retries != 0) ? margs.data() : nullptr;
+    LoRaPacketDecoder::Status status;
+    std::vector<uint8_t> bytes;
+    {
+        py::gil_scoped_release release;
+        status = decoder.decode(in, numSyms, alt, marg);
+        if (status == LoRaPacketDecoder::DECODE_OK)
+        {
+            bytes.assign(decoder.payload(), decoder.payload() + decoder.length());
+        }
+    }
+    if (status != LoRaPacketDecoder::DECODE_OK) return py::none();
+    return toArray(std::move(bytes));
+}
+
+/***********************************************************************
+ * Modulate
+ **********************************************************************/
+static py::array_t<Sample> modulate(
+    InArray<uint16_t> symbols, const size_t sf, const unsigned char sync,
+    const float amplitude, const size_t padding, const double ovs)
+{
+    checkSpreadFactor(sf, 0);
+    if (not (ovs >= 1 and ovs <= 256)) throw std::invalid_argument("ovs="+std::to_string(ovs)+" is not in 1 to 256");
+
+    LoRaModulator mod(sf);
+    mod.setSync(sync);
+    mod.setAmplitude(amplitude);
+    mod.setPadding(padding);
+    mod.setOvs(ovs);
+
+    const uint16_t *in = symbols.data();
+    const size_t numSyms = symbols.size();
+    std::vector<Sample> samps;
+    {
+        py::gil_scoped_release release;
+        samps.reserve(mod.maxFrameSamples(numSyms));
+        mod.modulateFrame(in, numSyms, samps);
+    }
+    return toArray(std::move(samps));
+}
+
+/***********************************************************************
+ * Demodulate
+ **********************************************************************/
+struct DemodPacket
+{
+    unsigned long long index;
+    std::vector<uint16_t> symbols;
+    std::vector<uint16_t> alternates;
+    std::vector<float> margins;
+    int freqError;
+    float fineFreqError;
+    float power;
+    float snr;
+};
+
+/*!
+ * A demodulator that keeps its state between calls,
+ * so that a long capture can be processed in chunks,
+ * and the tables are only generated once.
+ */
+class Demodulator
+{
+public:
+    Demodulator(const size_t sf, const unsigned char sync, const double threshold, const size_t mtu, const bool tracking, const bool alternates):
+        _demod(checkSpreadFactor(sf, 0)),
+        _alternates(alternates),
+        _index(0)
+    {
+        _demod.setSync(sync);
+        _demod.setThreshold(threshold);
+        _demod.setMTU(mtu);
+        _demod.enableTracking(tracking);
+        _demod.enableAlternates(alternates);
+        _demod.enableLabels(false);
+    }
+
+    /*!
+     * Demodulate the next chunk of samples.
+     * The steps read the numpy buffer in place, only the samples
+     * that do not complete a step are kept for the next call.
+     * \return a list of dicts with the packet symbols and the sync measurements,
+     * and the alternates and margins of the symbols when enabled
+     */
+    py::list process(InArray<Sample> samples)
+    {
+        const Sample *in = samples.data();
+        const size_t num = samples.size();
+        std::vector<DemodPacket> packets;
+        {
+            py::gil_scoped_release release;
+            _steps.process(_demod, in, num, [this, &packets](const Sample *p){return this->step(p, packets);});
+        }
+
+        py::list out;
+        for (auto &packet : packets)
+        {
+            py::dict d;
+            d["index"] = packet.index;
+            d["symbols"] = toArray(std::move(packet.symbols));
+            if (_alternates)
+            {
+                d["alternates"] = toArray(std::move(packet.alternates));
+                d["margins"] = toArray(std::move(packet.margins));
+            }
+            d["cfo"] = packet.freqError;
+            d["fineFreqError"] = packet.fineFreqError;
+            d["power"] = packet.power;
+            d["snr"] = packet.snr;
+            out.append(d);
+        }
+        return out;
+    }
+
+    //! Return to frame sync and drop the pending samples
+    void reset(void)
+    {
+        _demod.reset();
+        _steps.clear();
+        _index = 0;
+    }
+
+private:
+    size_t step(const Sample *in, std::vector<DemodPacket> &packets)
+    {
+        const size_t consumed = _demod.step(in);
+        _index += consumed;
+        if (_demod.syncFound())
+        {
+            _sync.index = _index + _demod.dataSymbolsDelay();
+            _sync.freqError = _demod.freqError();
+            _sync.power = _demod.power();
+            _sync.snr = _demod.snr();
+        }
+        if (_demod.packetReady())
+        {
+            packets.push_back(_sync);
+            packets.back().symbols.assign(_demod.symbols(), _demod.symbols() + _demod.numSymbols());
+            if (_alternates)
+            {
+                packets.back().alternates.assign(_demod.alternates(), _demod.alternates() + _demod.numSymbols());
+                packets.back().margins.assign(_demod.margins(), _demod.margins() + _demod.numSymbols());
+            }
+            packets.back().fineFreqError = _demod.fineFreqError();
+        }
+        return consumed;
+    }
+
+    LoRaDemodulator _demod;
+    const bool _alternates;
+    LoRaStepBuffer _steps;
+    unsigned long long _index;
+    DemodPacket _sync;
+};
+
+static py::list demodulate(
+    InArray<Sample> samples, const size_t sf, const unsigned char sync,
+    const double threshold, const size_t mtu, const bool tracking, const bool alternates)
+{
+    Demodulator demod(sf, sync, threshold, mtu, tracking, alternates);
+    return demod.process(samples);
+}
+
+/***********************************************************************
+ * Module
+ **********************************************************************/
+PYBIND11_MODULE(lora_phy, m)
+{
+    m.doc() = "LoRa PHY encoder, decoder, modulator and demodulator on numpy arrays";
+
+    m.def("encode", &encode,
+        "Encode a uint8 payload into uint16 symbols",
+        py::arg("payload"), py::arg("sf") = 10, py::arg("rdd") = 4,
+        py::arg("crc") = true, py::arg("explicit_header") = true, py::arg("ppm") = 0);
+
+    m.def("decode", &decode,
+        "Decode uint16 symbols into a uint8 payload, or None when the packet fails its checks, "
+        "retries need the alternates and margins of a demodulated packet",
+        py::arg("symbols"), py::arg("sf") = 10, py::arg("rdd") = 4,
+        py::arg("crc_check") = true, py::arg("explicit_header") = true, py::arg("length") = 8,
+        py::arg("ppm") = 0, py::arg("retries") = 0,
+        py::arg("alternates") = py::none(), py::arg("margins") = py::none());
+
+    m.def("modulate", &modulate,
+        "Modulate uint16 symbols into a complex64 frame with preamble and padding",
+        py::arg("symbols"), py::arg("sf") = 10, py::arg("sync") = 0x12,
+        py::arg("amplitude") = 1.0f, py::arg("padding") = 1, py::arg("ovs") = 1.0);
+
+    m.def("demodulate", &demodulate,
+        "Demodulate complex64 samples into a list of packets of uint16 symbols",
+        py::arg("samples"), py::arg("sf") = 10, py::arg("sync") = 0x12,
+        py::arg("threshold") = -30.0, py::arg("mtu") = 256, py::arg("tracking") = true,
+        py::arg("alternates") = false);
+
+    py::class_<Demodulator>(m, "Demodulator",
+        "A demodulator that keeps its state between chunks of a capture")
+        .def(py::init<size_t, unsigned char, double, size_t, bool, bool>(),
+            py::arg("sf") = 10, py::arg("sync") = 0x12,
+            py::arg("threshold") = -30.0, py::arg("mtu") = 256, py::arg("tracking") = true,
+            py::arg("alternates") = false)
+        .def("process", &Demodulator::process, py::arg("samples"))
+        .def("reset", &Demodulator::reset);
+}
@@ -0,0 +1,90 @@
+#!/usr/bin/env python
+
+"""
+Tests of the lora_phy python module, run by ctest when pybind11 is found.
+The module directory must be on the PYTHONPATH.
+"""
+
+import unittest
+import numpy as np
+import lora_phy
+
+def noisy(samps, sigma, seed=0):
+    rng = np.random.RandomState(seed)
+    noise = sigma*(rng.randn(samps.size) + 1j*rng.randn(samps.size))
+    return (samps + noise).astype(np.complex64)
+
+class TestLoRaPhy(unittest.TestCase):
+
+    def test_loopback(self):
+        payload = np.frombuffer(b'hello world', np.uint8)
+        for sf in (5, 7, 9, 12):
+            syms = lora_phy.encode(payload, sf=sf)
+            samps = np.concatenate([np.zeros(4 << sf, np.complex64), lora_phy.modulate(syms, sf=sf, padding=4)])
+            packets = lora_phy.demodulate(noisy(samps, 0.1), sf=sf, threshold=-5.0, mtu=syms.size)
+            self.assertEqual(len(packets), 1)
+            np.testing.assert_array_equal(packets[0]['symbols'], syms)
+            self.assertEqual(lora_phy.decode(packets[0]['symbols'], sf=sf).tobytes(), payload.tobytes())
+
+    def test_chunks(self):
+        sf = 9
+        syms = lora_phy.encode(np.arange(32, dtype=np.uint8), sf=sf)
+        frame = lora_phy.modulate(syms, sf=sf, padding=4)
+        samps = noisy(np.concatenate([frame, frame, frame]), 0.1)
+        whole = lora_phy.demodulate(samps, sf=sf, threshold=-5.0)
+
+        demod = lora_phy.Demodulator(sf=sf, threshold=-5.0)
+        chunked = []
+        for chunk in np.array_split(samps, 37):
+            chunked += demod.process(chunk)
+        self.assertEqual(len(whole), 3)
+        self.assertEqual([p['index'] for p in chunked], [p['index'] for p in whole])
+        for a, b in zip(chunked, whole):
+            np.testing.assert_array_equal(a['symbols'], b['symbols'])
+
+    def test_modulate_ovs(self):
+        sf = 7
+        syms = lora_phy.encode(np.arange(8, dtype=np.uint8), sf=sf)
+        frame = lora_phy.modulate(syms, sf=sf, padding=2)
+        self.assertEqual(frame.size, int((14.25 + syms.size + 2)*(1 << sf)))
+        self.assertEqual(lora_phy.modulate(syms, sf=sf, padding=2, ovs=2.0).size, 2*frame.size)
+        for ovs in (0.5, 300.0, float('nan')):
+            with self.assertRaises(ValueError):
+                lora_phy.modulate(syms, sf=sf, ovs=ovs)
+
+    def test_retries(self):
+        sf = 8
+        payload = np.arange(16, dtype=np.uint8)
+        syms = lora_phy.encode(payload, sf=sf, rdd=1)
+
+        #a parity only coding rate detects the error in a payload symbol but cannot correct it
+        bad = syms.copy()
+        bad[10] = (bad[10] + 37) % (1 << sf)
+        self.assertIsNone(lora_phy.decode(bad, sf=sf, rdd=1))
+
+        #the runner-up of the least reliable symbol is the transmitted one
+        margins = np.full(syms.size, 20.0, np.float32)
+        margins[10] = 0.5
+        result = lora_phy.decode(bad, sf=sf, rdd=1, retries=4, alternates=syms, margins=margins)
+        self.assertEqual(result.tobytes(), payload.tobytes())
+
+        with self.assertRaises(ValueError):
+            lora_phy.decode(bad, sf=sf, rdd=1, retries=4)
+        with self.assertRaises(ValueError):
+            lora_phy.decode(bad, sf=sf, rdd=1, retries=4, alternates=syms[1:], margins=margins)
+
+    def test_demod_alternates(self):
+        sf = 9
+        syms = lora_phy.encode(np.arange(24, dtype=np.uint8), sf=sf)
+        samps = noisy(lora_phy.modulate(syms, sf=sf, padding=4), 0.1)
+        packets = lora_phy.demodulate(samps, sf=sf, threshold=-5.0, mtu=syms.size, alternates=True)
+        self.assertEqual(len(packets), 1)
+        self.assertEqual(packets[0]['alternates'].size, syms.size)
+        self.assertEqual(packets[0]['margins'].size, syms.size)
+        self.assertTrue(np.all(packets[0]['margins'] > 0))
+        result = lora_phy.decode(packets[0]['symbols'], sf=sf, retries=8,
+            alternates=packets[0]['alternates'], margins=packets[0]['margins'])
+        self.assertEqual(result.tobytes(), np.arange(24, dtype=np.uint8).tobytes())
+
+if __name__ == '__main__':
+    unittest.main()
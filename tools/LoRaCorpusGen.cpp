@@ -0,0 +1,235 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include "LoRaPacketEncoder.hpp"
+#include "LoRaModulator.hpp"
+#include "LoRaBfpCodec.hpp"
+#include "LoRaCodes.hpp"
+#include <json.hpp>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+
+using json = nlohmann::json;
+
+/***********************************************************************
+ * Generator of the golden regression corpus in corpus/.
+ *
+ * Each capture holds one or two frames of a radio configuration,
+ * with the impairments of a cheap receiver: a carrier offset
+ * of a fraction of a bin, a fractional timing offset, a DC offset,
+ * and noise. The samples are stored as 6-bit BFP captures,
+ * which the LoRa BFP Capture Source replays, and manifest.json
+ * lists the configuration and the expected payloads of each capture.
+ *
+ * The drift cases also render the frames with a sample clock
+ * that runs fast or slow by some parts per million. The drift moves
+ * the sampling phase over the capture, so it stays small enough
+ * that the phase does not walk into the timing offsets below.
+ *
+ * The timing offsets are those that the demodulator handles today:
+ * it does not correct a fractional timing offset, and offsets
+ * of 0.2 to 0.6 of a chip cause symbol errors at one sample per chip.
+ *
+ * The corpus is committed, so the test checks the receiver against
+ * these fixed captures, not against the current modulator.
+ * Rerun only to add captures, never to make a failing test pass:
+ * the existing captures and their manifest entries are kept
+ * unless --force is given, and each case draws its payloads and noise
+ * from a seed of its own name, so adding a case changes no other.
+ **********************************************************************/
+
+struct CorpusCase
+{
+    std::string name;
+    size_t sf;
+    std::string cr;
+    unsigned sync;
+    size_t ppm; //!< symbol size in bits (PPM), zero for SF, not parts per million
+    bool explicitHeader;
+    bool crc;
+    size_t frames;
+    size_t length;
+    double snr; //!< dB over the noise in the channel bandwidth
+    double cfo; //!< carrier offset in bins
+    double delay; //!< fractional timing offset in samples
+    double drift; //!< sample clock offset in parts per million
+};
+
+//! The oversampling ratio that sets the resolution of the timing offset
+static const size_t OVS = 10;
+
+static const std::vector<CorpusCase> corpusCases = {
+    {"sf7_cr45_sync12", 7, "4/5", 0x12, 0, true, true, 2, 16, 10.0, 0.21, 0.0, 0.0},
+    {"sf8_cr45_sync12", 8, "4/5", 0x12, 0, true, true, 2, 16, 8.0, -0.33, 0.8, 0.0},
+    {"sf9_cr45_sync34", 9, "4/5", 0x34, 0, true, true, 1, 16, 6.0, 0.12, 0.0, 0.0},
+    {"sf10_cr45_sync12", 10, "4/5", 0x12, 0, true, true, 1, 16, 4.0, -0.18, 0.7, 0.0},
+    {"sf11_cr45_ppm9", 11, "4/5", 0x12, 9, true, true, 1, 12, 2.0, 0.27, 0.9, 0.0},
+    {"sf12_cr45_ppm10", 12, "4/5", 0x12, 10, true, true, 1, 8, 0.0, -0.09, 0.1, 0.0},
+    {"sf7_cr46_sync12", 7, "4/6", 0x12, 0, true, true, 2, 16, 10.0, 0.38, 0.9, 0.0},
+    {"sf7_cr47_sync12", 7, "4/7", 0x12, 0, true, true, 2, 16, 10.0, -0.27, 0.8, 0.0},
+    {"sf7_cr48_sync12", 7, "4/8", 0x12, 0, true, true, 2, 16, 10.0, 0.05, 0.0, 0.0},
+    {"sf7_cr48_implicit", 7, "4/8", 0x12, 0, false, false, 2, 8, 10.0, -0.42, 0.7, 0.0},
+    {"sf9_cr47_sync8e", 9, "4/7", 0x8e, 0, true, true, 1, 24, 6.0, 0.31, 0.9, 0.0},
+    {"sf5_cr45_sync12", 5, "4/5", 0x12, 0, true, true, 2, 16, 16.0, 0.17, 0.0, 0.0},
+    {"sf6_cr46_sync12", 6, "4/6", 0x12, 0, true, true, 2, 16, 14.0, -0.24, 0.9, 0.0},
+    {"sf7_cr45_drift20", 7, "4/5", 0x12, 0, true, true, 2, 16, 10.0, 0.14, 0.0, 20.0},
+    {"sf7_cr48_drift-10", 7, "4/8", 0x12, 0, true, true, 2, 16, 10.0, -0.23, 0.0, -10.0},
+    {"sf9_cr45_drift10", 9, "4/5", 0x12, 0, true, true, 1, 16, 6.0, 0.26, 0.0, 10.0},
+    {"sf12_cr45_ppm10_drift10", 12, "4/5", 0x12, 10, true, true, 1, 8, 2.0, -0.11, 0.8, 10.0},
+};
+
+//! A seed from the case name that is the same on every platform (FNV-1a)
+static unsigned caseSeed(const std::string &name)
+{
+    unsigned hash = 2166136261u;
+    for (const auto ch : name) hash = (hash ^ uint8_t(ch))*16777619u;
+    return hash;
+}
+
+static std::string toHex(const std::vector<uint8_t> &bytes)
+{
+    std::string hex;
+    char buff[3];
+    for (const auto b : bytes)
+    {
+        std::snprintf(buff, sizeof(buff), "%02x", b);
+        hex += buff;
+    }
+    return hex;
+}
+
+int main(int argc, char **argv)
+{
+    const bool force = (argc == 3 and std::string(argv[1]) == "--force");
+    if (argc != 2 and not force)
+    {
+        std::cerr << "LoRaCorpusGen [--force] <corpus directory>" << std::endl
+            << "  existing captures are kept unless --force is given" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const std::string dir(argv[argc-1]);
+
+    //the entries of the captures already in the corpus
+    std::map<std::string, json> existing;
+    std::vector<std::string> existingOrder;
+    std::ifstream manifestIn(dir + "/manifest.json");
+    if (manifestIn)
+    {
+        const auto previous = json::parse(manifestIn);
+        for (const auto &capture : previous["captures"])
+        {
+            const auto file = capture["file"].get<std::string>();
+            existing[file] = capture;
+            existingOrder.push_back(file);
+        }
+    }
+
+    json manifest;
+    manifest["captures"] = json::array();
+    for (const auto &c : corpusCases)
+    {
+        const auto file = c.name + ".lbfp";
+        if (not force and existing.count(file) != 0 and std::ifstream(dir + "/" + file).good())
+        {
+            manifest["captures"].push_back(existing.at(file));
+            existing.erase(file);
+            std::cout << file << ": kept" << std::endl;
+            continue;
+        }
+        existing.erase(file);
+
+        std::mt19937 rng(caseSeed(c.name));
+        const size_t N = size_t(1) << c.sf;
+        size_t rdd = 0;
+        parseCodingRate(c.cr, rdd);
+        LoRaPacketEncoder encoder;
+        encoder.sf = c.sf;
+        encoder.ppm = c.ppm;
+        encoder.rdd = rdd;
+        encoder.explicitHeader = c.explicitHeader;
+        encoder.crc = c.crc;
+
+        //noise, then each frame followed by noise
+        std::vector<std::complex<float>> samps(2*N);
+        json payloads = json::array();
+        for (size_t f = 0; f < c.frames; f++)
+        {
+            std::vector<uint8_t> payload(c.length);
+            for (auto &b : payload) b = uint8_t(rng());
+            payloads.push_back(toHex(payload));
+            std::vector<uint16_t> symbols;
+            encoder.encode(payload.data(), payload.size(), symbols);
+
+            //oversample, then keep every OVS sample from the timing offset
+            LoRaModulator mod(c.sf);
+            mod.setSync(c.sync);
+            mod.setAmplitude(1.0f);
+            mod.setOvs(OVS*(1.0 + c.drift*1e-6));
+            std::vector<std::complex<float>> frame;
+            mod.modulateFrame(symbols.data(), symbols.size(), frame);
+            for (size_t i = size_t(c.delay*OVS + 0.5); i < frame.size(); i += OVS) samps.push_back(frame[i]);
+            samps.resize(samps.size() + 3*N);
+        }
+
+        //receiver impairments
+        std::normal_distribution<float> noise(0.0f, float(std::pow(10.0, -c.snr/20)/std::sqrt(2.0)));
+        const std::complex<float> dc(0.05f, -0.03f);
+        for (size_t i = 0; i < samps.size(); i++)
+        {
+            samps[i] *= std::polar(1.0f, float(2*M_PI*c.cfo*i/N));
+            samps[i] = 0.25f*(samps[i] + std::complex<float>(noise(rng), noise(rng))) + dc;
+        }
+
+        //6-bit BFP capture, the last block zero padded
+        LoRaBfpCodec codec(6, 32);
+        const size_t numSamps = samps.size();
+        samps.resize((numSamps + codec.blockSize() - 1)/codec.blockSize()*codec.blockSize());
+        std::vector<uint8_t> bytes(LoRaBfpCodec::HEADER_SIZE + samps.size()/codec.blockSize()*codec.blockBytes());
+        codec.encodeHeader(bytes.data(), numSamps);
+        for (size_t i = 0; i < samps.size()/codec.blockSize(); i++)
+        {
+            codec.encode(samps.data() + i*codec.blockSize(), bytes.data() + LoRaBfpCodec::HEADER_SIZE + i*codec.blockBytes());
+        }
+        std::ofstream out(dir + "/" + file, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+        if (not out)
+        {
+            std::cerr << "cannot write " << dir << "/" << file << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        json capture;
+        capture["file"] = file;
+        capture["sf"] = c.sf;
+        capture["cr"] = c.cr;
+        capture["sync"] = c.sync;
+        capture["ppm"] = c.ppm;
+        capture["explicit"] = c.explicitHeader;
+        capture["crc"] = c.crc;
+        capture["dataLength"] = c.length;
+        capture["snr"] = c.snr;
+        capture["cfo"] = c.cfo;
+        capture["delay"] = c.delay;
+        capture["drift"] = c.drift;
+        capture["payloads"] = payloads;
+        manifest["captures"].push_back(capture);
+        std::cout << file << ": " << numSamps << " samples, " << bytes.size() << " bytes" << std::endl;
+    }
+
+    //captures of cases since removed from the list stay in the corpus
+    for (const auto &file : existingOrder)
+    {
+        if (existing.count(file) != 0) manifest["captures"].push_back(existing.at(file));
+    }
+
+    std::ofstream out(dir + "/manifest.json");
+    out << manifest.dump(4) << std::endl;
+    return out ? EXIT_SUCCESS : EXIT_FAILURE;
+}
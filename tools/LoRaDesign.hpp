@@ -0,0 +1,193 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#pragma once
+#include <Pothos/Exception.hpp>
+#include <json.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <functional>
+
+/***********************************************************************
+ * Conversion of a design saved by the graphical designer (.pth)
+ * into the JSON topology format, for the LoRa Headless runner.
+ *
+ * The properties of each block become its factory arguments and calls,
+ * as described by the block documentation, and the breakers are replaced
+ * by the connections they stand for. Disabled blocks and connections
+ * are left out, and so are the blocks under the strip prefixes.
+ * Blocks whose only consumers were stripped are pruned as well,
+ * except the LoRa blocks.
+ **********************************************************************/
+
+//! The options of the conversion
+struct DesignOptions
+{
+    std::vector<std::string> strip = {"/plotters/", "/widgets/"};
+    std::map<std::string, std::string> globals;
+    bool prune = true;
+    nlohmann::json threadPool = nlohmann::json::object();
+};
+
+/*!
+ * Convert a saved design into the JSON topology format.
+ * The describe function returns the block description of a factory path.
+ */
+inline nlohmann::json convertDesign(const nlohmann::json &design, const DesignOptions &cfg,
+    const std::function<nlohmann::json(const std::string &)> &describe, std::ostream &log)
+{
+    std::vector<nlohmann::json> objects;
+    for (const auto &page : design.value("pages", nlohmann::json::array()))
+    {
+        for (const auto &obj : page.value("graphObjects", nlohmann::json::array()))
+        {
+            if (obj.value("enabled", true)) objects.push_back(obj);
+        }
+    }
+
+    //the blocks that remain, by id
+    std::map<std::string, nlohmann::json> blocks;
+    for (const auto &obj : objects)
+    {
+        if (obj.value("what", "") != "Block") continue;
+        const auto path = obj.value("path", "");
+        bool stripped = false;
+        for (const auto &prefix : cfg.strip) stripped = stripped or path.compare(0, prefix.size(), prefix) == 0;
+        if (stripped) log << "strip " << obj.value("id", "") << " " << path << std::endl;
+        else blocks[obj.value("id", "")] = obj;
+    }
+
+    //stream connections as [src, srcPort, dst, dstPort], breakers joined by node name
+    std::vector<std::vector<std::string>> edges;
+    std::map<std::string, std::string> breakerNodes;
+    std::set<std::string> inputBreakers;
+    for (const auto &obj : objects)
+    {
+        if (obj.value("what", "") != "Breaker") continue;
+        breakerNodes[obj.value("id", "")] = obj.value("nodeName", "");
+        if (obj.value("isInput", false)) inputBreakers.insert(obj.value("id", ""));
+    }
+    std::multimap<std::string, std::pair<std::string, std::string>> breakerSources, breakerSinks;
+    for (const auto &obj : objects)
+    {
+        if (obj.value("what", "") != "Connection") continue;
+        if (obj.contains("sigSlots"))
+        {
+            for (const auto &sigSlot : obj["sigSlots"])
+            {
+                edges.push_back({obj.value("signalId", ""), sigSlot[0].get<std::string>(), obj.value("slotId", ""), sigSlot[1].get<std::string>()});
+            }
+            continue;
+        }
+        const auto src = obj.value("outputId", "");
+        const auto dst = obj.value("inputId", "");
+        const auto srcPort = obj.value("outputKey", "");
+        const auto dstPort = obj.value("inputKey", "");
+        if (inputBreakers.count(dst) != 0) breakerSources.emplace(breakerNodes[dst], std::make_pair(src, srcPort));
+        else if (breakerNodes.count(src) != 0) breakerSinks.emplace(breakerNodes[src], std::make_pair(dst, dstPort));
+        else edges.push_back({src, srcPort, dst, dstPort});
+    }
+    for (const auto &source : breakerSources)
+    {
+        const auto sinks = breakerSinks.equal_range(source.first);
+        for (auto it = sinks.first; it != sinks.second; ++it)
+        {
+            edges.push_back({source.second.first, source.second.second, it->second.first, it->second.second});
+        }
+    }
+
+    //drop the connections of removed blocks, then prune what fed only removed blocks
+    std::set<std::string> producers;
+    for (const auto &edge : edges) producers.insert(edge[0]);
+    while (true)
+    {
+        std::vector<std::vector<std::string>> kept;
+        std::set<std::string> hasConsumer;
+        for (const auto &edge : edges)
+        {
+            if (blocks.count(edge[0]) == 0 or blocks.count(edge[2]) == 0) continue;
+            kept.push_back(edge);
+            hasConsumer.insert(edge[0]);
+        }
+        edges.swap(kept);
+
+        std::vector<std::string> dead;
+        for (const auto &block : blocks)
+        {
+            if (not cfg.prune or producers.count(block.first) == 0 or hasConsumer.count(block.first) != 0) continue;
+            if (block.second.value("path", "").compare(0, 6, "/lora/") == 0) continue;
+            dead.push_back(block.first);
+        }
+        if (dead.empty()) break;
+        for (const auto &id : dead)
+        {
+            log << "prune " << id << " " << blocks[id].value("path", "") << std::endl;
+            blocks.erase(id);
+        }
+    }
+
+    nlohmann::json topology;
+    topology["threadPools"]["default"] = cfg.threadPool;
+
+    //the globals of the design in order, overrides in place or appended
+    topology["globals"] = nlohmann::json::array();
+    std::set<std::string> overridden;
+    for (const auto &global : design.value("globals", nlohmann::json::array()))
+    {
+        const auto name = global.value("name", "");
+        const auto it = cfg.globals.find(name);
+        if (it != cfg.globals.end()) overridden.insert(name);
+        topology["globals"].push_back({{"name", name}, {"value", (it != cfg.globals.end()) ? it->second : global.value("value", "")}});
+    }
+    for (const auto &global : cfg.globals)
+    {
+        if (overridden.count(global.first) == 0) topology["globals"].push_back({{"name", global.first}, {"value", global.second}});
+    }
+
+    //arguments and calls from the block description, the values stay expressions
+    topology["blocks"] = nlohmann::json::array();
+    for (const auto &entry : blocks)
+    {
+        const auto &obj = entry.second;
+        const auto path = obj.value("path", "");
+        const auto desc = describe(path);
+
+        std::map<std::string, std::string> values;
+        for (const auto &param : desc.value("params", nlohmann::json::array()))
+        {
+            if (param.contains("default")) values[param.value("key", "")] = param.value("default", "");
+        }
+        for (const auto &prop : obj.value("properties", nlohmann::json::array()))
+        {
+            values[prop.value("key", "")] = prop.value("value", "");
+        }
+        auto value = [&](const std::string &key)
+        {
+            const auto it = values.find(key);
+            if (it == values.end()) throw Pothos::NotFoundException("LoRaHeadless::convertDesign("+entry.first+")", "no value for "+key);
+            return it->second;
+        };
+
+        nlohmann::json block;
+        block["id"] = entry.first;
+        block["path"] = path;
+        block["threadPool"] = "default";
+        block["args"] = nlohmann::json::array();
+        for (const auto &arg : desc.value("args", nlohmann::json::array())) block["args"].push_back(value(arg.get<std::string>()));
+        block["calls"] = nlohmann::json::array();
+        for (const auto &call : desc.value("calls", nlohmann::json::array()))
+        {
+            nlohmann::json c = nlohmann::json::array({call.value("name", "")});
+            for (const auto &arg : call.value("args", nlohmann::json::array())) c.push_back(value(arg.get<std::string>()));
+            block["calls"].push_back(c);
+        }
+        topology["blocks"].push_back(block);
+    }
+
+    topology["connections"] = nlohmann::json::array();
+    for (const auto &edge : edges) topology["connections"].push_back(edge);
+    return topology;
+}
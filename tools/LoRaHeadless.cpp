@@ -0,0 +1,241 @@
+// Copyright (c) 2016-2016 Lime Microsystems
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Init.hpp>
+#include <Pothos/Framework.hpp>
+#include <Pothos/Plugin.hpp>
+#include <json.hpp>
+#include "LoRaDesign.hpp"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <csignal>
+#include <cstdlib>
+
+using json = nlohmann::json;
+
+/***********************************************************************
+ * Headless runner for topologies saved by the graphical designer (.pth).
+ *
+ * The saved design is converted into the JSON topology format
+ * (see LoRaDesign.hpp), with the block descriptions from the
+ * documentation in the plugin registry. By default the plotter
+ * and widget blocks are stripped, as they need the GUI.
+ *
+ * All blocks run in one thread pool with the given settings.
+ * Every interval, the runner prints the rates of each block
+ * from the topology statistics until interrupted.
+ **********************************************************************/
+
+struct RunnerConfig : DesignOptions
+{
+    std::string path;
+    bool dump = false;
+    double interval = 5.0;
+    double duration = 0.0;
+};
+
+static volatile std::sig_atomic_t stopRequested = 0;
+
+static void handleSignal(int)
+{
+    stopRequested = 1;
+}
+
+static std::vector<std::string> parseList(const std::string &s)
+{
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) if (not item.empty()) out.push_back(item);
+    return out;
+}
+
+static bool parseArgs(int argc, char **argv, RunnerConfig &cfg)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        const auto eq = arg.find('=');
+        const auto key = arg.substr(0, eq);
+        const auto value = (eq == std::string::npos) ? std::string() : arg.substr(eq+1);
+        if (arg.compare(0, 2, "--") != 0)
+        {
+            if (not cfg.path.empty()) return false;
+            cfg.path = arg;
+        }
+        else if (key == "--threads") cfg.threadPool["numThreads"] = std::stoul(value);
+        else if (key == "--priority") cfg.threadPool["priority"] = std::stod(value);
+        else if (key == "--affinity-mode") cfg.threadPool["affinityMode"] = value;
+        else if (key == "--affinity")
+        {
+            cfg.threadPool["affinity"] = json::array();
+            for (const auto &cpu : parseList(value)) cfg.threadPool["affinity"].push_back(std::stoul(cpu));
+        }
+        else if (key == "--yield-mode") cfg.threadPool["yieldMode"] = value;
+        else if (key == "--strip") cfg.strip = parseList(value);
+        else if (key == "--global")
+        {
+            const auto assign = value.find('=');
+            if (assign == std::string::npos) return false;
+            cfg.globals[value.substr(0, assign)] = value.substr(assign+1);
+        }
+        else if (key == "--keep-dead") cfg.prune = false;
+        else if (key == "--dump") cfg.dump = true;
+        else if (key == "--interval") cfg.interval = std::stod(value);
+        else if (key == "--duration") cfg.duration = std::stod(value);
+        else return false;
+    }
+    return not cfg.path.empty() and cfg.interval > 0.0;
+}
+
+static void usage(void)
+{
+    std::cerr << "LoRaHeadless [options] design.pth" << std::endl
+        << "  --threads=N            threads in the pool, default one per block" << std::endl
+        << "  --priority=P           thread priority from -1.0 to 1.0" << std::endl
+        << "  --affinity-mode=CPU    ALL, CPU, or NUMA" << std::endl
+        << "  --affinity=0,1         CPUs or NUMA nodes of the affinity mode" << std::endl
+        << "  --yield-mode=HYBRID    CONDITION, HYBRID, or SPIN" << std::endl
+        << "  --global=NAME=EXPR     override a global variable of the design" << std::endl
+        << "  --strip=/plotters/,/widgets/  block path prefixes to remove" << std::endl
+        << "  --keep-dead            keep blocks that only fed removed blocks" << std::endl
+        << "  --dump                 print the converted topology and exit" << std::endl
+        << "  --interval=5           seconds between the printed rates" << std::endl
+        << "  --duration=0           seconds to run, zero until interrupted" << std::endl;
+}
+
+//! The block description from the documentation in the plugin registry
+static json describeBlock(const std::string &path)
+{
+    const auto docPath = "/blocks/docs" + path;
+    if (not Pothos::PluginRegistry::exists(docPath))
+    {
+        throw Pothos::NotFoundException("LoRaHeadless::describeBlock("+path+")", "no block description");
+    }
+    return json::parse(Pothos::PluginRegistry::get(docPath).getObject().extract<std::string>());
+}
+
+//! The counters of one block from a statistics query
+struct BlockCounters
+{
+    unsigned long long inElements = 0;
+    unsigned long long outElements = 0;
+    unsigned long long messages = 0;
+    unsigned long long workNs = 0;
+};
+
+static std::map<std::string, BlockCounters> parseStats(const std::string &statsJson)
+{
+    std::map<std::string, BlockCounters> out;
+    const auto stats = json::parse(statsJson);
+    for (const auto &entry : stats.items())
+    {
+        const auto &block = entry.value();
+        if (not block.is_object()) continue;
+        auto &counters = out[block.value("blockName", entry.key())];
+        for (const auto &port : block.value("inputStats", json::array()))
+        {
+            counters.inElements += port.value("totalElements", 0ull);
+            counters.messages += port.value("totalMessages", 0ull);
+        }
+        for (const auto &port : block.value("outputStats", json::array()))
+        {
+            counters.outElements += port.value("totalElements", 0ull);
+            counters.messages += port.value("totalMessages", 0ull);
+        }
+        counters.workNs += block.value("totalTimeWork", 0ull);
+    }
+    return out;
+}
+
+static void printRates(const double elapsed, const double dt,
+    const std::map<std::string, BlockCounters> &now, const std::map<std::string, BlockCounters> &last)
+{
+    std::cout << "[" << std::fixed << std::setprecision(1) << elapsed << " s]" << std::endl
+        << "  " << std::left << std::setw(24) << "block" << std::right
+        << std::setw(12) << "in Msps" << std::setw(12) << "out Msps"
+        << std::setw(12) << "msgs/s" << std::setw(8) << "busy%" << std::endl;
+    for (const auto &entry : now)
+    {
+        const auto it = last.find(entry.first);
+        const BlockCounters prev = (it == last.end()) ? BlockCounters() : it->second;
+        const auto &cur = entry.second;
+        std::cout << "  " << std::left << std::setw(24) << entry.first << std::right << std::setprecision(3)
+            << std::setw(12) << (cur.inElements - prev.inElements)/dt/1e6
+            << std::setw(12) << (cur.outElements - prev.outElements)/dt/1e6
+            << std::setprecision(1)
+            << std::setw(12) << (cur.messages - prev.messages)/dt
+            << std::setw(8) << 100.0*(cur.workNs - prev.workNs)/(dt*1e9) << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    RunnerConfig cfg;
+    if (not parseArgs(argc, argv, cfg))
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        Pothos::ScopedInit init;
+
+        std::ifstream file(cfg.path);
+        if (not file) throw Pothos::FileException("LoRaHeadless("+cfg.path+")", "cannot open");
+        const auto design = json::parse(file);
+        const auto topologyJson = convertDesign(design, cfg, &describeBlock, std::cerr);
+        if (cfg.dump)
+        {
+            std::cout << topologyJson.dump(4) << std::endl;
+            return EXIT_SUCCESS;
+        }
+
+        auto topology = Pothos::Topology::make(topologyJson.dump());
+        topology->commit();
+        std::signal(SIGINT, handleSignal);
+        std::signal(SIGTERM, handleSignal);
+
+        const auto start = std::chrono::steady_clock::now();
+        auto lastTime = start;
+        auto last = parseStats(topology->queryJSONStats());
+        while (not stopRequested)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            const auto now = std::chrono::steady_clock::now();
+            const double elapsed = std::chrono::duration<double>(now - start).count();
+            const double dt = std::chrono::duration<double>(now - lastTime).count();
+            const bool done = cfg.duration > 0.0 and elapsed >= cfg.duration;
+            if (dt < cfg.interval and not done) continue;
+
+            const auto stats = parseStats(topology->queryJSONStats());
+            printRates(elapsed, dt, stats, last);
+            last = stats;
+            lastTime = now;
+            if (done) break;
+        }
+    }
+    catch (const Pothos::Exception &ex)
+    {
+        std::cerr << ex.displayText() << std::endl;
+        return EXIT_FAILURE;
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}